@@ -0,0 +1,42 @@
+/*
+  main.c calls helper() once, so it hardly matters that the call can't be
+  inlined. This program calls score() from scoring.c hundreds of millions of
+  times, so here it does matter. optimize.sh builds it in several ways and
+  compares them.
+
+  Because score() is in another translation unit, compiling hot_loop.c only
+  sees its declaration in scoring.h. Every call stays a real call, and the
+  loop can't be vectorized around it. LINK TIME OPTIMIZATION (-flto) has the
+  compiler look at all translation units together when linking, so it can
+  inline score() after all.
+
+  Usage: hot_loop [rounds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scoring.h"
+
+#define VALUE_COUNT 4096
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+
+    /* mostly in range, a few below and above */
+    static int values[VALUE_COUNT];
+    unsigned seed = 1;
+    for (int i = 0; i < VALUE_COUNT; ++i) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = (int)((seed >> 16) % 1010) - 5;
+    }
+
+    long total = 0;
+    for (int round = 0; round < rounds; ++round) {
+        for (int i = 0; i < VALUE_COUNT; ++i)
+            total += score(values[i]);
+    }
+
+    printf("total score: %ld\n", total);
+    return 0;
+}
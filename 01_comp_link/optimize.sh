@@ -0,0 +1,185 @@
+#! /bin/bash
+
+# Builds a multi file program in several ways, and reports what cross
+# translation unit optimization did to it:
+#
+#   O2        each .c compiled on its own, like compile.sh does
+#   LTO       -flto: link time optimization
+#   PGO       -fprofile-use: profile guided optimization, after a training run
+#   LTO+PGO   both
+#   ThinLTO   clang's -flto=thin, only if clang is installed
+#
+# For each build the report lists the size of the code, the cycles one run
+# takes, and which calls from one .c file to a function in another were
+# inlined. The disassembly of each build is saved as CONFIG.s next to the
+# report, for comparing by hand (diff -u O2.s LTO.s).
+#
+# Usage:
+#
+#   ./optimize.sh                     the two examples: main.c + helper.c,
+#                                     and hot_loop.c + scoring.c
+#   ./optimize.sh [-n NAME] [-a ARGS] file.c...
+#                                     your own program, run with ARGS
+#
+# Results go to lab_output/NAME/report.txt.
+
+set -e
+cd "$(dirname "$0")"
+
+if [ $# -eq 0 ]; then
+    "$0" -n helper main.c helper.c
+    "$0" -n hot_loop -a 20000 hot_loop.c scoring.c
+    exit
+fi
+
+name=program
+run_args=""
+while getopts "n:a:" option; do
+    case $option in
+        n) name=$OPTARG ;;
+        a) run_args=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+sources=("$@")
+
+out=lab_output/$name
+rm -rf "$out"
+mkdir -p "$out/plain" "$out/lto" "$out/pgo"
+gcc -O2 -o "$out/run_counted" run_counted.c
+
+# compile DIR FLAGS... compiles every source to DIR/NAME.o
+compile() {
+    local dir=$1
+    shift
+    for source in "${sources[@]}"; do
+        (set -x; gcc "$@" -c -o "$dir/$(basename "${source%.c}").o" "$source")
+    done
+}
+
+objects() {
+    for source in "${sources[@]}"; do
+        echo "$1/$(basename "${source%.c}").o"
+    done
+}
+
+# link CONFIG DIR FLAGS...
+link() {
+    local config=$1 dir=$2
+    shift 2
+    (set -x; gcc "$@" -o "$out/$config" $(objects "$dir"))
+}
+
+compile "$out/plain" -O2
+link O2 "$out/plain" -O2
+
+compile "$out/lto" -O2 -flto
+link LTO "$out/lto" -O2 -flto
+
+# PGO: build with counters, run once to write NAME.gcda profiles next to the
+# objects, then compile again to the same object names, which finds them.
+compile "$out/pgo" -O2 -fprofile-generate
+link pgo-train "$out/pgo" -O2 -fprofile-generate
+"$out/pgo-train" $run_args > /dev/null
+
+compile "$out/pgo" -O2 -fprofile-use
+link PGO "$out/pgo" -O2
+compile "$out/pgo" -O2 -flto -fprofile-use
+link LTO+PGO "$out/pgo" -O2 -flto
+
+configs=(O2 LTO PGO LTO+PGO)
+
+# gcc has no ThinLTO. Its -flto already splits the work done at link time
+# into partitions that are optimized in parallel, which is the idea behind
+# ThinLTO, but it decides what to inline before splitting.
+thin_note="ThinLTO: skipped, clang is not installed"
+if command -v clang > /dev/null; then
+    if (set -x; clang -O2 -flto=thin -fuse-ld=lld -o "$out/ThinLTO" \
+            "${sources[@]}"); then
+        configs+=(ThinLTO)
+        thin_note=""
+    else
+        thin_note="ThinLTO: skipped, clang -flto=thin failed (needs lld)"
+    fi
+fi
+
+# Which functions does one object call that another one defines?
+cross_calls=()
+for object in $(objects "$out/plain"); do
+    for symbol in $(nm --undefined-only "$object" | awk '{print $2}'); do
+        for other in $(objects "$out/plain"); do
+            if [ "$other" != "$object" ] &&
+               nm --defined-only "$other" | grep -qw "T $symbol"; then
+                cross_calls+=("$(basename "$object" .o) -> $symbol")
+            fi
+        done
+    done
+done
+
+# cycles CONFIG prints the unit, "cycles" or "tsc" (see run_counted.c), and
+# the fewest of 3 runs. Other programs and interrupts only ever make a run
+# slower.
+cycles() {
+    local best="" unit line count
+    for run in 1 2 3; do
+        line=$("$out/run_counted" "$out/$1" $run_args 2>&1 >/dev/null | tail -1)
+        unit=${line% *}
+        count=${line#* }
+        if [ -z "$best" ] || [ "$count" -lt "$best" ]; then
+            best=$count
+        fi
+    done
+    echo "$unit $best"
+}
+
+report=$out/report.txt
+{
+    echo "program: ${sources[*]} $run_args"
+    echo
+    echo "cross translation unit calls in the O2 build:"
+    for call in "${cross_calls[@]}"; do
+        echo "    $call"
+    done
+    echo
+
+    baseline=""
+    printf "%-9s %11s %15s %8s   %s\n" config "text bytes" "cycles" "speedup" \
+           "cross TU calls inlined"
+    for config in "${configs[@]}"; do
+        objdump -d --no-show-raw-insn "$out/$config" > "$out/$config.s"
+
+        # A call that is still there may be a tail call, which is a jmp, or
+        # go to a copy gcc specialized for its callers, like
+        # symbol.constprop.0, symbol.isra.0 or symbol.part.0.
+        inlined=()
+        for call in "${cross_calls[@]}"; do
+            symbol=${call#*-> }
+            if ! grep -Eq "(call|jmp)\s.*<$symbol(\.[a-z]+\.[0-9]+)?>" \
+                 "$out/$config.s"; then
+                inlined+=("$symbol")
+            fi
+        done
+
+        text=$(size "$out/$config" | awk 'NR == 2 {print $1}')
+        measured=$(cycles "$config")
+        unit=${measured% *}
+        count=${measured#* }
+        if [ -z "$baseline" ]; then
+            baseline=$count
+        fi
+        printf "%-9s %11s %15s %7.2fx   %s\n" "$config" "$text" "$count" \
+               "$(awk "BEGIN {print $baseline / $count}")" "${inlined[*]:--}"
+    done
+    echo
+
+    if [ "$unit" = "tsc" ]; then
+        echo "cycles are time stamp counter ticks, the cycle counter is not"
+        echo "available on this machine"
+    fi
+    if [ -n "$thin_note" ]; then
+        echo "$thin_note"
+    fi
+} > "$report"
+
+cat "$report"
@@ -0,0 +1,70 @@
+/* Runs a program and reports how many cycles it took, for optimize.sh.
+
+   Usage: run_counted program [arguments...]
+
+   Prints one line to stderr: "cycles N", or "tsc N" when the processor's
+   cycle counter isn't available (for example in many virtual machines). The
+   TSC (time stamp counter) ticks at a fixed rate instead of with the clock
+   speed, but it is still good for comparing two builds on the same machine.
+   The program's own output goes to /dev/null.
+*/
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+/* Opens a counter of the user space cycles of this process and every
+   process it starts from now on. Returns -1 if there is no such counter. */
+static int open_cycle_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.inherit = 1;        /* count the child too */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s program [arguments...]\n", argv[0]);
+        return 2;
+    }
+
+    int counter = open_cycle_counter();
+    uint64_t start = __rdtsc();
+    if (counter >= 0)
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+
+    pid_t child = fork();
+    if (child == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execv(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+
+    int status = 1;
+    if (child > 0)
+        waitpid(child, &status, 0);
+    uint64_t end = __rdtsc();
+
+    uint64_t cycles = 0;
+    if (counter >= 0 && read(counter, &cycles, sizeof(cycles)) == sizeof(cycles))
+        fprintf(stderr, "cycles %llu\n", (unsigned long long)cycles);
+    else
+        fprintf(stderr, "tsc %llu\n", (unsigned long long)(end - start));
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,11 @@
+#include "scoring.h"
+
+int score(int value) {
+    /* hot_loop.c almost never takes these two branches. Only profile guided
+       optimization can tell the compiler that. */
+    if (value < 0)
+        return 0;
+    if (value > 1000)
+        return 3000;
+    return value * 3 + 1;
+}
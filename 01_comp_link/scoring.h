@@ -0,0 +1,9 @@
+/* A small function for hot_loop.c to call from another translation unit. */
+
+#ifndef SCORING_H
+#define SCORING_H
+
+/* Clamps value to [0, 1000] and scales it. */
+int score(int value);
+
+#endif /* SCORING_H */
@@ -2,4 +2,4 @@
 
 set -x
 
-gcc -o main -Wall -Werror main.c
+gcc -O2 -o main -Wall -Werror main.c record.c record_table.c record_writer.c ../instrument/instrument.c
@@ -1,9 +1,22 @@
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-struct record {
-    char* name;
-    int age;
-};
+#include <sys/mman.h>
+
+#include "record.h"
+#include "record_table.h"
+#include "record_writer.h"
+
+#include "../instrument/instrument.h"
+
+/* A struct groups variables into one. Open record.h next to this file: it
+   defines struct record, the record used in this lesson, which groups a
+   name and an age. */
 
 void print_record(struct record rec) {
     printf("%s: %d\n", rec.name, rec.age);
@@ -29,9 +42,9 @@ void initialize_and_print_record() {
    keyword before creating record_t variables.
 
    TYPENAME_t means typedef of TYPENAME.
-*/
 
-typedef struct record record_t;
+   record.h typedefs struct record as record_t.
+*/
 
 /*
 NOTE: could have just written
@@ -48,6 +61,9 @@ NOTE: could have just written
 
    Somewhat unusual to copy structs by value in C. In C++ there's mechanisms to
    make this more efficient.
+
+   passing_cost.cpp measures what passing and returning structs of different
+   sizes by value actually costs, compared to passing pointers.
  */
 
 void struct_assignment() {
@@ -61,20 +77,16 @@ void struct_assignment() {
 
     /* make rec1 and rec2 have different values */
     rec2.age = 26;
+    print_record(rec1);
+    print_record(rec2);
 }
 
 /* Structs can also be passed to a function by value and returned by value.
 
-   Again, copying is done member by member.
+   Again, copying is done member by member. make_record in record.c returns
+   one: it fills in a local record_t, and returns a copy of it.
  */
 
-record_t make_record(char* name, int age) {
-    record_t rec;
-    rec.name = name;
-    rec.age = age;
-    return rec;
-}
-
 void return_struct_by_value() {
     puts(__func__);
     record_t rec = make_record("Franklin D. Roosevelt", 55);
@@ -112,12 +124,366 @@ void pointer_to_structure() {
     print_record_ptr(&rec);
 }
 
+/* A program that keeps millions of records and asks questions like "what
+   is the average age?" spends most of its time scanning one member of each
+   record. record_table.h explains why it is faster to store such records as
+   a struct of arrays, and provides a table that does.
+*/
+
+/* record_t_layout in record.c describes what record_t looks like, for
+   converting to and from a table. */
+
+void using_a_record_table() {
+    puts(__func__);
+    record_t presidents[] = {
+        {"Herbert Hoover", 86}, {"Calvin Coolidge", 84},
+        {"Warren G. Harding", 34}, {"Franklin D. Roosevelt", 55}
+    };
+
+    record_table_t table;
+    record_table_init(&table);
+    if (!record_table_append_structs(&table, presidents, 4, &record_t_layout) ||
+        !record_table_append(&table, "Robert Redford", 42)) {
+        puts("out of memory");
+        record_table_destroy(&table);
+        return;
+    }
+
+    age_stats_t stats = record_table_age_stats(&table);
+    printf("average age %.1f, youngest %d, oldest %d\n",
+           (double)stats.sum / stats.count, stats.min, stats.max);
+
+    /* filter, then project: the names of everyone aged 40 to 60 */
+    size_t rows[5];
+    char* names[5];
+    size_t found = record_table_select_age_between(&table, 40, 60, rows);
+    record_table_project(&table, rows, found, names, NULL);
+    for (size_t i = 0; i < found; ++i)
+        printf("aged 40 to 60: %s\n", names[i]);
+
+    /* and back to structs */
+    record_t last;
+    record_table_to_structs(&table, table.size - 1, 1, &last, &record_t_layout);
+    print_record(last);
+
+    record_table_destroy(&table);
+}
+
+double seconds_between(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/* The same two queries, written for an array of record_t. */
+
+long long sum_ages(record_t const * records, size_t count) {
+    long long sum = 0;
+    for (size_t i = 0; i < count; ++i)
+        sum += records[i].age;
+    return sum;
+}
+
+size_t count_age_between(record_t const * records, size_t count,
+                         int min_age, int max_age) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i)
+        found += records[i].age >= min_age && records[i].age <= max_age;
+    return found;
+}
+
+void compare_with_array_of_structs(size_t count) {
+    puts(__func__);
+    printf("%zu records\n", count);
+
+    record_t* records = malloc(count * sizeof(record_t));
+    record_table_t table;
+    record_table_init(&table);
+    if (records == NULL || !record_table_reserve(&table, count)) {
+        puts("out of memory");
+        free(records);
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        records[i].name = "Robert Redford";
+        records[i].age = (int)(i * 7919 % 100);
+    }
+    record_table_append_structs(&table, records, count, &record_t_layout);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long aos_sum = sum_ages(records, count);
+    size_t aos_found = count_age_between(records, count, 40, 60);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double aos_time = seconds_between(start, end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long soa_sum = record_table_age_stats(&table).sum;
+    size_t soa_found = record_table_count_age_between(&table, 40, 60);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double soa_time = seconds_between(start, end);
+
+    printf("array of structs %.3f s\nrecord table     %.3f s\n",
+           aos_time, soa_time);
+    if (aos_sum != soa_sum || aos_found != soa_found)
+        puts("results differ!");
+
+    record_table_destroy(&table);
+    free(records);
+}
+
+/* Printing millions of records with print_record is slow, because every
+   printf call locks the output and reads its format string again.
+   record_writer.h has a writer that does neither.
+*/
+
+void using_a_record_writer() {
+    puts(__func__);
+    fflush(stdout); /* the writer bypasses stdout's buffer */
+
+    record_writer_t* writer = record_writer_create(STDOUT_FILENO,
+                                                   "%d year old %s\n", 0);
+    if (writer == NULL) {
+        puts("out of memory");
+        return;
+    }
+    record_writer_write(writer, "Robert Redford", 42);
+    record_writer_write(writer, "Calvin Coolidge", 84);
+    record_writer_free(writer);
+}
+
+/* The writer takes a lot of shortcuts: names are read 16 bytes at a time,
+   even past their end, texts are stored 16 bytes at a time, a name may
+   force a flush in the middle of a record, and names of 4096 chars or more
+   go out through writev without being copied. So its output is checked
+   against fprintf with the same format, for:
+
+   - formats with the name first or the age first, with a field right at
+     the start or end, with %%, and with texts longer than 16 chars
+   - ages of 1, 2 and 3 or more digits, negative ones, INT_MAX and INT_MIN
+   - names from empty to 10000 chars, including every length that ends a
+     name right before a page that can't be read
+   - a buffer of the smallest size, so it fills up and flushes often
+
+   The output goes to temporary files, which are then compared. If they
+   differ, the program exits with an error.
+*/
+
+int failed_checks = 0;
+
+/* Reads all of file into a malloc'ed buffer, and sets *size. */
+char* read_back(FILE* file, size_t* size) {
+    fflush(file);
+    long length = ftell(file);
+    char* data = malloc(length > 0 ? length : 1);
+    rewind(file);
+    if (data == NULL || fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        return NULL;
+    }
+    *size = length;
+    return data;
+}
+
+typedef struct {
+    char const * format;
+    int name_first;
+} writer_format_t;
+
+void check_record_writer() {
+    puts(__func__);
+    writer_format_t const formats[] = {
+        {NULL, 1},
+        {"%s: %d\n", 1},
+        {"%d year old %s\n", 0},
+        {"%d%s", 0},
+        {"%s%d", 1},
+        {"100%% of %s is %d%%\n", 1},
+        {"%% the age of the person in this record is %d, the name is %s %%\n",
+         0},
+    };
+    int const ages[] = {0, 7, 10, 99, 100, 12345, -1, -99, -100, -12345,
+                        INT_MAX, INT_MIN};
+    size_t const lengths[] = {0, 1, 15, 16, 17, 31, 32, 100, 1000, 4000, 4095,
+                              4096, 4097, 10000};
+
+    /* Two pages, and the second can't be read: a short name ending right
+       before it must not make the writer crash. */
+    long page = sysconf(_SC_PAGESIZE);
+    char* pages = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char* long_name = malloc(10001);
+    if (pages == MAP_FAILED || long_name == NULL ||
+        mprotect(pages + page, page, PROT_NONE) != 0) {
+        puts("could not set up the check");
+        ++failed_checks;
+        return;
+    }
+    for (int i = 0; i < 10000; ++i)
+        long_name[i] = 'a' + i % 26;
+    memset(pages, 'x', page);
+
+    int mismatches = 0;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+        for (size_t buffer_size = 0; buffer_size <= 1; ++buffer_size) {
+            FILE* written = tmpfile();
+            FILE* expected = tmpfile();
+            if (written == NULL || expected == NULL) {
+                puts("could not make temporary files");
+                ++mismatches;
+                break;
+            }
+            /* 1 means as small as the writer allows */
+            record_writer_t* writer = record_writer_create(
+                fileno(written), formats[f].format, buffer_size);
+            char const * format = formats[f].format ? formats[f].format
+                                                    : "%s: %d\n";
+
+            for (size_t a = 0; a < sizeof(ages) / sizeof(ages[0]); ++a) {
+                int age = ages[a];
+                for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]);
+                     ++l) {
+                    char saved = long_name[lengths[l]];
+                    long_name[lengths[l]] = '\0';
+                    record_writer_write(writer, long_name, age);
+                    if (formats[f].name_first)
+                        fprintf(expected, format, long_name, age);
+                    else
+                        fprintf(expected, format, age, long_name);
+                    long_name[lengths[l]] = saved;
+                }
+                /* names that end 0 to 20 chars before the unreadable page */
+                for (int length = 0; length <= 20; ++length) {
+                    char* name = pages + page - 1 - length;
+                    pages[page - 1] = '\0';
+                    record_writer_write(writer, name, age);
+                    if (formats[f].name_first)
+                        fprintf(expected, format, name, age);
+                    else
+                        fprintf(expected, format, age, name);
+                }
+            }
+            if (!record_writer_free(writer))
+                ++mismatches;
+
+            size_t written_size = 0, expected_size = 0;
+            char* written_data = read_back(written, &written_size);
+            char* expected_data = read_back(expected, &expected_size);
+            if (written_data == NULL || expected_data == NULL ||
+                written_size != expected_size ||
+                memcmp(written_data, expected_data, written_size) != 0) {
+                printf("format \"%s\", buffer size %zu: output differs\n",
+                       format, buffer_size);
+                ++mismatches;
+            }
+            free(written_data);
+            free(expected_data);
+            fclose(written);
+            fclose(expected);
+        }
+    }
+
+    munmap(pages, 2 * page);
+    free(long_name);
+    if (mismatches != 0)
+        ++failed_checks;
+    printf("record_writer checked against fprintf: %s\n",
+           mismatches == 0 ? "no mismatches" : "MISMATCHES");
+}
+
+/* Writes the records with fprintf, the way print_record does. */
+double time_printf(record_t const * records, size_t count, FILE* out) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; ++i)
+        fprintf(out, "%s: %d\n", records[i].name, records[i].age);
+    fflush(out);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return seconds_between(start, end);
+}
+
+double time_record_writer(record_t const * records, size_t count, int fd) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    record_writer_t* writer = record_writer_create(fd, NULL, 0);
+    if (writer == NULL)
+        return 0;
+    for (size_t i = 0; i < count; ++i)
+        record_writer_write(writer, records[i].name, records[i].age);
+    if (!record_writer_free(writer))
+        puts("writing failed");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return seconds_between(start, end);
+}
+
+void compare_with_printf(size_t count) {
+    puts(__func__);
+    printf("%zu records\n", count);
+
+    record_t* records = malloc(count * sizeof(record_t));
+    if (records == NULL) {
+        puts("out of memory");
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        records[i].name = "Robert Redford";
+        records[i].age = (int)(i % 100);
+    }
+
+    /* once to /dev/null, where only our own work counts, and once to a real
+       file, which is deleted again afterwards.
+
+       On the machine this was written on, the writer is about 9.5x faster
+       to /dev/null, and under 6x to a file: there the kernel copying the
+       data into the page cache takes most of the writer's time, and costs
+       printf just the same. */
+    char path[] = "/tmp/recordsXXXXXX";
+    int file_fd = mkstemp(path);
+    FILE* null_file = fopen("/dev/null", "w");
+    if (file_fd < 0 || null_file == NULL) {
+        puts("could not open the output files");
+    } else {
+        unlink(path);
+        FILE* file = fdopen(dup(file_fd), "w");
+
+        double printf_time = time_printf(records, count, null_file);
+        double writer_time = time_record_writer(records, count,
+                                                fileno(null_file));
+        printf("/dev/null  printf %.3f s   record_writer %.3f s   %.1fx\n",
+               printf_time, writer_time, printf_time / writer_time);
+
+        printf_time = time_printf(records, count, file);
+        writer_time = time_record_writer(records, count, file_fd);
+        printf("file       printf %.3f s   record_writer %.3f s   %.1fx\n",
+               printf_time, writer_time, printf_time / writer_time);
+        fclose(file);
+    }
+
+    if (null_file != NULL)
+        fclose(null_file);
+    if (file_fd >= 0)
+        close(file_fd);
+    free(records);
+}
+
 int main(int argc, char* argv[]) {
-    initialize_and_print_record();
-    struct_assignment();
-    return_struct_by_value();
-    initialize_record_with_initializer_list();
-    pointer_to_structure();
-    
-    return 0;
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(initialize_and_print_record());
+    INSTRUMENTED(struct_assignment());
+    INSTRUMENTED(return_struct_by_value());
+    INSTRUMENTED(initialize_record_with_initializer_list());
+    INSTRUMENTED(pointer_to_structure());
+    INSTRUMENTED(using_a_record_table());
+    INSTRUMENTED(using_a_record_writer());
+    INSTRUMENTED(check_record_writer());
+
+    /* The number of records can be passed on the command line. */
+    size_t count = 10000000;
+    if (argc > 1)
+        count = strtoul(argv[1], NULL, 10);
+    if (count > 0)
+        INSTRUMENTED(compare_with_array_of_structs(count));
+    if (count > 0)
+        INSTRUMENTED(compare_with_printf(count));
+
+    return failed_checks == 0 ? 0 : 1;
 }
@@ -0,0 +1,206 @@
+/*
+   main.c passes record_t to print_record BY VALUE, copying it, and to
+   print_record_ptr BY POINTER. It says copying structs is "somewhat
+   unusual". How much does the copy actually cost, and at what size does it
+   start to matter?
+
+   This program measures the cost of one call for structs from 8 bytes to
+   4 KiB, passed in each of these ways:
+
+   by_value          int f(payload p)
+   by_pointer        int f(payload const * p)
+   by_const_ref      int f(payload const & p)       (C++ only)
+   by_move           f(std::move(p)) into by_value  (C++ only)
+   return_rvo        payload f()                    returned by value
+   return_out_param  void f(payload* out)           the C alternative
+
+   For a trivially copyable struct like record_t, moving IS copying, so
+   by_move should cost the same as by_value. It is included to show that.
+
+   passing_cost.sh builds this at several optimization levels, with and
+   without link time optimization, and collects the results.
+
+   Usage: passing_cost [--format=text|json|csv] [--config=LABEL]
+                       [--min-time=SECONDS]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "passing_cost.hpp"
+
+/* Results are added to this, so the compiler can't throw the calls away. */
+volatile long checksum;
+
+/* How long each measurement has to run for to be trusted. */
+double min_time = 0.02;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/* Returns nanoseconds per call of body(iterations), which must make
+   iterations calls.
+
+   The number of iterations is doubled until one run takes at least min_time,
+   so the clock's own cost doesn't matter. Then the best of 5 runs is kept:
+   other programs and interrupts only ever make a run SLOWER.
+*/
+template <typename Body>
+double ns_per_call(Body body) {
+    long iterations = 1000;
+    for (;;) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        checksum += body(iterations);
+        if (seconds_since(start) >= min_time)
+            break;
+        iterations *= 2;
+    }
+
+    double best = 0;
+    for (int run = 0; run < 5; ++run) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        checksum += body(iterations);
+        double elapsed = seconds_since(start);
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best * 1e9 / iterations;
+}
+
+enum output_format { TEXT, JSON, CSV };
+
+struct report {
+    output_format format;
+    std::string config;
+    int result_count;
+};
+
+void print_header(report& out) {
+    if (out.format == JSON)
+        std::printf("{\"config\": \"%s\", \"results\": [", out.config.c_str());
+    else if (out.format == CSV)
+        std::puts("config,size,mode,ns_per_call");
+    else
+        std::printf("%s\n%6s  %-17s %s\n", out.config.c_str(), "size", "mode",
+                    "ns/call");
+}
+
+void print_result(report& out, std::size_t size, char const * mode, double ns) {
+    if (out.format == JSON) {
+        std::printf("%s\n  {\"size\": %zu, \"mode\": \"%s\", \"ns_per_call\": %.3f}",
+                    out.result_count > 0 ? "," : "", size, mode, ns);
+    } else if (out.format == CSV) {
+        std::printf("\"%s\",%zu,%s,%.3f\n", out.config.c_str(), size, mode, ns);
+    } else {
+        std::printf("%6zu  %-17s %8.3f\n", size, mode, ns);
+    }
+    ++out.result_count;
+}
+
+void print_footer(report& out) {
+    if (out.format == JSON)
+        std::puts("\n]}");
+}
+
+/* The loops change one byte of the payload every call. Otherwise, once a
+   call is inlined (with LTO), the compiler could work out the answer once
+   and reuse it. */
+template <std::size_t Size>
+void measure(report& out) {
+    payload<Size> p;
+    std::memset(p.bytes, 1, Size);
+
+    print_result(out, Size, "by_value", ns_per_call([&](long iterations) {
+        long sum = 0;
+        for (long i = 0; i < iterations; ++i) {
+            p.bytes[0] = (unsigned char)i;
+            sum += take_by_value(p);
+        }
+        return sum;
+    }));
+
+    print_result(out, Size, "by_pointer", ns_per_call([&](long iterations) {
+        long sum = 0;
+        for (long i = 0; i < iterations; ++i) {
+            p.bytes[0] = (unsigned char)i;
+            sum += take_by_pointer(&p);
+        }
+        return sum;
+    }));
+
+    print_result(out, Size, "by_const_ref", ns_per_call([&](long iterations) {
+        long sum = 0;
+        for (long i = 0; i < iterations; ++i) {
+            p.bytes[0] = (unsigned char)i;
+            sum += take_by_const_ref(p);
+        }
+        return sum;
+    }));
+
+    print_result(out, Size, "by_move", ns_per_call([&](long iterations) {
+        long sum = 0;
+        for (long i = 0; i < iterations; ++i) {
+            p.bytes[0] = (unsigned char)i;
+            sum += take_by_value(std::move(p));
+        }
+        return sum;
+    }));
+
+    print_result(out, Size, "return_rvo", ns_per_call([&](long iterations) {
+        long sum = 0;
+        for (long i = 0; i < iterations; ++i) {
+            payload<Size> made = make_payload<Size>((int)i);
+            sum += made.bytes[Size - 1];
+        }
+        return sum;
+    }));
+
+    print_result(out, Size, "return_out_param", ns_per_call([&](long iterations) {
+        long sum = 0;
+        payload<Size> made;
+        for (long i = 0; i < iterations; ++i) {
+            make_into(&made, (int)i);
+            sum += made.bytes[Size - 1];
+        }
+        return sum;
+    }));
+}
+
+int main(int argc, char* argv[]) {
+    report out = {TEXT, "default", 0};
+
+    for (int i = 1; i < argc; ++i) {
+        char const * arg = argv[i];
+        if (std::strcmp(arg, "--format=json") == 0) {
+            out.format = JSON;
+        } else if (std::strcmp(arg, "--format=csv") == 0) {
+            out.format = CSV;
+        } else if (std::strcmp(arg, "--format=text") == 0) {
+            out.format = TEXT;
+        } else if (std::strncmp(arg, "--config=", 9) == 0) {
+            out.config = arg + 9;
+        } else if (std::strncmp(arg, "--min-time=", 11) == 0) {
+            min_time = std::atof(arg + 11);
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return 1;
+        }
+    }
+
+    print_header(out);
+#define MEASURE(Size) measure<Size>(out);
+    PASSING_COST_SIZES(MEASURE)
+#undef MEASURE
+    print_footer(out);
+
+    return 0;
+}
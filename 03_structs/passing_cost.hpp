@@ -0,0 +1,47 @@
+/* The functions measured by passing_cost.cpp.
+
+   They are defined in passing_cost_callees.cpp, a separate file, so that the
+   compiler can't inline them into the benchmark loops and skip the copies we
+   want to measure. Unless we compile with -flto: link time optimization sees
+   both files at once and CAN inline them, which is one of the things we want
+   to find out about.
+*/
+
+#ifndef PASSING_COST_HPP
+#define PASSING_COST_HPP
+
+#include <cstddef>
+
+/* A struct of exactly Size bytes. Like record_t it is TRIVIALLY COPYABLE:
+   copying it just copies its bytes. */
+template <std::size_t Size>
+struct payload {
+    unsigned char bytes[Size];
+};
+
+/* Each of these reads the first and last byte, so the whole struct has to
+   be there, and returns their sum. */
+template <std::size_t Size>
+int take_by_value(payload<Size> p);
+
+template <std::size_t Size>
+int take_by_pointer(payload<Size> const * p);
+
+template <std::size_t Size>
+int take_by_const_ref(payload<Size> const & p);
+
+/* Returning: RVO (return value optimization) means the callee builds its
+   result directly in the caller's variable. make_into is the C way of doing
+   the same thing by hand, with an out parameter. */
+template <std::size_t Size>
+payload<Size> make_payload(int seed);
+
+template <std::size_t Size>
+void make_into(payload<Size>* out, int seed);
+
+/* The sizes that are measured, 8 bytes to 4 KiB. passing_cost_callees.cpp
+   instantiates the functions above for each of them. */
+#define PASSING_COST_SIZES(X) \
+    X(8) X(16) X(32) X(64) X(128) X(256) X(512) X(1024) X(2048) X(4096)
+
+#endif /* PASSING_COST_HPP */
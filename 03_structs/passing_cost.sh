@@ -0,0 +1,32 @@
+#! /bin/bash
+
+# Builds passing_cost at -O0, -O2 and -O3, each with and without link time
+# optimization, runs every build, and collects the results in
+# passing_cost.json, a list with one object per build. Runs can be compared
+# over time to catch regressions. (passing_cost --format=csv gives a table
+# for a spreadsheet instead.)
+#
+# Any arguments are passed on to passing_cost, e.g. --min-time=0.005 for a
+# quicker, noisier run.
+
+set -e
+
+configs=("-O0" "-O2" "-O3" "-O0 -flto" "-O2 -flto" "-O3 -flto")
+
+echo "[" > passing_cost.json
+
+for i in "${!configs[@]}"; do
+    flags="${configs[$i]}"
+    echo "building and running with $flags" >&2
+
+    (set -x; g++ -std=c++11 $flags -Wall -Werror -o passing_cost \
+        passing_cost.cpp passing_cost_callees.cpp)
+
+    if [ "$i" -gt 0 ]; then
+        echo "," >> passing_cost.json
+    fi
+    ./passing_cost --format=json --config="$flags" "$@" >> passing_cost.json
+    rm passing_cost
+done
+
+echo "]" >> passing_cost.json
@@ -0,0 +1,41 @@
+#include "passing_cost.hpp"
+
+#include <cstring>
+
+template <std::size_t Size>
+int take_by_value(payload<Size> p) {
+    return p.bytes[0] + p.bytes[Size - 1];
+}
+
+template <std::size_t Size>
+int take_by_pointer(payload<Size> const * p) {
+    return p->bytes[0] + p->bytes[Size - 1];
+}
+
+template <std::size_t Size>
+int take_by_const_ref(payload<Size> const & p) {
+    return p.bytes[0] + p.bytes[Size - 1];
+}
+
+template <std::size_t Size>
+payload<Size> make_payload(int seed) {
+    payload<Size> p;
+    std::memset(p.bytes, seed, Size);
+    return p;
+}
+
+template <std::size_t Size>
+void make_into(payload<Size>* out, int seed) {
+    std::memset(out->bytes, seed, Size);
+}
+
+/* EXPLICIT INSTANTIATION: a template in a .cpp file is only compiled for the
+   types someone asks for, and nobody in this file does. These lines ask. */
+#define INSTANTIATE(Size) \
+    template int take_by_value<Size>(payload<Size>); \
+    template int take_by_pointer<Size>(payload<Size> const *); \
+    template int take_by_const_ref<Size>(payload<Size> const &); \
+    template payload<Size> make_payload<Size>(int); \
+    template void make_into<Size>(payload<Size>*, int);
+
+PASSING_COST_SIZES(INSTANTIATE)
@@ -0,0 +1,14 @@
+#include "record.h"
+
+#include <stddef.h>
+
+record_t make_record(char* name, int age) {
+    record_t rec;
+    rec.name = name;
+    rec.age = age;
+    return rec;
+}
+
+record_layout_t const record_t_layout = {
+    sizeof(record_t), offsetof(record_t, name), offsetof(record_t, age)
+};
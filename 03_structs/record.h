@@ -0,0 +1,22 @@
+/* The record used throughout this lesson. main.c explains it. It lives in
+   its own file so the benchmarks in bench/ can use it too. */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "record_table.h"
+
+struct record {
+    char* name;
+    int age;
+};
+
+typedef struct record record_t;
+
+/* Returns a record by value. */
+record_t make_record(char* name, int age);
+
+/* What record_t looks like, for converting to and from a table. */
+extern record_layout_t const record_t_layout;
+
+#endif /* RECORD_H */
@@ -0,0 +1,268 @@
+#include "record_table.h"
+
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COLUMN_ALIGNMENT 64
+
+void record_table_init(record_table_t* table) {
+    table->names = NULL;
+    table->ages = NULL;
+    table->size = 0;
+    table->capacity = 0;
+}
+
+void record_table_destroy(record_table_t* table) {
+    free(table->names);
+    free(table->ages);
+    record_table_init(table);
+}
+
+/* aligned_alloc wants the size to be a multiple of the alignment. */
+static void* alloc_column(size_t bytes) {
+    bytes = (bytes + COLUMN_ALIGNMENT - 1) & ~(size_t)(COLUMN_ALIGNMENT - 1);
+    return aligned_alloc(COLUMN_ALIGNMENT, bytes);
+}
+
+int record_table_reserve(record_table_t* table, size_t capacity) {
+    if (capacity <= table->capacity)
+        return 1;
+
+    /* Grow by at least double, so appending one row at a time only copies
+       each row a few times on average. */
+    size_t new_capacity = table->capacity * 2;
+    if (new_capacity < capacity)
+        new_capacity = capacity;
+    if (new_capacity < 64)
+        new_capacity = 64;
+    if (new_capacity > ((size_t)-1 - COLUMN_ALIGNMENT) / sizeof(char*))
+        return 0;
+
+    char** names = (char**)alloc_column(new_capacity * sizeof(char*));
+    int* ages = (int*)alloc_column(new_capacity * sizeof(int));
+    if (names == NULL || ages == NULL) {
+        free(names);
+        free(ages);
+        return 0;
+    }
+
+    if (table->size > 0) {
+        memcpy(names, table->names, table->size * sizeof(char*));
+        memcpy(ages, table->ages, table->size * sizeof(int));
+    }
+    free(table->names);
+    free(table->ages);
+    table->names = names;
+    table->ages = ages;
+    table->capacity = new_capacity;
+    return 1;
+}
+
+/* Makes room for count more rows. */
+static int reserve_more(record_table_t* table, size_t count) {
+    if (count > (size_t)-1 - table->size)
+        return 0;
+    return record_table_reserve(table, table->size + count);
+}
+
+int record_table_append(record_table_t* table, char* name, int age) {
+    if (table->size == table->capacity && !reserve_more(table, 1))
+        return 0;
+    table->names[table->size] = name;
+    table->ages[table->size] = age;
+    ++table->size;
+    return 1;
+}
+
+int record_table_append_columns(record_table_t* table, char* const * names,
+                                int const * ages, size_t count) {
+    if (!reserve_more(table, count))
+        return 0;
+    memcpy(table->names + table->size, names, count * sizeof(char*));
+    memcpy(table->ages + table->size, ages, count * sizeof(int));
+    table->size += count;
+    return 1;
+}
+
+/* Converting is a loop that copies each member to or from its column. The
+   members are copied with memcpy because records only promises to be a
+   byte array. */
+
+int record_table_append_structs(record_table_t* table, void const * records,
+                                size_t count, record_layout_t const * layout) {
+    if (!reserve_more(table, count))
+        return 0;
+
+    char const * rec = (char const *)records;
+    char** names = table->names + table->size;
+    int* ages = table->ages + table->size;
+    for (size_t i = 0; i < count; ++i, rec += layout->size) {
+        memcpy(&names[i], rec + layout->name_offset, sizeof(char*));
+        memcpy(&ages[i], rec + layout->age_offset, sizeof(int));
+    }
+    table->size += count;
+    return 1;
+}
+
+void record_table_to_structs(record_table_t const * table, size_t first,
+                             size_t count, void* records,
+                             record_layout_t const * layout) {
+    char* rec = (char*)records;
+    for (size_t i = first; i < first + count; ++i, rec += layout->size) {
+        memcpy(rec + layout->name_offset, &table->names[i], sizeof(char*));
+        memcpy(rec + layout->age_offset, &table->ages[i], sizeof(int));
+    }
+}
+
+/* ---- queries ----
+
+   Each query has a plain C version, and an AVX2 version that handles 8 ages
+   per loop iteration and leaves the last few rows to the plain version.
+
+   Checking min <= age <= max takes two comparisons. Subtracting min first
+   turns it into one: as unsigned numbers, age - min <= max - min exactly when
+   age is in the range, because ages below min wrap around to huge numbers.
+*/
+
+static int age_in_range(int age, int min_age, unsigned range) {
+    return (unsigned)age - (unsigned)min_age <= range;
+}
+
+static void age_stats_scalar(int const * ages, size_t begin, size_t end,
+                             age_stats_t* stats) {
+    for (size_t i = begin; i < end; ++i) {
+        stats->sum += ages[i];
+        if (ages[i] < stats->min)
+            stats->min = ages[i];
+        if (ages[i] > stats->max)
+            stats->max = ages[i];
+    }
+}
+
+static size_t select_scalar(int const * ages, size_t begin, size_t end,
+                            int min_age, unsigned range, size_t* rows) {
+    size_t found = 0;
+    for (size_t i = begin; i < end; ++i) {
+        /* always write, only move on if it matched: no branch to mispredict */
+        if (rows != NULL)
+            rows[found] = i;
+        found += age_in_range(ages[i], min_age, range);
+    }
+    return found;
+}
+
+__attribute__((target("avx2")))
+static void age_stats_avx2(int const * ages, size_t size, age_stats_t* stats) {
+    /* 8 ints can add up to more than an int holds, so the sums are kept as
+       4 + 4 long longs. */
+    __m256i sum_low = _mm256_setzero_si256();
+    __m256i sum_high = _mm256_setzero_si256();
+    __m256i min = _mm256_set1_epi32(stats->min);
+    __m256i max = _mm256_set1_epi32(stats->max);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i chunk = _mm256_load_si256((__m256i const *)(ages + i));
+        sum_low = _mm256_add_epi64(
+            sum_low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(chunk)));
+        sum_high = _mm256_add_epi64(
+            sum_high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(chunk, 1)));
+        min = _mm256_min_epi32(min, chunk);
+        max = _mm256_max_epi32(max, chunk);
+    }
+
+    long long sums[4];
+    int mins[8];
+    int maxes[8];
+    _mm256_storeu_si256((__m256i*)sums, _mm256_add_epi64(sum_low, sum_high));
+    _mm256_storeu_si256((__m256i*)mins, min);
+    _mm256_storeu_si256((__m256i*)maxes, max);
+    for (int lane = 0; lane < 4; ++lane)
+        stats->sum += sums[lane];
+    for (int lane = 0; lane < 8; ++lane) {
+        if (mins[lane] < stats->min)
+            stats->min = mins[lane];
+        if (maxes[lane] > stats->max)
+            stats->max = maxes[lane];
+    }
+
+    age_stats_scalar(ages, i, size, stats);
+}
+
+/* Counts when rows is NULL, selects otherwise. */
+__attribute__((target("avx2")))
+static size_t select_avx2(int const * ages, size_t size, int min_age,
+                          unsigned range, size_t* rows) {
+    __m256i min = _mm256_set1_epi32(min_age);
+    __m256i max = _mm256_set1_epi32((int)range);
+    size_t found = 0;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i chunk = _mm256_load_si256((__m256i const *)(ages + i));
+        __m256i offset = _mm256_sub_epi32(chunk, min);
+        /* AVX2 has no unsigned <=, but x <= y exactly when max(x, y) == y */
+        __m256i in_range = _mm256_cmpeq_epi32(_mm256_max_epu32(offset, max), max);
+        unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(in_range));
+
+        if (rows == NULL) {
+            found += __builtin_popcount(mask);
+        } else {
+            /* one row number per set bit, lowest first */
+            for (; mask != 0; mask &= mask - 1)
+                rows[found++] = i + __builtin_ctz(mask);
+        }
+    }
+
+    return found + select_scalar(ages, i, size, min_age, range,
+                                 rows == NULL ? NULL : rows + found);
+}
+
+static int have_avx2() {
+    static int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") != 0;
+    }
+    return supported;
+}
+
+age_stats_t record_table_age_stats(record_table_t const * table) {
+    age_stats_t stats = {table->size, 0, 0, 0};
+    if (table->size == 0)
+        return stats;
+
+    stats.min = stats.max = table->ages[0];
+    if (have_avx2())
+        age_stats_avx2(table->ages, table->size, &stats);
+    else
+        age_stats_scalar(table->ages, 0, table->size, &stats);
+    return stats;
+}
+
+size_t record_table_select_age_between(record_table_t const * table,
+                                       int min_age, int max_age, size_t* rows) {
+    if (min_age > max_age || table->size == 0)
+        return 0;
+
+    unsigned range = (unsigned)max_age - (unsigned)min_age;
+    if (have_avx2())
+        return select_avx2(table->ages, table->size, min_age, range, rows);
+    return select_scalar(table->ages, 0, table->size, min_age, range, rows);
+}
+
+size_t record_table_count_age_between(record_table_t const * table,
+                                      int min_age, int max_age) {
+    return record_table_select_age_between(table, min_age, max_age, NULL);
+}
+
+void record_table_project(record_table_t const * table, size_t const * rows,
+                          size_t row_count, char** names, int* ages) {
+    for (size_t i = 0; i < row_count; ++i) {
+        if (names != NULL)
+            names[i] = table->names[rows[i]];
+        if (ages != NULL)
+            ages[i] = table->ages[rows[i]];
+    }
+}
@@ -0,0 +1,94 @@
+/* A table of records stored column by column. */
+
+#ifndef RECORD_TABLE_H
+#define RECORD_TABLE_H
+
+#include <stddef.h>
+
+/* An array of record_t stores the records one after the other:
+
+       name age pad | name age pad | name age pad | ...
+
+   This is called an ARRAY OF STRUCTS (AoS). To average the ages, every
+   16 byte record has to be loaded into the cache just to read its 4 byte age.
+
+   record_table_t instead keeps one array per member, a STRUCT OF ARRAYS (SoA):
+
+       names: name | name | name | ...
+       ages:  age  | age  | age  | ...
+
+   Scanning the ages now only reads ages, and a vector register can load 8 of
+   them at once. Both columns start on a 64 byte (cache line) boundary.
+
+   Row i of the table is names[i] and ages[i]. The fields may be read
+   directly, but should only be changed through the functions below.
+*/
+typedef struct {
+    char** names;
+    int* ages;
+    size_t size;      /* rows in use */
+    size_t capacity;  /* rows allocated */
+} record_table_t;
+
+void record_table_init(record_table_t* table);
+void record_table_destroy(record_table_t* table);
+
+/* Makes room for at least capacity rows. The functions that add rows return 1
+   on success and 0 if out of memory, in which case the table is unchanged. */
+int record_table_reserve(record_table_t* table, size_t capacity);
+
+int record_table_append(record_table_t* table, char* name, int age);
+
+/* Batch insert, from columns that are already split up. */
+int record_table_append_columns(record_table_t* table, char* const * names,
+                                int const * ages, size_t count);
+
+/* Converting from and to an array of structs.
+
+   The table doesn't know what record_t looks like, so the caller describes
+   it: the size of the struct and where in it the members are, which is what
+   sizeof and offsetof give us. The member types must be char* and int.
+*/
+typedef struct {
+    size_t size;
+    size_t name_offset;
+    size_t age_offset;
+} record_layout_t;
+
+int record_table_append_structs(record_table_t* table, void const * records,
+                                size_t count, record_layout_t const * layout);
+
+/* Copies count rows starting at row first into the array records. */
+void record_table_to_structs(record_table_t const * table, size_t first,
+                             size_t count, void* records,
+                             record_layout_t const * layout);
+
+/* ---- queries ---- */
+
+/* AGGREGATE: statistics of the age column. min and max are 0 for an empty
+   table. */
+typedef struct {
+    size_t count;
+    long long sum;
+    int min;
+    int max;
+} age_stats_t;
+
+age_stats_t record_table_age_stats(record_table_t const * table);
+
+/* The number of rows with min_age <= age <= max_age. */
+size_t record_table_count_age_between(record_table_t const * table,
+                                      int min_age, int max_age);
+
+/* FILTER: writes the row numbers of the rows with min_age <= age <= max_age
+   to rows, in order, and returns how many there were. rows must have room
+   for table->size row numbers. */
+size_t record_table_select_age_between(record_table_t const * table,
+                                       int min_age, int max_age, size_t* rows);
+
+/* PROJECTION: copies the columns of the given rows, for example the ones a
+   filter picked, into names and ages. Either may be NULL to skip it. */
+void record_table_project(record_table_t const * table, size_t const * rows,
+                          size_t row_count, char** names, int* ages);
+
+#endif /* RECORD_TABLE_H */
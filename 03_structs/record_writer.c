@@ -0,0 +1,333 @@
+#include "record_writer.h"
+
+#include <emmintrin.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define DEFAULT_BUFFER_SIZE (256 * 1024)
+
+/* Names at least this long are not copied into the buffer. Instead the
+   buffer and the name are written together with writev, straight from where
+   the name already is. */
+#define LONG_NAME 4096
+
+/* The longest int, "-2147483648". */
+#define MAX_INT_CHARS 11
+
+/* A COMPILED FORMAT is the format string split into its pieces. Every valid
+   format has the same shape: text, field, text, field, text, where any of the
+   three texts may be empty. So writing a record is always the same five
+   steps, with no parsing left to do.
+
+   Short texts are copied 16 bytes at a time, even if they are shorter. To
+   make that safe, each text starts 16 byte aligned in writer->text with zeros
+   after it, and the buffer keeps a few spare bytes at its end.
+*/
+
+#define TEXT_CHUNK 16
+
+struct record_writer {
+    int fd;
+    int failed;
+
+    int name_first;        /* is the name the first field? */
+    char* text;
+    size_t text_offsets[3];
+    size_t text_lengths[3];
+    size_t text_length;    /* of all three texts together */
+
+    char* buffer;
+    size_t used;
+    size_t capacity;       /* not counting the spare bytes */
+};
+
+static size_t round_up_to_chunk(size_t size) {
+    return (size + TEXT_CHUNK - 1) / TEXT_CHUNK * TEXT_CHUNK;
+}
+
+/* Splits format into the three texts. Returns 0 if it isn't valid. */
+static int compile_format(record_writer_t* writer, char const * format) {
+    int field_count = 0;
+    size_t offset = 0;
+    size_t length = 0;
+
+    for (char const * ch = format;; ++ch) {
+        if (*ch == '%' && ch[1] == '%') {
+            writer->text[offset + length++] = '%';
+            ++ch;
+            continue;
+        }
+        if (*ch != '%' && *ch != '\0') {
+            writer->text[offset + length++] = *ch;
+            continue;
+        }
+
+        /* the end of a text */
+        writer->text_offsets[field_count] = offset;
+        writer->text_lengths[field_count] = length;
+        writer->text_length += length;
+        offset += round_up_to_chunk(length + 1);
+        length = 0;
+        if (*ch == '\0')
+            return field_count == 2;
+
+        /* a field */
+        if (field_count == 2 || (ch[1] != 's' && ch[1] != 'd'))
+            return 0;
+        if (field_count == 0)
+            writer->name_first = ch[1] == 's';
+        else if (writer->name_first == (ch[1] == 's'))
+            return 0;  /* the same field twice */
+        ++field_count;
+        ++ch;
+    }
+}
+
+record_writer_t* record_writer_create(int fd, char const * format,
+                                      size_t buffer_size) {
+    if (format == NULL)
+        format = "%s: %d\n";
+    if (buffer_size == 0)
+        buffer_size = DEFAULT_BUFFER_SIZE;
+
+    /* the buffer must at least fit one record with a short name */
+    size_t format_length = strlen(format);
+    if (buffer_size < format_length + MAX_INT_CHARS + LONG_NAME)
+        buffer_size = format_length + MAX_INT_CHARS + LONG_NAME;
+    size_t spare = 3 * TEXT_CHUNK;
+
+    record_writer_t* writer = (record_writer_t*)malloc(sizeof(record_writer_t));
+    if (writer == NULL)
+        return NULL;
+    writer->fd = fd;
+    writer->failed = 0;
+    writer->used = 0;
+    writer->capacity = buffer_size;
+    writer->text_length = 0;
+    /* room for each text rounded up, plus the zeros after it */
+    writer->text = (char*)calloc(round_up_to_chunk(format_length) + spare, 1);
+    writer->buffer = (char*)malloc(buffer_size + spare);
+
+    if (writer->text == NULL || writer->buffer == NULL ||
+        !compile_format(writer, format)) {
+        free(writer->text);
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int record_writer_free(record_writer_t* writer) {
+    int ok = record_writer_flush(writer);
+    free(writer->text);
+    free(writer->buffer);
+    free(writer);
+    return ok;
+}
+
+/* Writes all of the iovecs. writev may write only part of them, or be
+   interrupted by a signal before writing anything, so loop until done. */
+static int write_all(record_writer_t* writer, struct iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = writev(writer->fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            writer->failed = 1;
+            return 0;
+        }
+
+        /* skip the parts that were written completely */
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= parts->iov_len;
+            ++parts;
+            --count;
+        }
+        if (count > 0) {
+            parts->iov_base = (char*)parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+    return 1;
+}
+
+int record_writer_flush(record_writer_t* writer) {
+    if (writer->failed)
+        return 0;
+    struct iovec part = {writer->buffer, writer->used};
+    writer->used = 0;
+    return write_all(writer, &part, 1);
+}
+
+/* Converting an int to decimal one digit at a time needs a division per
+   digit. Looking up TWO digits at a time in this table halves that.
+   digit_pairs[2 * n] and digit_pairs[2 * n + 1] are the two digits of n. */
+static char const digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "7475767778798081828384858687888990919293949596979899";
+
+/* Writes age in decimal to out, and returns how many chars that took. */
+static size_t format_int(int age, char* out) {
+    /* unsigned, so that -INT_MIN doesn't overflow */
+    unsigned value = age < 0 ? 0u - (unsigned)age : (unsigned)age;
+    char digits[MAX_INT_CHARS];
+    char* pos = digits + sizeof(digits);
+
+    /* digits are produced last first, so fill digits from the end */
+    while (value >= 100) {
+        unsigned pair = value % 100;
+        value /= 100;
+        pos -= 2;
+        memcpy(pos, &digit_pairs[2 * pair], 2);
+    }
+    if (value >= 10) {
+        pos -= 2;
+        memcpy(pos, &digit_pairs[2 * value], 2);
+    } else {
+        *--pos = (char)('0' + value);
+    }
+    if (age < 0)
+        *--pos = '-';
+
+    size_t length = digits + sizeof(digits) - pos;
+    memcpy(out, pos, length);
+    return length;
+}
+
+/* Most ages are below 100, so they get their own fast path. */
+static inline size_t format_age(int age, char* out) {
+    if ((unsigned)age < 10) {
+        out[0] = (char)('0' + age);
+        return 1;
+    }
+    if ((unsigned)age < 100) {
+        memcpy(out, &digit_pairs[2 * age], 2);
+        return 2;
+    }
+    return format_int(age, out);
+}
+
+/* Writes the buffer and then name, without copying name. */
+static int write_long_name(record_writer_t* writer, char const * name,
+                           size_t length) {
+    struct iovec parts[2] = {
+        {writer->buffer, writer->used},
+        {(void*)name, length}
+    };
+    writer->used = 0;
+    return write_all(writer, parts, 2);
+}
+
+static char* write_text(record_writer_t const * writer, int which, char* out) {
+    char const * text = writer->text + writer->text_offsets[which];
+    size_t length = writer->text_lengths[which];
+    for (size_t i = 0; i < length; i += TEXT_CHUNK)
+        memcpy(out + i, text + i, TEXT_CHUNK);
+    return out + length;
+}
+
+/* Most names are short. For those, finding the length with strlen and then
+   copying with memcpy reads the name twice, in two library calls.
+
+   Instead, load 16 bytes at once, look for the terminating '\0' among them
+   the way fast_string_length does in lesson 04, and if it is there, store
+   all 16 bytes. The bytes after the name land in the buffer's spare space
+   and are overwritten by whatever is written next.
+
+   Reading past the end of name is safe as long as the 16 bytes don't cross
+   into the next page: the page name starts in is readable, so every byte of
+   it is. Returns the length of name, or TEXT_CHUNK if it didn't find the end,
+   in which case nothing was stored.
+*/
+#define PAGE_SIZE 4096
+
+/* AddressSanitizer doesn't know about pages, and would report the read. */
+__attribute__((no_sanitize_address))
+static size_t copy_short_name(char const * name, char* out) {
+    if (((uintptr_t)name & (PAGE_SIZE - 1)) > PAGE_SIZE - TEXT_CHUNK)
+        return TEXT_CHUNK;
+
+    __m128i chars = _mm_loadu_si128((__m128i const *)name);
+    unsigned zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(chars,
+                                                      _mm_setzero_si128()));
+    if (zeros == 0)
+        return TEXT_CHUNK;
+    _mm_storeu_si128((__m128i*)out, chars);
+    return __builtin_ctz(zeros);
+}
+
+/* Copies name to out and returns the end of it. A long name is not copied,
+   but written directly along with everything before it. May have to flush
+   to make room. Returns NULL if writing failed. */
+static char* write_name(record_writer_t* writer, char const * name, char* out) {
+    size_t length = copy_short_name(name, out);
+    if (length < TEXT_CHUNK)
+        return out + length;
+
+    length = strlen(name);
+    if (length >= LONG_NAME) {
+        writer->used = out - writer->buffer;
+        if (!write_long_name(writer, name, length))
+            return NULL;
+        return writer->buffer;
+    }
+
+    /* Room was only made for TEXT_CHUNK chars of name, so there may not be
+       enough for this one and the rest of the record. */
+    if (out + length + writer->text_length + MAX_INT_CHARS >
+        writer->buffer + writer->capacity) {
+        writer->used = out - writer->buffer;
+        if (!record_writer_flush(writer))
+            return NULL;
+        out = writer->buffer;
+    }
+    memcpy(out, name, length);
+    return out + length;
+}
+
+int record_writer_write(record_writer_t* writer, char const * name, int age) {
+    if (writer->failed)
+        return 0;
+
+    /* Make sure a short name fits first. Whether it IS short is found out
+       when copying it. */
+    if (writer->used + writer->text_length + MAX_INT_CHARS + TEXT_CHUNK >
+        writer->capacity) {
+        if (!record_writer_flush(writer))
+            return 0;
+    }
+
+    char* out = write_text(writer, 0, writer->buffer + writer->used);
+    if (writer->name_first) {
+        out = write_name(writer, name, out);
+        if (out == NULL)
+            return 0;
+        out = write_text(writer, 1, out);
+        out += format_age(age, out);
+    } else {
+        out += format_age(age, out);
+        out = write_text(writer, 1, out);
+        out = write_name(writer, name, out);
+        if (out == NULL)
+            return 0;
+    }
+    out = write_text(writer, 2, out);
+
+    writer->used = out - writer->buffer;
+    return 1;
+}
+
+int record_writer_write_table(record_writer_t* writer,
+                              record_table_t const * table) {
+    for (size_t i = 0; i < table->size; ++i) {
+        if (!record_writer_write(writer, table->names[i], table->ages[i]))
+            return 0;
+    }
+    return 1;
+}
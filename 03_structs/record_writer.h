@@ -0,0 +1,47 @@
+/* A fast replacement for calling printf once per record. */
+
+#ifndef RECORD_WRITER_H
+#define RECORD_WRITER_H
+
+#include <stddef.h>
+
+#include "record_table.h"
+
+/* print_record calls printf for every record, and each call has to:
+   1. lock stdout, in case another thread is printing too,
+   2. read the format string char by char to work out what to do,
+   3. convert the age to decimal with a general purpose routine.
+
+   A record_writer_t does 2 only once, when it is created, and avoids 1 and 3
+   entirely. Records are formatted into a large buffer, which is handed to the
+   operating system with write() only when full.
+
+   A writer must only be used by one thread at a time.
+*/
+typedef struct record_writer record_writer_t;
+
+/* Creates a writer that writes to the file descriptor fd, which it does not
+   close.
+
+   format is like a printf format with exactly one %s, the name, and one %d,
+   the age, in either order. %% writes a single %. NULL means "%s: %d\n", the
+   format print_record uses.
+
+   buffer_size is the size of the buffer in bytes, 0 picks a default.
+
+   Returns NULL if out of memory or if format is not valid.
+*/
+record_writer_t* record_writer_create(int fd, char const * format,
+                                      size_t buffer_size);
+
+/* Flushes, then frees the writer. Returns what record_writer_flush returned. */
+int record_writer_free(record_writer_t* writer);
+
+/* These return 1 on success and 0 if writing failed. Once writing has failed
+   the writer stays failed, and later calls do nothing and return 0. */
+int record_writer_write(record_writer_t* writer, char const * name, int age);
+int record_writer_write_table(record_writer_t* writer,
+                              record_table_t const * table);
+int record_writer_flush(record_writer_t* writer);
+
+#endif /* RECORD_WRITER_H */
@@ -2,4 +2,4 @@
 
 set -x
 
-gcc -Werror -o const const.c
+gcc -Werror -o const const.c fast_string_length.c ../instrument/instrument.c
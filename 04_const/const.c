@@ -1,4 +1,10 @@
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fast_string_length.h"
+
+#include "../instrument/instrument.h"
 
 /* Variables in C can be marked constant.
    Constant variables cannot be modified. */
@@ -44,13 +50,10 @@ void nonconst_to_const() {
 }
 
 /* Functions that are passed a pointer to something they read but do not
-   write to, should take pointers to const. */
-
-int string_length(char const * string) {
-    int count = 0;
-    for (; *string; ++string, ++count);
-    return count;
-}
+   write to, should take pointers to const. string_length, at the top of
+   fast_string_length.c, is one: it walks the string looking for the '\0',
+   and never writes through the pointer.
+*/
 
 void using_string_length() {
     char string[] = "testing.";
@@ -62,6 +65,47 @@ void using_string_length() {
     string_length(string);
 }
 
+/* string_length looks at one char per loop iteration. For long strings it is
+   much faster to look at 8, 16 or 32 chars at once. fast_string_length.c has
+   versions that do this, and they still take a pointer to const.
+
+   string_length is simple enough that we can be sure it is correct, so we
+   use it to check the fast versions on strings of many lengths, starting at
+   every possible alignment. If any of them gets a length wrong, the program
+   exits with an error.
+*/
+
+int failed_checks = 0;
+
+int check_string_length(char const * name, string_length_func fast) {
+    static char buffer[4096 + 64];
+    int mismatches = 0;
+
+    for (size_t start = 0; start < 64; ++start) {
+        for (size_t length = 0; length < 600; ++length) {
+            char* string = buffer + start;
+            memset(string, 'x', length);
+            string[length] = '\0';
+            if (fast(string) != (size_t)string_length(string))
+                ++mismatches;
+        }
+    }
+
+    printf("%s: %d mismatches\n", name, mismatches);
+    if (mismatches != 0)
+        ++failed_checks;
+    return mismatches;
+}
+
+void using_fast_string_length() {
+    puts(__func__);
+    check_string_length("string_length_swar", string_length_swar);
+    check_string_length("string_length_sse2", string_length_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        check_string_length("string_length_avx2", string_length_avx2);
+    check_string_length("string_length_fast", string_length_fast);
+}
+
 /* These types are the same:
    char const * string;
    const char * string;
@@ -139,7 +183,10 @@ void pointers_to_pointers_to_etc() {
 */
 
 int main(int argc, char* argv[]) {
-    constant_values();
-    pointer_to_const();
-    nonconst_to_const();
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(constant_values());
+    INSTRUMENTED(pointer_to_const());
+    INSTRUMENTED(nonconst_to_const());
+    INSTRUMENTED(using_fast_string_length());
+    return failed_checks == 0 ? 0 : 1;
 }
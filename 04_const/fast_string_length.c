@@ -0,0 +1,177 @@
+#include "fast_string_length.h"
+
+#include <stdint.h>
+#include <immintrin.h>
+
+int string_length(char const * string) {
+    int count = 0;
+    for (; *string; ++string, ++count);
+    return count;
+}
+
+/* Why can we read past the end of the string without crashing?
+
+   The operating system hands out memory in PAGES, usually 4096 bytes each.
+   If any byte of a page is readable, every byte of that page is readable.
+
+   All the functions here only ever do ALIGNED reads. An aligned read of 8, 16
+   or 32 bytes starts at an address that is a multiple of its size, so it can
+   never straddle two pages. If the read contains at least one byte of our
+   string, the whole read is inside a page we are allowed to touch.
+
+   Bytes read from before the start of the string, or after the '\0', are
+   simply ignored.
+*/
+
+/* SWAR: SIMD Within A Register.
+
+   (word - 0x0101...01) & ~word & 0x8080...80 is non zero exactly when one of
+   the bytes of word is zero. The lowest set 0x80 bit marks the first zero byte.
+   This relies on x86 being little endian.
+*/
+
+/* may_alias tells gcc that a word_t may point at memory that really holds
+   chars. Without it, reading chars through a uint64_t pointer is undefined. */
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+static uint64_t zero_bytes(uint64_t word) {
+    return (word - ONES) & ~word & HIGHS;
+}
+
+size_t string_length_swar(char const * string) {
+    uintptr_t offset = (uintptr_t)string % sizeof(uint64_t);
+    word_t const * word = (word_t const *)(string - offset);
+
+    /* Pretend the bytes before the string are not zero by setting them to
+       0xff. */
+    uint64_t found = zero_bytes(*word | ((1ULL << (8 * offset)) - 1));
+
+    while (!found)
+        found = zero_bytes(*++word);
+
+    char const * end = (char const *)word + __builtin_ctzll(found) / 8;
+    return end - string;
+}
+
+/* Checking one vector per loop iteration is not enough to beat strlen:
+   the loop overhead, and the compare and branch on every vector, cost more
+   than the load. Once the reads are aligned to 4 vectors, the loops below
+   check 4 vectors at once. _mm_min_epu8 keeps the smallest of each byte,
+   and that is zero exactly when one of the 4 vectors has a zero there, so
+   there is a single compare and branch per 64 bytes. 4 vectors aligned to
+   their total size are still never split between two pages.
+
+   Only when the '\0' is found do we work out which vector it was in, by
+   putting the 4 movemasks together into one 64 bit mask.
+*/
+
+#define SSE2_GROUP 64
+
+size_t string_length_sse2(char const * string) {
+    uintptr_t offset = (uintptr_t)string % 16;
+    __m128i const * block = (__m128i const *)(string - offset);
+    __m128i const zero = _mm_setzero_si128();
+
+    /* Each bit of the movemask says whether one byte equaled '\0'. Shift out
+       the bits for bytes before the string. */
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block),
+                                                     zero)) >> offset;
+    if (mask)
+        return __builtin_ctz(mask);
+
+    /* one vector at a time, until block is aligned to a whole group */
+    for (++block; (uintptr_t)block % SSE2_GROUP != 0; ++block) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero));
+        if (mask)
+            return (char const *)block + __builtin_ctz(mask) - string;
+    }
+
+    for (;; block += 4) {
+        __m128i a = _mm_load_si128(block);
+        __m128i b = _mm_load_si128(block + 1);
+        __m128i c = _mm_load_si128(block + 2);
+        __m128i d = _mm_load_si128(block + 3);
+        __m128i min = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(min, zero)))
+            break;
+    }
+
+    uint64_t found =
+        (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block),
+                                                   zero)) |
+        (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block + 1),
+                                                   zero)) << 16 |
+        (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block + 2),
+                                                   zero)) << 32 |
+        (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block + 3),
+                                                   zero)) << 48;
+    return (char const *)block + __builtin_ctzll(found) - string;
+}
+
+#define AVX2_GROUP 128
+
+__attribute__((target("avx2")))
+static uint64_t zero_mask_avx2(__m256i const * block) {
+    __m256i const zero = _mm256_setzero_si256();
+    return (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_load_si256(block), zero));
+}
+
+__attribute__((target("avx2")))
+size_t string_length_avx2(char const * string) {
+    uintptr_t offset = (uintptr_t)string % 32;
+    __m256i const * block = (__m256i const *)(string - offset);
+    __m256i const zero = _mm256_setzero_si256();
+
+    unsigned mask = (unsigned)zero_mask_avx2(block) >> offset;
+    if (mask)
+        return __builtin_ctz(mask);
+
+    for (++block; (uintptr_t)block % AVX2_GROUP != 0; ++block) {
+        mask = zero_mask_avx2(block);
+        if (mask)
+            return (char const *)block + __builtin_ctz(mask) - string;
+    }
+
+    for (;; block += 4) {
+        __m256i a = _mm256_load_si256(block);
+        __m256i b = _mm256_load_si256(block + 1);
+        __m256i c = _mm256_load_si256(block + 2);
+        __m256i d = _mm256_load_si256(block + 3);
+        __m256i min = _mm256_min_epu8(_mm256_min_epu8(a, b),
+                                      _mm256_min_epu8(c, d));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(min, zero)))
+            break;
+    }
+
+    /* 128 bytes don't fit in one 64 bit mask, so look at two halves */
+    uint64_t found = zero_mask_avx2(block) | zero_mask_avx2(block + 1) << 32;
+    if (found)
+        return (char const *)block + __builtin_ctzll(found) - string;
+    found = zero_mask_avx2(block + 2) | zero_mask_avx2(block + 3) << 32;
+    return (char const *)(block + 2) + __builtin_ctzll(found) - string;
+}
+
+/* The first call to string_length_fast asks the processor what it supports
+   (the CPUID instruction, wrapped by __builtin_cpu_supports) and remembers
+   the answer in a function pointer.
+*/
+
+static string_length_func pick_string_length() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return string_length_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return string_length_sse2;
+    return string_length_swar;
+}
+
+size_t string_length_fast(char const * string) {
+    static string_length_func impl = NULL;
+    if (impl == NULL)
+        impl = pick_string_length();
+    return impl(string);
+}
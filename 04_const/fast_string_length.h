@@ -0,0 +1,31 @@
+/* string_length, which const.c uses, and faster versions of it. */
+
+#ifndef FAST_STRING_LENGTH_H
+#define FAST_STRING_LENGTH_H
+
+#include <stddef.h>
+
+/* The simple version: one char per loop iteration. */
+int string_length(char const * string);
+
+/* Each of these returns the same answer as string_length, they just look at
+   more than one char at a time.
+
+   string_length_swar  reads one aligned machine word (8 bytes) at a time.
+   string_length_sse2  reads aligned 16 byte vectors, 4 at a time.
+   string_length_avx2  reads aligned 32 byte vectors, 4 at a time.
+                       Only call this if the processor supports AVX2.
+*/
+size_t string_length_swar(char const * string);
+size_t string_length_sse2(char const * string);
+size_t string_length_avx2(char const * string);
+
+/* string_length_fast picks the best of the above for the processor we are
+   running on. The choice is made once, the first time it is called.
+*/
+size_t string_length_fast(char const * string);
+
+/* All of the functions above have this type. */
+typedef size_t (*string_length_func)(char const *);
+
+#endif /* FAST_STRING_LENGTH_H */
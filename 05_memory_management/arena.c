@@ -0,0 +1,152 @@
+#include "arena.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* malloc and free have to work for any pattern of allocations and frees. So
+   each call does bookkeeping, and often takes a lock.
+
+   Many programs allocate lots of small objects that all die together, for
+   example everything created while handling one request. An arena takes
+   advantage of that:
+
+   - Allocating is "bumping" a pointer: round next up to the alignment, and
+     add size. If the chunk is full, malloc a new one.
+   - There is no per object free. Everything is freed at once by
+     arena_destroy, arena_reset or arena_rollback.
+
+   Chunks are kept in a linked list, newest first.
+*/
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    arena_chunk_t* older;
+    char* limit;
+    alignas(max_align_t) char data[];
+};
+
+void arena_init(arena_t* arena, size_t chunk_size) {
+    arena->chunk = NULL;
+    arena->next = NULL;
+    arena->limit = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+}
+
+static void free_chunks_newer_than(arena_t* arena, arena_chunk_t* keep) {
+    while (arena->chunk != keep) {
+        arena_chunk_t* older = arena->chunk->older;
+        free(arena->chunk);
+        arena->chunk = older;
+    }
+}
+
+void arena_destroy(arena_t* arena) {
+    free_chunks_newer_than(arena, NULL);
+    arena->next = NULL;
+    arena->limit = NULL;
+}
+
+static char* align_up(char* ptr, size_t align) {
+    return (char*)(((uintptr_t)ptr + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+/* The slow path: the current chunk is full. */
+static void* alloc_from_new_chunk(arena_t* arena, size_t size, size_t align) {
+    /* A size this close to SIZE_MAX would wrap around below, and malloc a
+       tiny chunk that the caller then writes size bytes into. */
+    if (size > SIZE_MAX - align - sizeof(arena_chunk_t) ||
+        arena->chunk_size > SIZE_MAX - sizeof(arena_chunk_t))
+        return NULL;
+
+    /* big allocations get a chunk of their own */
+    size_t data_size = arena->chunk_size;
+    if (size + align > data_size)
+        data_size = size + align;
+
+    arena_chunk_t* chunk = (arena_chunk_t*)malloc(sizeof(arena_chunk_t) +
+                                                  data_size);
+    if (chunk == NULL)
+        return NULL;
+    chunk->older = arena->chunk;
+    chunk->limit = chunk->data + data_size;
+
+    arena->chunk = chunk;
+    arena->limit = chunk->limit;
+    char* result = align_up(chunk->data, align);
+    arena->next = result + size;
+    return result;
+}
+
+void* arena_alloc_aligned(arena_t* arena, size_t size, size_t align) {
+    if (arena->chunk != NULL) {
+        char* result = align_up(arena->next, align);
+        if (result <= arena->limit && size <= (size_t)(arena->limit - result)) {
+            arena->next = result + size;
+            return result;
+        }
+    }
+    return alloc_from_new_chunk(arena, size, align);
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    return arena_alloc_aligned(arena, size, alignof(max_align_t));
+}
+
+void arena_reset(arena_t* arena) {
+    if (arena->chunk == NULL)
+        return;
+
+    arena_chunk_t* oldest = arena->chunk;
+    while (oldest->older != NULL)
+        oldest = oldest->older;
+
+    free_chunks_newer_than(arena, oldest);
+    arena->next = oldest->data;
+    arena->limit = oldest->limit;
+}
+
+arena_mark_t arena_mark(arena_t const * arena) {
+    arena_mark_t mark = {arena->chunk, arena->next};
+    return mark;
+}
+
+void arena_rollback(arena_t* arena, arena_mark_t mark) {
+    free_chunks_newer_than(arena, mark.chunk);
+    arena->next = mark.next;
+    arena->limit = mark.chunk ? mark.chunk->limit : NULL;
+}
+
+/* Thread local arenas.
+
+   pthread keys give each thread its own value for the same key, and call a
+   destructor with that value when the thread exits.
+*/
+
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_arena_once = PTHREAD_ONCE_INIT;
+
+static void destroy_thread_arena(void* arena) {
+    arena_destroy((arena_t*)arena);
+    free(arena);
+}
+
+static void create_thread_arena_key(void) {
+    pthread_key_create(&thread_arena_key, destroy_thread_arena);
+}
+
+arena_t* thread_arena(void) {
+    pthread_once(&thread_arena_once, create_thread_arena_key);
+
+    arena_t* arena = (arena_t*)pthread_getspecific(thread_arena_key);
+    if (arena == NULL) {
+        arena = (arena_t*)malloc(sizeof(arena_t));
+        if (arena == NULL)
+            return NULL;
+        arena_init(arena, 0);
+        pthread_setspecific(thread_arena_key, arena);
+    }
+    return arena;
+}
@@ -0,0 +1,55 @@
+/* An ARENA (also called a region, or bump allocator) hands out memory from
+   big chunks, and frees it all at once. */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena_chunk arena_chunk_t;
+
+/* Treat the members as private, and only use the functions below. */
+typedef struct {
+    arena_chunk_t* chunk; /* the newest chunk */
+    char* next;           /* the next free byte in chunk */
+    char* limit;          /* the end of chunk */
+    size_t chunk_size;
+} arena_t;
+
+/* A position in an arena, see arena_mark. */
+typedef struct {
+    arena_chunk_t* chunk;
+    char* next;
+} arena_mark_t;
+
+/* Sets up an empty arena that gets memory from malloc chunk_size bytes at a
+   time. Pass 0 for a default chunk size. No memory is allocated yet. */
+void arena_init(arena_t* arena, size_t chunk_size);
+
+/* Frees all the memory of the arena. Every pointer it returned is then
+   invalid. */
+void arena_destroy(arena_t* arena);
+
+/* Returns size bytes aligned for any type, like malloc, or NULL if out of
+   memory. There is no way to free just this allocation. */
+void* arena_alloc(arena_t* arena, size_t size);
+
+/* Same, but aligned to align bytes, which must be a power of two. */
+void* arena_alloc_aligned(arena_t* arena, size_t size, size_t align);
+
+/* Frees everything allocated from the arena, but keeps its first chunk to
+   reuse. */
+void arena_reset(arena_t* arena);
+
+/* arena_mark remembers the current position. arena_rollback frees everything
+   allocated after the mark was taken. Marks must be rolled back in the
+   reverse order they were taken, like a stack. */
+arena_mark_t arena_mark(arena_t const * arena);
+void arena_rollback(arena_t* arena, arena_mark_t mark);
+
+/* Each thread has its own arena, created the first time the thread calls
+   this, and destroyed when the thread exits. Since only one thread ever uses
+   it, no locking is needed. */
+arena_t* thread_arena(void);
+
+#endif /* ARENA_H */
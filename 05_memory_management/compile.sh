@@ -2,4 +2,4 @@
 
 set -x
 
-gcc -o memory memory.c
+gcc -pthread -o memory memory.c arena.c object_pool.c record.c ../instrument/instrument.c
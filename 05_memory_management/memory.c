@@ -1,8 +1,18 @@
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "arena.h"
+#include "object_pool.h"
+#include "record.h"
+
+#include "../instrument/instrument.h"
+
 /*
   Important C++ note:
   Virtually everything I teach you how to do in this lesson is WRONG
@@ -87,6 +97,11 @@ int variable_size_array(int size) {
     int array[size];
 }
 
+/* A big enough size overflows the stack, and the program crashes. And
+   neither kind of array can grow once it exists. Lesson 09 has small_vector,
+   which is as cheap as a stack array while it is small, and moves to the
+   heap when it grows. */
+
 /* Aside from the stack memory can be also allocated on the HEAP. This is called
    dynamically allocated memory.
 
@@ -185,24 +200,10 @@ void malloc_string() {
    responsible for freeing that memory. However, this is not always the case.
 */
 
-typedef struct {
-    int age;
-    int height; /*in inches*/
-} record_t;
-
-/* make_record returns a pointer to a record.
-   The caller owns the record, and is responsible for freeing it
+/* record.h has a record_t, with an age and a height. make_record, at the
+   top of record.c, mallocs a new record, fills it in and returns the
+   pointer. The caller owns the record, and is responsible for freeing it.
 */
-record_t* make_record(int age, int height) {
-    record_t* rec = (record_t*) malloc(sizeof(record_t));
-    if (rec == NULL) {
-        puts("Out of memory!");
-        exit(1);
-    }
-    rec->age = age;
-    rec->height = height;
-    return rec;
-}
 
 void gain_ownership_of_record() {
     record_t* bob = make_record(48, 72);
@@ -248,6 +249,190 @@ void fake_exception_example() {
    steam come out of my ears.
 */
 
+/* Sometimes we make huge numbers of small records that all stop being needed
+   at the same time, for example all the records made while handling one
+   request. Calling malloc and free for each of them is slow, and it's easy to
+   forget a free.
+
+   An ARENA (see arena.h) solves both problems. Records are carved out of big
+   chunks, and the whole arena is freed at once. The arena owns the records,
+   so the caller must NOT free them. make_record_in in record.c is
+   make_record with arena_alloc_aligned in place of malloc.
+*/
+
+/* The examples below check their results too. If a check fails, the
+   program exits with an error. */
+int failed_checks = 0;
+
+void arena_example() {
+    puts(__func__);
+    arena_t arena;
+    arena_init(&arena, 0);
+
+    for (int request = 0; request < 3; ++request) {
+        /* handle a request that needs lots of records */
+        long total_height = 0;
+        for (int i = 0; i < 100000; ++i) {
+            record_t* rec = make_record_in(&arena, 20 + i % 50, 60 + i % 20);
+            total_height += rec->height;
+        }
+        printf("request %d: total height %ld\n", request, total_height);
+
+        /* free all 100000 records at once */
+        arena_reset(&arena);
+    }
+
+    /* A mark lets us throw away just the records made after it. */
+    record_t* kept = make_record_in(&arena, 48, 72);
+    arena_mark_t mark = arena_mark(&arena);
+    for (int i = 0; i < 1000; ++i)
+        make_record_in(&arena, 1, 1);
+    arena_rollback(&arena, mark);
+    printf("kept record: %d %d\n", kept->age, kept->height);
+
+    /* A size that can't possibly fit in memory gets NULL, like from malloc,
+       not a chunk that wrapped around to a few bytes. */
+    if (arena_alloc(&arena, SIZE_MAX - 8) != NULL) {
+        puts("arena_alloc of SIZE_MAX - 8 bytes did not fail!");
+        ++failed_checks;
+    }
+
+    arena_destroy(&arena);
+
+    /* Every thread can also have an arena of its own. */
+    record_t* bob = make_record_in(thread_arena(), 48, 72);
+    printf("bob: %d %d\n", bob->age, bob->height);
+    arena_reset(thread_arena());
+}
+
+/* Records are small, and every record_t is the same size. An OBJECT POOL
+   (see object_pool.h) keeps a list of free records ready, so making one is
+   usually just taking the first record off that list. Unlike an arena,
+   each record can be given back on its own with object_pool_free.
+   make_record_from_pool in record.c uses object_pool_alloc.
+*/
+
+/* Pools can be shared by many threads. Each of these threads keeps up to 100
+   records alive at a time, and frees and replaces them in a random order.
+
+   Each record is stamped with its slot and with a value only its thread
+   uses. If the pool ever handed one record to two threads, or two slots,
+   the stamp would be overwritten, and the record counted as corrupted. */
+
+#define POOL_THREADS 8
+#define POOL_ROUNDS 100000
+#define LIVE_RECORDS 100
+
+atomic_int corrupted_records;
+
+void* pool_worker(void* pool_ptr) {
+    object_pool_t* pool = (object_pool_t*) pool_ptr;
+    record_t* live[LIVE_RECORDS] = {NULL};
+    unsigned random = (unsigned)(size_t)&live;
+    /* every thread's live array is somewhere else on the stack */
+    int stamp = (int)((size_t)&live >> 4);
+
+    /* a cache takes most of the traffic off the shared pool */
+    pool_cache_t cache;
+    pool_cache_init(&cache, pool);
+
+    for (int round = 0; round < POOL_ROUNDS; ++round) {
+        random = random * 1103515245 + 12345;
+        int slot = (random >> 16) % LIVE_RECORDS;
+        if (live[slot] != NULL) {
+            if (live[slot]->age != slot || live[slot]->height != stamp)
+                atomic_fetch_add(&corrupted_records, 1);
+            if (round % 2)
+                object_pool_free(pool, live[slot]);
+            else
+                pool_cache_free(&cache, live[slot]);
+        }
+
+        live[slot] = (record_t*) (round % 3 ? pool_cache_alloc(&cache)
+                                            : object_pool_alloc(pool));
+        if (live[slot] == NULL) {
+            puts("Out of memory!");
+            exit(1);
+        }
+        live[slot]->age = slot;
+        live[slot]->height = stamp;
+    }
+
+    for (int slot = 0; slot < LIVE_RECORDS; ++slot) {
+        if (live[slot] != NULL)
+            object_pool_free(pool, live[slot]);
+    }
+    pool_cache_flush(&cache);
+    return NULL;
+}
+
+void print_pool_stats(object_pool_t* pool) {
+    object_pool_stats_t stats;
+    object_pool_get_stats(pool, &stats);
+    printf("in use %zu, high water %zu, capacity %zu in %zu slabs, "
+           "%.1f%% unused\n", stats.in_use, stats.high_water, stats.capacity,
+           stats.slab_count, stats.fragmentation * 100);
+}
+
+void object_pool_example() {
+    puts(__func__);
+    object_pool_t* pool = object_pool_create(sizeof(record_t), 0);
+    if (pool == NULL) {
+        puts("Out of memory!");
+        exit(1);
+    }
+
+    record_t* bob = make_record_from_pool(pool, 48, 72);
+    print_pool_stats(pool);
+    object_pool_free(pool, bob);
+
+    pthread_t threads[POOL_THREADS];
+    int started = 0;
+    while (started < POOL_THREADS &&
+           pthread_create(&threads[started], NULL, pool_worker, pool) == 0)
+        ++started;
+    if (started < POOL_THREADS) {
+        printf("could only start %d of %d threads\n", started, POOL_THREADS);
+        ++failed_checks;
+    }
+    /* only the threads that started can be joined */
+    for (int i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    print_pool_stats(pool);
+
+    int corrupted = atomic_load(&corrupted_records);
+    if (corrupted != 0) {
+        printf("%d records were corrupted!\n", corrupted);
+        ++failed_checks;
+    }
+    object_pool_destroy(pool);
+
+    /* A slab too big for a size_t is refused, instead of wrapping around
+       to a small slab. */
+    object_pool_t* huge = object_pool_create(sizeof(record_t), SIZE_MAX / 2);
+    if (huge != NULL) {
+        puts("object_pool_create with SIZE_MAX / 2 objects per slab worked!");
+        object_pool_destroy(huge);
+        ++failed_checks;
+    }
+}
+
 int main(int argc, char* argv[]) {
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(arena_example());
+    INSTRUMENTED(object_pool_example());
+
+    /* A failed check must show in the exit status, which the crash below
+       would hide. */
+    if (failed_checks != 0) {
+        instrument_dump();
+        return 1;
+    }
+
+    /* This one goes last, since it may well crash. Flush stdout and write
+       the measurements first, so they are not lost if it does. */
+    fflush(stdout);
+    instrument_dump();
     undefined_behavior();
+    return 0;
 }
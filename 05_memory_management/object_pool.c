@@ -0,0 +1,259 @@
+#include "object_pool.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Free objects are kept on a FREE LIST: each free object holds a pointer to
+   the next free object in its first 8 bytes. Allocating pops the first object
+   off the list, and freeing pushes it back on.
+
+   To let many threads push and pop at once without a lock, the list is a
+   TREIBER STACK. A thread reads the head, works out the new head, and then
+   uses compare-and-swap (CAS) to install it only if the head has not changed
+   in the meantime. If it has, the thread just tries again.
+
+   The ABA PROBLEM: thread 1 reads head A with next B, and is paused. Thread 2
+   pops A, pops B, and pushes A back. The head is A again, so thread 1's CAS
+   succeeds, and installs B, which is in use!
+
+   To prevent this, the head is a TAGGED POINTER. x86-64 pointers only use
+   their low 48 bits, so the top 16 bits hold a counter that changes on every
+   push and pop. In the story above, the head would be A with a different tag,
+   and thread 1's CAS would fail.
+
+   Slabs are never freed before the pool is destroyed, so reading next from
+   an object that another thread just popped is harmless. The CAS then fails.
+*/
+
+#define DEFAULT_OBJECTS_PER_SLAB 1024
+#define POINTER_BITS 48
+#define POINTER_MASK ((UINT64_C(1) << POINTER_BITS) - 1)
+
+typedef struct free_object {
+    _Atomic(struct free_object*) next;
+} free_object_t;
+
+typedef struct slab {
+    struct slab* next;
+    alignas(max_align_t) char objects[];
+} slab_t;
+
+struct object_pool {
+    _Atomic uint64_t free_head; /* tagged pointer to a free_object_t */
+    size_t object_size;
+    size_t objects_per_slab;
+
+    pthread_mutex_t slab_lock; /* only taken to add a slab */
+    slab_t* slabs;
+    atomic_size_t slab_count;
+
+    atomic_size_t in_use;
+    atomic_size_t high_water;
+};
+
+static free_object_t* untag(uint64_t tagged) {
+    return (free_object_t*)(uintptr_t)(tagged & POINTER_MASK);
+}
+
+static uint64_t retag(uint64_t old_tagged, free_object_t* object) {
+    uint64_t tag = (old_tagged >> POINTER_BITS) + 1;
+    return (tag << POINTER_BITS) | (uint64_t)(uintptr_t)object;
+}
+
+/* Pushes the list first ... last, which are already linked together. */
+static void push_list(object_pool_t* pool, free_object_t* first,
+                      free_object_t* last) {
+    uint64_t head = atomic_load(&pool->free_head);
+    do {
+        atomic_store_explicit(&last->next, untag(head), memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(&pool->free_head, &head,
+                                           retag(head, first)));
+}
+
+static free_object_t* pop(object_pool_t* pool) {
+    uint64_t head = atomic_load(&pool->free_head);
+    for (;;) {
+        free_object_t* object = untag(head);
+        if (object == NULL)
+            return NULL;
+        free_object_t* next = atomic_load_explicit(&object->next,
+                                                   memory_order_relaxed);
+        if (atomic_compare_exchange_weak(&pool->free_head, &head,
+                                         retag(head, next)))
+            return object;
+    }
+}
+
+static free_object_t* object_at(slab_t* slab, size_t object_size, size_t i) {
+    return (free_object_t*)(slab->objects + i * object_size);
+}
+
+/* Adds a slab and pushes all of its objects. Returns 0 if out of memory. */
+static int add_slab(object_pool_t* pool) {
+    pthread_mutex_lock(&pool->slab_lock);
+
+    /* another thread may have added a slab while we waited for the lock */
+    if (untag(atomic_load(&pool->free_head)) != NULL) {
+        pthread_mutex_unlock(&pool->slab_lock);
+        return 1;
+    }
+
+    size_t count = pool->objects_per_slab;
+    slab_t* slab = (slab_t*)malloc(sizeof(slab_t) + count * pool->object_size);
+    if (slab == NULL || (uintptr_t)slab > POINTER_MASK) {
+        free(slab);
+        pthread_mutex_unlock(&pool->slab_lock);
+        return 0;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    atomic_fetch_add(&pool->slab_count, 1);
+
+    for (size_t i = 0; i + 1 < count; ++i) {
+        atomic_init(&object_at(slab, pool->object_size, i)->next,
+                    object_at(slab, pool->object_size, i + 1));
+    }
+    push_list(pool, object_at(slab, pool->object_size, 0),
+              object_at(slab, pool->object_size, count - 1));
+
+    pthread_mutex_unlock(&pool->slab_lock);
+    return 1;
+}
+
+object_pool_t* object_pool_create(size_t object_size, size_t objects_per_slab) {
+    /* every object must have room for the free list pointer, and the next
+       object must start aligned */
+    if (object_size < sizeof(free_object_t))
+        object_size = sizeof(free_object_t);
+    if (object_size > SIZE_MAX - 7)
+        return NULL;
+    object_size = (object_size + 7) / 8 * 8;
+
+    /* A slab is sizeof(slab_t) + objects_per_slab * object_size bytes. If
+       that doesn't fit in a size_t, it would wrap around to a small slab,
+       and add_slab would link objects far past its end. */
+    if (objects_per_slab == 0)
+        objects_per_slab = DEFAULT_OBJECTS_PER_SLAB;
+    if (objects_per_slab > (SIZE_MAX - sizeof(slab_t)) / object_size)
+        return NULL;
+
+    object_pool_t* pool = (object_pool_t*)malloc(sizeof(object_pool_t));
+    if (pool == NULL)
+        return NULL;
+
+    atomic_init(&pool->free_head, 0);
+    pool->object_size = object_size;
+    pool->objects_per_slab = objects_per_slab;
+    pthread_mutex_init(&pool->slab_lock, NULL);
+    pool->slabs = NULL;
+    atomic_init(&pool->slab_count, 0);
+    atomic_init(&pool->in_use, 0);
+    atomic_init(&pool->high_water, 0);
+    return pool;
+}
+
+void object_pool_destroy(object_pool_t* pool) {
+    while (pool->slabs != NULL) {
+        slab_t* next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    pthread_mutex_destroy(&pool->slab_lock);
+    free(pool);
+}
+
+static void count_allocs(object_pool_t* pool, size_t count) {
+    size_t in_use = atomic_fetch_add_explicit(&pool->in_use, count,
+                                              memory_order_relaxed) + count;
+    size_t high_water = atomic_load_explicit(&pool->high_water,
+                                             memory_order_relaxed);
+    while (in_use > high_water &&
+           !atomic_compare_exchange_weak(&pool->high_water, &high_water,
+                                         in_use));
+}
+
+static void* alloc_uncounted(object_pool_t* pool) {
+    free_object_t* object;
+    while ((object = pop(pool)) == NULL) {
+        if (!add_slab(pool))
+            return NULL;
+    }
+    return object;
+}
+
+void* object_pool_alloc(object_pool_t* pool) {
+    void* object = alloc_uncounted(pool);
+    if (object != NULL)
+        count_allocs(pool, 1);
+    return object;
+}
+
+void object_pool_free(object_pool_t* pool, void* object) {
+    free_object_t* free_object = (free_object_t*)object;
+    push_list(pool, free_object, free_object);
+    atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+}
+
+void object_pool_get_stats(object_pool_t* pool, object_pool_stats_t* stats) {
+    stats->in_use = atomic_load(&pool->in_use);
+    stats->high_water = atomic_load(&pool->high_water);
+    stats->slab_count = atomic_load(&pool->slab_count);
+    stats->capacity = stats->slab_count * pool->objects_per_slab;
+    stats->fragmentation = stats->capacity == 0 ? 0.0 :
+        1.0 - (double)stats->in_use / stats->capacity;
+}
+
+/* Caches move objects to and from the pool half a cache at a time, so a
+   thread that allocates and frees in a loop doesn't bounce between an empty
+   and a full cache. */
+
+void pool_cache_init(pool_cache_t* cache, object_pool_t* pool) {
+    cache->pool = pool;
+    cache->count = 0;
+}
+
+void* pool_cache_alloc(pool_cache_t* cache) {
+    if (cache->count == 0) {
+        while (cache->count < POOL_CACHE_SIZE / 2) {
+            void* object = alloc_uncounted(cache->pool);
+            if (object == NULL)
+                break;
+            cache->objects[cache->count++] = object;
+        }
+        if (cache->count == 0)
+            return NULL;
+        count_allocs(cache->pool, cache->count);
+    }
+    return cache->objects[--cache->count];
+}
+
+static void return_objects(pool_cache_t* cache, size_t keep) {
+    size_t returning = cache->count - keep;
+    if (returning == 0)
+        return;
+
+    /* link them into one list and push it with a single CAS */
+    for (size_t i = keep; i + 1 < cache->count; ++i) {
+        atomic_store_explicit(&((free_object_t*)cache->objects[i])->next,
+                              (free_object_t*)cache->objects[i + 1],
+                              memory_order_relaxed);
+    }
+    push_list(cache->pool, (free_object_t*)cache->objects[keep],
+              (free_object_t*)cache->objects[cache->count - 1]);
+    atomic_fetch_sub_explicit(&cache->pool->in_use, returning,
+                              memory_order_relaxed);
+    cache->count = keep;
+}
+
+void pool_cache_free(pool_cache_t* cache, void* object) {
+    if (cache->count == POOL_CACHE_SIZE)
+        return_objects(cache, POOL_CACHE_SIZE / 2);
+    cache->objects[cache->count++] = object;
+}
+
+void pool_cache_flush(pool_cache_t* cache) {
+    return_objects(cache, 0);
+}
@@ -0,0 +1,68 @@
+/* An OBJECT POOL hands out objects that all have the same size, and can be
+   used from many threads at once. Through a pool_cache_t (below) that is
+   much faster than malloc. */
+
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <stddef.h>
+
+/* Opaque, see object_pool.c. */
+typedef struct object_pool object_pool_t;
+
+/* Creates a pool of objects of object_size bytes. Memory is taken from malloc
+   in SLABS of objects_per_slab objects (0 for a default). Objects are
+   aligned to at least 8 bytes. Returns NULL if out of memory, or if a slab
+   would be too big to fit in a size_t. */
+object_pool_t* object_pool_create(size_t object_size, size_t objects_per_slab);
+
+/* Frees all slabs. Every object from the pool becomes invalid. */
+void object_pool_destroy(object_pool_t* pool);
+
+/* Returns an object, or NULL if out of memory. Safe to call from any thread.
+
+   Every object_pool_alloc and object_pool_free does two atomic
+   read-modify-writes on memory all threads share: one on the free list and
+   one on the stats. That makes them SLOWER than malloc and free, which
+   keep a cache for each thread: about 44 ns against 18 ns for an alloc and
+   free on one thread, and the gap grows with more threads (see
+   bench/microbench_memory.c). Anything that allocates often should go
+   through a pool_cache_t instead, which costs about 5 ns. */
+void* object_pool_alloc(object_pool_t* pool);
+
+/* Gives object back to the pool it came from. Safe to call from any thread. */
+void object_pool_free(object_pool_t* pool, void* object);
+
+typedef struct {
+    size_t in_use;        /* objects allocated and not yet freed */
+    size_t high_water;    /* the most objects ever in use at once */
+    size_t capacity;      /* objects in all slabs, in use or free */
+    size_t slab_count;
+    double fragmentation; /* fraction of capacity sitting unused */
+} object_pool_stats_t;
+
+void object_pool_get_stats(object_pool_t* pool, object_pool_stats_t* stats);
+
+/* A pool_cache_t keeps a few free objects for ONE thread, so most allocs and
+   frees don't touch the shared pool at all. Each thread that wants one
+   declares its own (typically as a local variable) and must call
+   pool_cache_flush before it goes away.
+
+   Objects sitting in a cache count as in use in the pool's stats.
+*/
+#define POOL_CACHE_SIZE 64
+
+typedef struct {
+    object_pool_t* pool;
+    size_t count;
+    void* objects[POOL_CACHE_SIZE];
+} pool_cache_t;
+
+void pool_cache_init(pool_cache_t* cache, object_pool_t* pool);
+void* pool_cache_alloc(pool_cache_t* cache);
+void pool_cache_free(pool_cache_t* cache, void* object);
+
+/* Returns every cached object to the pool. */
+void pool_cache_flush(pool_cache_t* cache);
+
+#endif /* OBJECT_POOL_H */
@@ -0,0 +1,25 @@
+/* The record used in this lesson, and the three ways memory.c makes one. They
+   live in their own file so the benchmarks in bench/ can use them too. */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "arena.h"
+#include "object_pool.h"
+
+typedef struct {
+    int age;
+    int height; /*in inches*/
+} record_t;
+
+/* With malloc. The caller owns the record, and must free it. */
+record_t* make_record(int age, int height);
+
+/* In an arena. The arena owns the record, the caller must NOT free it. */
+record_t* make_record_in(arena_t* arena, int age, int height);
+
+/* From a pool of record_t sized objects. Give it back with
+   object_pool_free. */
+record_t* make_record_from_pool(object_pool_t* pool, int age, int height);
+
+#endif /* RECORD_H */
@@ -2,4 +2,4 @@
 
 set -x
 
-gcc -Werror -o ptr_arithmetic ptr_arithmetic.c
+gcc -Werror -o ptr_arithmetic ptr_arithmetic.c fast_find.c fast_case.c mapped_file.c slices.c ../instrument/instrument.c
@@ -0,0 +1,145 @@
+#include "fast_case.h"
+
+#include <ctype.h>
+#include <immintrin.h>
+
+/* In ASCII, upper and lower case letters differ in exactly one bit:
+
+   'A' = 0x41 = 0100 0001
+   'a' = 0x61 = 0110 0001
+
+   So changing case is "flip bit 0x20 of every char that is a letter of the
+   right case". With vectors we can find those chars with two compares, and
+   flip their bits with one xor, for 32 or 64 chars at once.
+
+   The three conversions only differ in which chars get flipped:
+
+   upper:  chars in 'a'..'z'
+   lower:  chars in 'A'..'Z'
+   swap:   chars for which (ch | 0x20) is in 'a'..'z', that is, any letter
+
+   A case_rule_t describes that choice.
+
+   Chars 0x80 and up are not ASCII. What toupper does with them depends on the
+   locale, so a block containing any of them is converted by scalar_convert
+   one char at a time instead.
+*/
+
+typedef void (*scalar_convert)(char* begin, char* end);
+
+typedef struct {
+    char or_bits;
+    char first;
+    char last;
+    scalar_convert scalar;
+} case_rule_t;
+
+static void uppercase_scalar(char* begin, char* end) {
+    for (; begin != end; ++begin)
+        *begin = toupper((unsigned char)*begin);
+}
+
+static void lowercase_scalar(char* begin, char* end) {
+    for (; begin != end; ++begin)
+        *begin = tolower((unsigned char)*begin);
+}
+
+static void swapcase_scalar(char* begin, char* end) {
+    for (; begin != end; ++begin) {
+        unsigned char ch = *begin;
+        *begin = isupper(ch) ? tolower(ch) : toupper(ch);
+    }
+}
+
+static case_rule_t const upper_rule = {0, 'a', 'z', uppercase_scalar};
+static case_rule_t const lower_rule = {0, 'A', 'Z', lowercase_scalar};
+static case_rule_t const swap_rule = {0x20, 'a', 'z', swapcase_scalar};
+
+__attribute__((target("avx2")))
+static void convert_avx2(char* begin, char* end, case_rule_t const * rule) {
+    __m256i const or_bits = _mm256_set1_epi8(rule->or_bits);
+    __m256i const before_first = _mm256_set1_epi8(rule->first - 1);
+    __m256i const after_last = _mm256_set1_epi8(rule->last + 1);
+    __m256i const case_bit = _mm256_set1_epi8(0x20);
+
+    for (; end - begin >= 32; begin += 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i const *)begin);
+
+        /* the top bit of every non-ASCII char is set */
+        if (_mm256_movemask_epi8(chars)) {
+            rule->scalar(begin, begin + 32);
+            continue;
+        }
+
+        /* all chars are 0..127 here, so signed compares are fine */
+        __m256i key = _mm256_or_si256(chars, or_bits);
+        __m256i flip = _mm256_and_si256(_mm256_cmpgt_epi8(key, before_first),
+                                        _mm256_cmpgt_epi8(after_last, key));
+        chars = _mm256_xor_si256(chars, _mm256_and_si256(flip, case_bit));
+        _mm256_storeu_si256((__m256i*)begin, chars);
+    }
+
+    rule->scalar(begin, end);
+}
+
+/* AVX-512 compares produce a MASK register with one bit per char, instead of
+   a vector. The blend takes the flipped char wherever the mask bit is set. */
+__attribute__((target("avx512f,avx512bw")))
+static void convert_avx512(char* begin, char* end, case_rule_t const * rule) {
+    __m512i const or_bits = _mm512_set1_epi8(rule->or_bits);
+    __m512i const first = _mm512_set1_epi8(rule->first);
+    __m512i const last = _mm512_set1_epi8(rule->last);
+    __m512i const case_bit = _mm512_set1_epi8(0x20);
+
+    for (; end - begin >= 64; begin += 64) {
+        __m512i chars = _mm512_loadu_si512(begin);
+
+        if (_mm512_movepi8_mask(chars)) {
+            rule->scalar(begin, begin + 64);
+            continue;
+        }
+
+        __m512i key = _mm512_or_si512(chars, or_bits);
+        __mmask64 flip = _mm512_cmpge_epu8_mask(key, first) &
+                         _mm512_cmple_epu8_mask(key, last);
+        chars = _mm512_mask_blend_epi8(flip, chars,
+                                       _mm512_xor_si512(chars, case_bit));
+        _mm512_storeu_si512(begin, chars);
+    }
+
+    convert_avx2(begin, end, rule);
+}
+
+typedef void (*convert_func)(char*, char*, case_rule_t const *);
+
+static void convert_scalar(char* begin, char* end, case_rule_t const * rule) {
+    rule->scalar(begin, end);
+}
+
+static convert_func pick_convert() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+        return convert_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return convert_avx2;
+    return convert_scalar;
+}
+
+static void convert(char* begin, char* end, case_rule_t const * rule) {
+    static convert_func impl = NULL;
+    if (impl == NULL)
+        impl = pick_convert();
+    impl(begin, end, rule);
+}
+
+void uppercase_chars(char* begin, char* end) {
+    convert(begin, end, &upper_rule);
+}
+
+void lowercase_chars(char* begin, char* end) {
+    convert(begin, end, &lower_rule);
+}
+
+void swapcase_chars(char* begin, char* end) {
+    convert(begin, end, &swap_rule);
+}
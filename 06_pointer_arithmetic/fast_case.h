@@ -0,0 +1,25 @@
+/* Faster versions of capitalize_chars from ptr_arithmetic.c. */
+
+#ifndef FAST_CASE_H
+#define FAST_CASE_H
+
+/* Each of these changes the case of every char in the slice [begin, end), in
+   place.
+
+   uppercase_chars  does the same as capitalize_chars (toupper on every char)
+   lowercase_chars  calls tolower on every char
+   swapcase_chars   makes upper case chars lower case, and the other way around
+
+   They follow the C locale's rules for ASCII: only 'a'..'z' and 'A'..'Z'
+   change case. Runs of plain ASCII chars are converted 32 or 64 at a time
+   with AVX2 or AVX-512, by flipping the case bit, without asking the locale.
+   Blocks containing non-ASCII chars are handed to toupper/tolower one char
+   at a time, which leave those chars alone in the C locale. So in the C
+   locale, which a program is in until it calls setlocale, the result is the
+   same as the simple loop; in other locales it may not be.
+*/
+void uppercase_chars(char* begin, char* end);
+void lowercase_chars(char* begin, char* end);
+void swapcase_chars(char* begin, char* end);
+
+#endif /* FAST_CASE_H */
@@ -0,0 +1,210 @@
+#include "fast_find.h"
+
+#include <immintrin.h>
+
+/* The idea is the same for SSE2 and AVX2:
+
+   1. Load 16 (or 32) chars into a vector register.
+   2. Compare all of them against the needle at once. Each matching byte
+      becomes 0xff, each other byte becomes 0x00.
+   3. movemask squeezes the top bit of every byte into an ordinary integer,
+      one bit per char.
+   4. If that integer is not zero, its lowest set bit is the first match.
+
+   Loads are unaligned (loadu), and only happen while at least a full vector
+   of the slice is left. In find_first_of the last few chars are checked one
+   at a time like find_char does, so we never read past end.
+*/
+
+static char* find_first_of_scalar(char* begin, char* end,
+                                  char const * needles, size_t needle_count) {
+    for (; begin != end; ++begin) {
+        for (size_t i = 0; i < needle_count; ++i) {
+            if (*begin == needles[i])
+                return begin;
+        }
+    }
+    return end;
+}
+
+static char* find_first_of_sse2(char* begin, char* end,
+                                char const * needles, size_t needle_count) {
+    __m128i broadcast[FIND_MAX_NEEDLES];
+    for (size_t i = 0; i < needle_count; ++i)
+        broadcast[i] = _mm_set1_epi8(needles[i]);
+
+    for (; end - begin >= 16; begin += 16) {
+        __m128i chars = _mm_loadu_si128((__m128i const *)begin);
+        __m128i matches = _mm_cmpeq_epi8(chars, broadcast[0]);
+        for (size_t i = 1; i < needle_count; ++i)
+            matches = _mm_or_si128(matches,
+                                   _mm_cmpeq_epi8(chars, broadcast[i]));
+
+        unsigned mask = _mm_movemask_epi8(matches);
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+
+    return find_first_of_scalar(begin, end, needles, needle_count);
+}
+
+__attribute__((target("avx2")))
+static char* find_first_of_avx2(char* begin, char* end,
+                                char const * needles, size_t needle_count) {
+    __m256i broadcast[FIND_MAX_NEEDLES];
+    for (size_t i = 0; i < needle_count; ++i)
+        broadcast[i] = _mm256_set1_epi8(needles[i]);
+
+    for (; end - begin >= 32; begin += 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i const *)begin);
+        __m256i matches = _mm256_cmpeq_epi8(chars, broadcast[0]);
+        for (size_t i = 1; i < needle_count; ++i)
+            matches = _mm256_or_si256(matches,
+                                      _mm256_cmpeq_epi8(chars, broadcast[i]));
+
+        unsigned mask = _mm256_movemask_epi8(matches);
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+
+    /* fewer than 32 chars left, let the 16 wide version finish up. */
+    return find_first_of_sse2(begin, end, needles, needle_count);
+}
+
+/* Searching for a single char is by far the most common case, and the loops
+   above are too slow for it: each iteration loads one vector and then goes
+   around the needle loop. find_char_fast has loops of its own that check 4
+   vectors per iteration, ORing their compares together, so there is one
+   branch per 64 (or 128) chars. Only when something matched do we look at
+   which of the 4 vectors it was in.
+
+   The last few chars don't need a scalar loop either. If the slice is at
+   least one vector long, the vector ENDING at end is checked. It overlaps
+   chars already checked, but none of those matched, so its first match is
+   the first match.
+*/
+
+static char* find_char_sse2(char* begin, char* end, char ch) {
+    if (end - begin < 16)
+        return find_first_of_scalar(begin, end, &ch, 1);
+    char* const last = end - 16;
+    __m128i const needle = _mm_set1_epi8(ch);
+
+    for (; end - begin >= 64; begin += 64) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)begin),
+                                   needle);
+        __m128i b = _mm_cmpeq_epi8(
+            _mm_loadu_si128((__m128i const *)(begin + 16)), needle);
+        __m128i c = _mm_cmpeq_epi8(
+            _mm_loadu_si128((__m128i const *)(begin + 32)), needle);
+        __m128i d = _mm_cmpeq_epi8(
+            _mm_loadu_si128((__m128i const *)(begin + 48)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b),
+                                           _mm_or_si128(c, d)))) {
+            unsigned long long mask =
+                (unsigned long long)_mm_movemask_epi8(a) |
+                (unsigned long long)_mm_movemask_epi8(b) << 16 |
+                (unsigned long long)_mm_movemask_epi8(c) << 32 |
+                (unsigned long long)_mm_movemask_epi8(d) << 48;
+            return begin + __builtin_ctzll(mask);
+        }
+    }
+
+    for (; end - begin >= 16; begin += 16) {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((__m128i const *)begin), needle));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+
+    if (begin == end)
+        return end;
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((__m128i const *)last), needle));
+    return mask ? last + __builtin_ctz(mask) : end;
+}
+
+__attribute__((target("avx2")))
+static char* find_char_avx2(char* begin, char* end, char ch) {
+    if (end - begin < 32)
+        return find_char_sse2(begin, end, ch);
+    char* const last = end - 32;
+    __m256i const needle = _mm256_set1_epi8(ch);
+
+    for (; end - begin >= 128; begin += 128) {
+        __m256i a = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((__m256i const *)begin), needle);
+        __m256i b = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((__m256i const *)(begin + 32)), needle);
+        __m256i c = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((__m256i const *)(begin + 64)), needle);
+        __m256i d = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((__m256i const *)(begin + 96)), needle);
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b),
+                                                 _mm256_or_si256(c, d)))) {
+            /* 128 chars don't fit in one 64 bit mask, so two halves */
+            unsigned long long mask =
+                (unsigned)_mm256_movemask_epi8(a) |
+                (unsigned long long)(unsigned)_mm256_movemask_epi8(b) << 32;
+            if (mask)
+                return begin + __builtin_ctzll(mask);
+            mask = (unsigned)_mm256_movemask_epi8(c) |
+                   (unsigned long long)(unsigned)_mm256_movemask_epi8(d) << 32;
+            return begin + 64 + __builtin_ctzll(mask);
+        }
+    }
+
+    for (; end - begin >= 32; begin += 32) {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((__m256i const *)begin), needle));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+
+    if (begin == end)
+        return end;
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256((__m256i const *)last), needle));
+    return mask ? last + __builtin_ctz(mask) : end;
+}
+
+typedef char* (*find_char_func)(char*, char*, char);
+
+static find_char_func pick_find_char() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_char_avx2;
+    return find_char_sse2;
+}
+
+typedef char* (*find_first_of_func)(char*, char*, char const *, size_t);
+
+static find_first_of_func pick_find_first_of() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_first_of_avx2;
+    return find_first_of_sse2;
+}
+
+char* find_first_of(char* begin, char* end,
+                    char const * needles, size_t needle_count) {
+    static find_first_of_func impl = NULL;
+
+    if (needle_count == 0)
+        return end;
+    if (needle_count == 1)
+        return find_char_fast(begin, end, needles[0]);
+    if (needle_count > FIND_MAX_NEEDLES)
+        return find_first_of_scalar(begin, end, needles, needle_count);
+
+    if (impl == NULL)
+        impl = pick_find_first_of();
+    return impl(begin, end, needles, needle_count);
+}
+
+char* find_char_fast(char* begin, char* end, char ch) {
+    static find_char_func impl = NULL;
+    if (impl == NULL)
+        impl = pick_find_char();
+    return impl(begin, end, ch);
+}
@@ -0,0 +1,29 @@
+/* Faster versions of find_char from ptr_arithmetic.c. */
+
+#ifndef FAST_FIND_H
+#define FAST_FIND_H
+
+#include <stddef.h>
+
+/* Like find_char, find_char_fast returns a pointer to the first character in
+   the slice [begin, end) that matches ch, or end if none match.
+
+   It compares 4 vectors of 16 or 32 chars per loop iteration, using SSE2 or
+   AVX2, whichever the processor supports. It never reads outside of the
+   slice.
+*/
+char* find_char_fast(char* begin, char* end, char ch);
+
+/* find_first_of returns a pointer to the first character in [begin, end) that
+   matches ANY of the needle_count chars in needles, or end if none match.
+   This is like strpbrk, but for slices.
+
+   Up to FIND_MAX_NEEDLES needles are searched with SSE2 or AVX2. More than
+   that still works, but falls back to checking one char at a time.
+*/
+#define FIND_MAX_NEEDLES 8
+
+char* find_first_of(char* begin, char* end,
+                    char const * needles, size_t needle_count);
+
+#endif /* FAST_FIND_H */
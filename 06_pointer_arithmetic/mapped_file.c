@@ -0,0 +1,122 @@
+#include "mapped_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void advise(char* begin, size_t length, int hints) {
+    if (length == 0)
+        return;
+
+    /* madvise only takes whole pages, so start at the beginning of the page
+       that begin is on. */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t into_page = (uintptr_t)begin % page_size;
+    begin -= into_page;
+    length += into_page;
+
+    /* The results are ignored: these are only hints. */
+    if (hints & MAPPED_SEQUENTIAL)
+        madvise(begin, length, MADV_SEQUENTIAL);
+    if (hints & MAPPED_RANDOM)
+        madvise(begin, length, MADV_RANDOM);
+    if (hints & MAPPED_WILL_NEED)
+        madvise(begin, length, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    if (hints & MAPPED_HUGE_PAGES)
+        madvise(begin, length, MADV_HUGEPAGE);
+#endif
+}
+
+int mapped_file_open(mapped_file_t* file, char const * path,
+                     mapped_mode_t mode, int hints) {
+    file->data = NULL;
+    file->size = 0;
+    file->mode = mode;
+
+    int fd = open(path, mode == MAPPED_IN_PLACE ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+    if ((uintmax_t)info.st_size > SIZE_MAX) {
+        close(fd);
+        errno = EFBIG;
+        return 0;
+    }
+
+    /* mmap can't map 0 bytes. An empty file is an empty slice. */
+    if (info.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+
+    int protection = PROT_READ;
+    int flags = MAP_SHARED;
+    if (mode == MAPPED_COPY_ON_WRITE) {
+        protection |= PROT_WRITE;
+        flags = MAP_PRIVATE;
+    } else if (mode == MAPPED_IN_PLACE) {
+        protection |= PROT_WRITE;
+    }
+
+    void* data = mmap(NULL, (size_t)info.st_size, protection, flags, fd, 0);
+    /* The mapping keeps the file open by itself, the descriptor isn't needed
+       any more. */
+    int saved_errno = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        errno = saved_errno;
+        return 0;
+    }
+
+    file->data = (char*)data;
+    file->size = (size_t)info.st_size;
+    advise(file->data, file->size, hints);
+    return 1;
+}
+
+void mapped_file_close(mapped_file_t* file) {
+    if (file->data != NULL)
+        munmap(file->data, file->size);
+    file->data = NULL;
+    file->size = 0;
+}
+
+void mapped_file_advise(mapped_file_t const * file, size_t offset,
+                        size_t length, int hints) {
+    file_slice_t slice = mapped_file_slice(file, offset, length);
+    advise(slice.begin, slice.end - slice.begin, hints);
+}
+
+int mapped_file_sync(mapped_file_t const * file) {
+    if (file->mode != MAPPED_IN_PLACE || file->data == NULL)
+        return 1;
+    return msync(file->data, file->size, MS_SYNC) == 0;
+}
+
+file_slice_t mapped_file_slice(mapped_file_t const * file, size_t offset,
+                               size_t length) {
+    if (file->data == NULL) {
+        file_slice_t empty = {NULL, NULL};
+        return empty;
+    }
+    if (offset > file->size)
+        offset = file->size;
+    if (length > file->size - offset)
+        length = file->size - offset;
+
+    file_slice_t slice = {file->data + offset, file->data + offset + length};
+    return slice;
+}
+
+file_slice_t mapped_file_all(mapped_file_t const * file) {
+    return mapped_file_slice(file, 0, file->size);
+}
@@ -0,0 +1,95 @@
+/* Files as slices: mapping a file into memory, so the slice functions from
+   ptr_arithmetic.c work on it directly. */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+/* Reading a file with fread or read COPIES it: the kernel keeps the file's
+   pages in its page cache, and read copies them into our buffer. mmap
+   instead makes the page cache pages themselves part of our address space.
+   The first time a page is touched the kernel fills it in (a PAGE FAULT),
+   and from then on it is ordinary memory, with no copies and no system
+   calls. The whole file becomes one char array, so [begin, end) is just a
+   slice, even if the file is many GB.
+
+   How writes to that memory are treated is chosen when it is mapped:
+
+   MAPPED_READ_ONLY       writing to the slice crashes the program
+   MAPPED_COPY_ON_WRITE   writes go to a private copy of each page written
+                          to, the file itself is not changed
+   MAPPED_IN_PLACE        writes change the file, as if written with write()
+
+   Mapping is not free either. Every page costs a page fault the first time
+   it is touched, and copy on write costs a fault AND a copy of the page the
+   first time it is written. For changing every byte of a file, fread into
+   a small buffer that stays in the cache is several times faster (see
+   bench/microbench_pointer_arithmetic.c). Mapping wins when only parts of
+   a big file are read, or when it is read many times.
+*/
+typedef enum {
+    MAPPED_READ_ONLY,
+    MAPPED_COPY_ON_WRITE,
+    MAPPED_IN_PLACE
+} mapped_mode_t;
+
+/* Hints about how the file will be used, passed on to the kernel with
+   madvise. They may be combined with |. A hint can't change what the
+   program does, only how fast it is, so a kernel that doesn't support one
+   simply ignores it.
+
+   MAPPED_SEQUENTIAL   read from begin to end: read ahead aggressively, and
+                       pages already read may be dropped early
+   MAPPED_RANDOM       read all over the place: don't read ahead
+   MAPPED_WILL_NEED    start reading the whole file in now
+   MAPPED_HUGE_PAGES   use 2 MB pages instead of 4 KB ones where possible,
+                       so the processor needs far fewer page table entries.
+                       Only some file systems (such as tmpfs) can do this.
+*/
+enum {
+    MAPPED_SEQUENTIAL = 1,
+    MAPPED_RANDOM = 2,
+    MAPPED_WILL_NEED = 4,
+    MAPPED_HUGE_PAGES = 8
+};
+
+typedef struct {
+    char* data;
+    size_t size;
+    mapped_mode_t mode;
+} mapped_file_t;
+
+/* Maps the file at path into memory. Returns 1 on success, or 0 with errno
+   set if the file couldn't be opened or mapped. An empty file is mapped as
+   an empty slice. */
+int mapped_file_open(mapped_file_t* file, char const * path,
+                     mapped_mode_t mode, int hints);
+
+/* Unmaps the file. In MAPPED_IN_PLACE mode the kernel still writes the
+   changes to the file afterwards, in its own time. */
+void mapped_file_close(mapped_file_t* file);
+
+/* Gives new hints for the bytes [offset, offset + length) of the file, for
+   example MAPPED_WILL_NEED for a part that is about to be read. */
+void mapped_file_advise(mapped_file_t const * file, size_t offset,
+                        size_t length, int hints);
+
+/* In MAPPED_IN_PLACE mode, writes the changes to the file now, and waits
+   until they are written. Returns 1 on success, or 0 with errno set. */
+int mapped_file_sync(mapped_file_t const * file);
+
+/* A slice of length bytes of the file, starting at offset. The slice is cut
+   short at the end of the file. */
+typedef struct {
+    char* begin;
+    char* end;
+} file_slice_t;
+
+file_slice_t mapped_file_slice(mapped_file_t const * file, size_t offset,
+                               size_t length);
+
+/* The whole file as a slice. */
+file_slice_t mapped_file_all(mapped_file_t const * file);
+
+#endif /* MAPPED_FILE_H */
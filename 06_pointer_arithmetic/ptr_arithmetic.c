@@ -1,6 +1,15 @@
 #include <stdio.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "fast_case.h"
+#include "fast_find.h"
+#include "mapped_file.h"
+#include "slices.h"
+
+#include "../instrument/instrument.h"
 
 /* Pointers are a kind of ITERATOR. That means they can be used to move over
    a collection of objects, specifically, an array.
@@ -124,21 +133,15 @@ void int_ptr_arithmetic() {
     Both pointers of the slice point to the same position, so the slice is emtpy.
 */
 
-/* lets define some functions that work with slices! */
+/* lets define some functions that work with slices! They are in slices.c,
+   so the benchmarks and lesson 07 can use them too. Open it next to this
+   file; each function is a single loop that walks begin up to end.
 
-void capitalize_chars(char* begin, char* end) {
-    for(; begin != end; ++begin) {
-        *begin = toupper(*begin);
-    }
-}
+   capitalize_chars calls toupper on every char in the slice.
 
-/* find_char returns a pointer to the first character that matches ch.
+   find_char returns a pointer to the first character that matches ch.
    If none match ch, it returns end.
 */
-char* find_char(char* begin, char* end, char ch) {
-    for(; begin != end && *begin != ch; ++begin);
-    return begin;
-}
 
 void demonstrate_slicing() {
     puts(__func__);
@@ -170,8 +173,276 @@ void demonstrate_slicing() {
     */
 }
 
+/* The fast versions below are checked against the simple ones. Every check
+   that finds a difference counts here, and makes main return an error. */
+int failed_checks = 0;
+
+/* find_char checks one char per loop iteration. fast_find.c has versions
+   that check 16 or 32 chars at once, but keep exactly the same slice
+   contract: they return end when nothing matches.
+
+   find_first_of searches for any of several chars at once, which is handy for
+   splitting text into words.
+*/
+
+/* The simple version of find_first_of, to check the fast one against. */
+char* find_first_of_simple(char* begin, char* end,
+                           char const * needles, size_t needle_count) {
+    for (; begin != end; ++begin) {
+        if (memchr(needles, *begin, needle_count) != NULL)
+            return begin;
+    }
+    return end;
+}
+
+void demonstrate_fast_find() {
+    puts(__func__);
+    char string[] = "a rather long string, so the vector loop has work: "
+                    "foo bar spam eggs; the end.";
+    char* begin = string;
+    char* end = string + strlen(string);
+
+    /* the fast version agrees with find_char for every slice and char */
+    int mismatches = 0;
+    for (char* p = begin; p != end; ++p) {
+        for (char* q = p; q != end; ++q) {
+            if (find_char_fast(p, end, *q) != find_char(p, end, *q))
+                ++mismatches;
+        }
+        if (find_char_fast(p, end, 'z') != end)
+            ++mismatches;
+    }
+
+    /* and on slices long enough for the 4 vector loops, with the char at
+       every position, and every start and end around it */
+    char long_string[300];
+    memset(long_string, 'a', sizeof(long_string));
+    for (size_t at = 0; at < sizeof(long_string); ++at) {
+        long_string[at] = '!';
+        for (size_t start = 0; start <= at; start += 7) {
+            for (size_t stop = at; stop <= sizeof(long_string); stop += 5) {
+                char* p = long_string + start;
+                char* q = long_string + stop;
+                if (find_char_fast(p, q, '!') != find_char(p, q, '!'))
+                    ++mismatches;
+            }
+        }
+        long_string[at] = 'a';
+    }
+    printf("find_char_fast mismatches: %d\n", mismatches);
+    if (mismatches != 0)
+        ++failed_checks;
+
+    /* find_first_of gets the same sweep, with each of its needles in turn,
+       and with 2 to 8 needles for the vector loops and 9 and 12 for the one
+       char at a time fallback. Some needles are negative chars. A second
+       needle a little further on checks that the first one is found. */
+    char const needles[] = "!#$%&*+,\xe9\x80\xff-";
+    size_t const needle_counts[] = {2, 3, 4, 5, 7, 8, 9, 12};
+    mismatches = 0;
+    for (size_t n = 0; n < sizeof(needle_counts) / sizeof(needle_counts[0]);
+         ++n) {
+        size_t count = needle_counts[n];
+        for (size_t at = 0; at < sizeof(long_string); ++at) {
+            long_string[at] = needles[at % count];
+            if (at + 13 < sizeof(long_string))
+                long_string[at + 13] = needles[(at + 1) % count];
+            for (size_t start = 0; start <= at; start += 7) {
+                for (size_t stop = at; stop <= sizeof(long_string);
+                     stop += 5) {
+                    char* p = long_string + start;
+                    char* q = long_string + stop;
+                    if (find_first_of(p, q, needles, count) !=
+                        find_first_of_simple(p, q, needles, count))
+                        ++mismatches;
+                }
+            }
+            long_string[at] = 'a';
+            if (at + 13 < sizeof(long_string))
+                long_string[at + 13] = 'a';
+        }
+        /* and nothing to find */
+        if (find_first_of(long_string, long_string + sizeof(long_string),
+                          needles, count) !=
+            long_string + sizeof(long_string))
+            ++mismatches;
+    }
+    printf("find_first_of mismatches: %d\n", mismatches);
+    if (mismatches != 0)
+        ++failed_checks;
+
+    /* print each word, splitting on spaces and punctuation */
+    char const separators[] = " ,.:;";
+    char* word_begin = begin;
+    while (word_begin != end) {
+        char* word_end = find_first_of(word_begin, end, separators,
+                                       strlen(separators));
+        if (word_end != word_begin)
+            printf("%.*s\n", (int)(word_end - word_begin), word_begin);
+        word_begin = word_end == end ? end : word_end + 1;
+    }
+}
+
+/* capitalize_chars calls toupper once per char. fast_case.c converts plain
+   ASCII text 32 or 64 chars at a time, and also has lower case and swap case
+   versions.
+
+   We check that each of them gives exactly the same bytes as a simple loop
+   like capitalize_chars, for every possible char value, at every alignment
+   and for every length, so the vector loops and the chars left over after
+   them are both covered. If any of them differ, the program exits with an
+   error.
+*/
+
+void lowercase_chars_simple(char* begin, char* end) {
+    for(; begin != end; ++begin) {
+        *begin = tolower((unsigned char)*begin);
+    }
+}
+
+void swapcase_chars_simple(char* begin, char* end) {
+    for(; begin != end; ++begin) {
+        unsigned char ch = *begin;
+        if (isupper(ch))
+            *begin = tolower(ch);
+        else if (islower(ch))
+            *begin = toupper(ch);
+    }
+}
+
+typedef void (*change_case_func)(char* begin, char* end);
+
+int check_case_chars(char const * name, change_case_func simple,
+                     change_case_func fast) {
+    char expected[64 + 256];
+    char actual[64 + 256];
+    int mismatches = 0;
+
+    for (int start = 0; start < 64; ++start) {
+        for (int length = 0; length <= 256; ++length) {
+            for (int i = 0; i < 64 + 256; ++i) {
+                expected[i] = (char)(i - start);
+                actual[i] = (char)(i - start);
+            }
+            simple(expected + start, expected + start + length);
+            fast(actual + start, actual + start + length);
+            if (memcmp(expected, actual, sizeof(actual)) != 0)
+                ++mismatches;
+        }
+    }
+
+    printf("%s mismatches: %d\n", name, mismatches);
+    if (mismatches != 0)
+        ++failed_checks;
+    return mismatches;
+}
+
+void demonstrate_fast_case() {
+    puts(__func__);
+    check_case_chars("uppercase_chars", capitalize_chars, uppercase_chars);
+    check_case_chars("lowercase_chars", lowercase_chars_simple,
+                     lowercase_chars);
+    check_case_chars("swapcase_chars", swapcase_chars_simple, swapcase_chars);
+
+    char string[] = "Foo Bar Spam Eggs, and enough text to fill a vector.";
+    char* begin = string;
+    char* end = string + strlen(string);
+
+    uppercase_chars(begin, end);
+    puts(string);
+    lowercase_chars(begin, end);
+    puts(string);
+    swapcase_chars(begin, find_char(begin, end, ','));
+    puts(string);
+}
+
+/* Slices don't care where their chars are. With mapped_file.h a whole file
+   becomes one slice, and the functions above work on it without it ever
+   being read into a buffer. count_lines, also in slices.c, counts the
+   '\n's in a slice by calling find_char_fast until it returns the end.
+*/
+
+void print_file(char const * path) {
+    mapped_file_t file;
+    if (!mapped_file_open(&file, path, MAPPED_READ_ONLY, 0)) {
+        perror(path);
+        return;
+    }
+    file_slice_t all = mapped_file_all(&file);
+    printf("%.*s", (int)(all.end - all.begin), all.begin);
+    mapped_file_close(&file);
+}
+
+void demonstrate_mapped_file() {
+    puts(__func__);
+    char path[] = "/tmp/ptr_arithmetic_XXXXXX";
+    char const text[] = "first line\nsecond line\nthird line\n";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("making a file to map");
+        return;
+    }
+    if (write(fd, text, strlen(text)) != (ssize_t)strlen(text)) {
+        perror(path);
+        close(fd);
+        unlink(path);
+        return;
+    }
+    close(fd);
+
+    mapped_file_t file;
+    if (!mapped_file_open(&file, path, MAPPED_READ_ONLY, MAPPED_SEQUENTIAL)) {
+        perror(path);
+        unlink(path);
+        return;
+    }
+    printf("%ld lines\n", count_lines(mapped_file_all(&file)));
+    mapped_file_close(&file);
+
+    /* Copy on write: the mapping is changed, the file isn't. */
+    if (mapped_file_open(&file, path, MAPPED_COPY_ON_WRITE, 0)) {
+        file_slice_t all = mapped_file_all(&file);
+        capitalize_chars(all.begin, all.end);
+        printf("mapped copy:\n%.*s", (int)(all.end - all.begin), all.begin);
+        mapped_file_close(&file);
+    }
+    puts("file after copy on write:");
+    print_file(path);
+
+    /* In place: capitalize just the second line of the file itself. */
+    if (mapped_file_open(&file, path, MAPPED_IN_PLACE, 0)) {
+        file_slice_t all = mapped_file_all(&file);
+        char* second = find_char(all.begin, all.end, '\n') + 1;
+        capitalize_chars(second, find_char(second, all.end, '\n'));
+        mapped_file_sync(&file);
+        mapped_file_close(&file);
+    }
+    puts("file after changing it in place:");
+    print_file(path);
+
+    unlink(path);
+}
+
+/* ./ptr_arithmetic FILE counts the lines of FILE, however big. */
+void count_lines_in_file(char const * path) {
+    mapped_file_t file;
+    if (!mapped_file_open(&file, path, MAPPED_READ_ONLY, MAPPED_SEQUENTIAL)) {
+        perror(path);
+        return;
+    }
+    printf("%s: %ld lines\n", path, count_lines(mapped_file_all(&file)));
+    mapped_file_close(&file);
+}
+
 int main(int argc, char* argv[]) {
-    basic_ptr_arithmetic();
-    int_ptr_arithmetic();
-    demonstrate_slicing();
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(basic_ptr_arithmetic());
+    INSTRUMENTED(int_ptr_arithmetic());
+    INSTRUMENTED(demonstrate_slicing());
+    INSTRUMENTED(demonstrate_fast_find());
+    INSTRUMENTED(demonstrate_fast_case());
+    INSTRUMENTED(demonstrate_mapped_file());
+    if (argc > 1)
+        INSTRUMENTED(count_lines_in_file(argv[1]));
+    return failed_checks == 0 ? 0 : 1;
 }
@@ -0,0 +1,29 @@
+#include "slices.h"
+
+#include <ctype.h>
+
+#include "fast_find.h"
+
+void capitalize_chars(char* begin, char* end) {
+    for(; begin != end; ++begin) {
+        *begin = toupper((unsigned char)*begin);
+    }
+}
+
+char* find_char(char* begin, char* end, char ch) {
+    for(; begin != end && *begin != ch; ++begin);
+    return begin;
+}
+
+long count_lines(file_slice_t slice) {
+    long lines = 0;
+    char* begin = slice.begin;
+    for (;;) {
+        char* newline = find_char_fast(begin, slice.end, '\n');
+        if (newline == slice.end)
+            break;
+        ++lines;
+        begin = newline + 1;
+    }
+    return lines;
+}
@@ -0,0 +1,19 @@
+/* The slice functions from ptr_arithmetic.c. They live in their own file so
+   the benchmarks in bench/ and lesson 07 can use them too. */
+
+#ifndef SLICES_H
+#define SLICES_H
+
+#include "mapped_file.h"
+
+/* Upper cases every char in [begin, end), one char at a time. */
+void capitalize_chars(char* begin, char* end);
+
+/* Returns a pointer to the first character in [begin, end) that matches ch,
+   or end if none match. One char at a time, see fast_find.h for faster. */
+char* find_char(char* begin, char* end, char ch);
+
+/* Counts the '\n's in slice. */
+long count_lines(file_slice_t slice);
+
+#endif /* SLICES_H */
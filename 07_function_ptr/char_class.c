@@ -0,0 +1,136 @@
+#include "char_class.h"
+
+#include <string.h>
+#include <immintrin.h>
+
+/* find_char_in_class checks 16 or 32 chars at a time with the pshufb
+   instruction (_mm_shuffle_epi8). pshufb is a 16 entry table lookup done on
+   every byte of a vector at once.
+
+   A 16 entry table is too small to look up a whole char, so we split each char
+   into two NIBBLES (4 bit halves): char = high * 16 + low.
+
+   nibble_rows[0][low] has bit h set if the char h * 16 + low is in the class,
+   for the high nibbles 0 to 7. nibble_rows[1][low] does the same for the high
+   nibbles 8 to 15, using bit h - 8.
+
+   For each char we look up its row by the low nibble, then test the bit for
+   its high nibble. That is two pshufb lookups, a blend, an and, and a compare
+   per 16 chars.
+*/
+
+void char_class_clear(char_class_t* cls) {
+    memset(cls, 0, sizeof(*cls));
+}
+
+void char_class_add(char_class_t* cls, unsigned char ch) {
+    cls->bits[ch / 8] |= 1 << (ch % 8);
+    cls->nibble_rows[ch / 128][ch % 16] |= 1 << (ch / 16 % 8);
+}
+
+void char_class_add_range(char_class_t* cls,
+                          unsigned char first, unsigned char last) {
+    for (unsigned ch = first; ch <= last; ++ch)
+        char_class_add(cls, ch);
+}
+
+void char_class_from_pred(char_class_t* cls, int (*pred)(int)) {
+    char_class_clear(cls);
+    for (unsigned ch = 0; ch < 256; ++ch) {
+        if (pred(ch))
+            char_class_add(cls, ch);
+    }
+}
+
+static char* find_char_in_class_scalar(char* begin, char* end,
+                                       char_class_t const * cls) {
+    for (; begin != end && !char_class_contains(cls, *begin); ++begin);
+    return begin;
+}
+
+__attribute__((target("ssse3")))
+static char* find_char_in_class_ssse3(char* begin, char* end,
+                                      char_class_t const * cls) {
+    __m128i const rows_low = _mm_loadu_si128(
+        (__m128i const *)cls->nibble_rows[0]);
+    __m128i const rows_high = _mm_loadu_si128(
+        (__m128i const *)cls->nibble_rows[1]);
+    __m128i const high_bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                            1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i const nibble_mask = _mm_set1_epi8(0x0f);
+    __m128i const seven = _mm_set1_epi8(7);
+    __m128i const zero = _mm_setzero_si128();
+
+    for (; end - begin >= 16; begin += 16) {
+        __m128i chars = _mm_loadu_si128((__m128i const *)begin);
+        __m128i low = _mm_and_si128(chars, nibble_mask);
+        __m128i high = _mm_and_si128(_mm_srli_epi16(chars, 4), nibble_mask);
+
+        __m128i use_high_rows = _mm_cmpgt_epi8(high, seven);
+        __m128i row = _mm_or_si128(
+            _mm_andnot_si128(use_high_rows, _mm_shuffle_epi8(rows_low, low)),
+            _mm_and_si128(use_high_rows, _mm_shuffle_epi8(rows_high, low)));
+        __m128i bit = _mm_shuffle_epi8(high_bits, high);
+
+        __m128i misses = _mm_cmpeq_epi8(_mm_and_si128(row, bit), zero);
+        unsigned mask = ~_mm_movemask_epi8(misses) & 0xffff;
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+
+    return find_char_in_class_scalar(begin, end, cls);
+}
+
+/* Same as the ssse3 version, but 32 chars at a time. AVX2 pshufb looks up
+   each 16 byte half separately, so the tables are repeated in both halves. */
+__attribute__((target("avx2")))
+static char* find_char_in_class_avx2(char* begin, char* end,
+                                     char_class_t const * cls) {
+    __m256i const rows_low = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((__m128i const *)cls->nibble_rows[0]));
+    __m256i const rows_high = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((__m128i const *)cls->nibble_rows[1]));
+    __m256i const high_bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m256i const nibble_mask = _mm256_set1_epi8(0x0f);
+    __m256i const seven = _mm256_set1_epi8(7);
+    __m256i const zero = _mm256_setzero_si256();
+
+    for (; end - begin >= 32; begin += 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i const *)begin);
+        __m256i low = _mm256_and_si256(chars, nibble_mask);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(chars, 4),
+                                        nibble_mask);
+
+        __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(rows_low, low),
+                                         _mm256_shuffle_epi8(rows_high, low),
+                                         _mm256_cmpgt_epi8(high, seven));
+        __m256i bit = _mm256_shuffle_epi8(high_bits, high);
+
+        __m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), zero);
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(misses);
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+
+    return find_char_in_class_ssse3(begin, end, cls);
+}
+
+typedef char* (*find_in_class_func)(char*, char*, char_class_t const *);
+
+static find_in_class_func pick_find_char_in_class() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_char_in_class_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return find_char_in_class_ssse3;
+    return find_char_in_class_scalar;
+}
+
+char* find_char_in_class(char* begin, char* end, char_class_t const * cls) {
+    static find_in_class_func impl = NULL;
+    if (impl == NULL)
+        impl = pick_find_char_in_class();
+    return impl(begin, end, cls);
+}
@@ -0,0 +1,44 @@
+/* A character class is a set of chars, like "all the digits" or "all the
+   vowels". It does the same job as a predicate such as isdigit, but it is
+   just data, not a function. */
+
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+/* There are only 256 possible chars, so a set of chars fits in 256 bits, one
+   bit per char.
+
+   The nibble tables hold the same information rearranged for
+   find_char_in_class. Always change a class with the functions below so the
+   two stay in sync.
+*/
+typedef struct {
+    unsigned char bits[32];
+    unsigned char nibble_rows[2][16];
+} char_class_t;
+
+/* Make cls the empty class. */
+void char_class_clear(char_class_t* cls);
+
+/* Add a single char, or every char from first to last inclusive. */
+void char_class_add(char_class_t* cls, unsigned char ch);
+void char_class_add_range(char_class_t* cls,
+                          unsigned char first, unsigned char last);
+
+/* Build a class by asking the predicate about each of the 256 chars once.
+   Any of the ctype.h predicates such as isdigit or ispunct work. */
+void char_class_from_pred(char_class_t* cls, int (*pred)(int));
+
+/* Check one char. This is a table lookup, so it is cheap and inlines well. */
+static inline int char_class_contains(char_class_t const * cls, char ch) {
+    unsigned char uch = (unsigned char)ch;
+    return (cls->bits[uch / 8] >> (uch % 8)) & 1;
+}
+
+/* Like find_char_if from higher_order.c, but tests membership in a class
+   instead of calling a predicate. Returns the first char in [begin, end) that
+   is in cls, or end if there is none.
+*/
+char* find_char_in_class(char* begin, char* end, char_class_t const * cls);
+
+#endif /* CHAR_CLASS_H */
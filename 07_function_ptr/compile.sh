@@ -2,4 +2,4 @@
 
 set -x
 
-gcc -Wall -Werror -g -o function_ptr function_ptr.c
+gcc -Wall -Werror -g -pthread -o function_ptr function_ptr.c char_class.c higher_order.c parallel.c expr_batch.c expr_compiler.c expr_reader.c expression.c stream.c transforms.c ../06_pointer_arithmetic/slices.c ../06_pointer_arithmetic/fast_find.c ../instrument/instrument.c
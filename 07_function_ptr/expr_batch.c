@@ -0,0 +1,147 @@
+#include "expr_batch.h"
+
+#include <immintrin.h>
+
+/* eval_expression makes one indirect call per expression, and the processor
+   can't guess which function it will jump to next.
+
+   eval_expression_batch instead GROUPS the expressions by operator. For each
+   operator it gathers the operands of up to BLOCK_SIZE matching expressions
+   into small contiguous arrays, runs one kernel on all of them, and scatters
+   the results back. A kernel is a tight loop with no calls, which AVX2 can run
+   8 ints at a time.
+*/
+
+#define BLOCK_SIZE 1024
+
+typedef void (*batch_kernel)(int const * left, int const * right, int* out,
+                             size_t count);
+
+static void add_scalar(int const * left, int const * right, int* out,
+                       size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = left[i] + right[i];
+}
+
+static void sub_scalar(int const * left, int const * right, int* out,
+                       size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = left[i] - right[i];
+}
+
+static void mult_scalar(int const * left, int const * right, int* out,
+                        size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = left[i] * right[i];
+}
+
+static void div_scalar(int const * left, int const * right, int* out,
+                       size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = left[i] / right[i];
+}
+
+/* Each AVX2 kernel does 8 ints per iteration, and hands the last few to the
+   scalar kernel. */
+
+#define AVX2_KERNEL(name, scalar, vector_op)                                 \
+    __attribute__((target("avx2")))                                          \
+    static void name(int const * left, int const * right, int* out,          \
+                     size_t count) {                                         \
+        size_t i = 0;                                                        \
+        for (; i + 8 <= count; i += 8) {                                     \
+            __m256i l = _mm256_loadu_si256((__m256i const *)(left + i));     \
+            __m256i r = _mm256_loadu_si256((__m256i const *)(right + i));    \
+            _mm256_storeu_si256((__m256i*)(out + i), vector_op(l, r));       \
+        }                                                                    \
+        scalar(left + i, right + i, out + i, count - i);                     \
+    }
+
+AVX2_KERNEL(add_avx2, add_scalar, _mm256_add_epi32)
+AVX2_KERNEL(sub_avx2, sub_scalar, _mm256_sub_epi32)
+AVX2_KERNEL(mult_avx2, mult_scalar, _mm256_mullo_epi32)
+
+/* There is no vector instruction for integer division.
+
+   libdivide style tricks turn division by a FIXED divisor into a multiply and
+   a shift, but here every expression has its own divisor, so there is nothing
+   to precompute. Instead we divide as doubles. A double holds any int exactly,
+   and the truncated quotient of two ints computed in double is always the
+   exact int quotient, so the result is identical to the / operator.
+*/
+__attribute__((target("avx2")))
+static void div_avx2(int const * left, int const * right, int* out,
+                     size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d l = _mm256_cvtepi32_pd(
+            _mm_loadu_si128((__m128i const *)(left + i)));
+        __m256d r = _mm256_cvtepi32_pd(
+            _mm_loadu_si128((__m128i const *)(right + i)));
+        _mm_storeu_si128((__m128i*)(out + i),
+                         _mm256_cvttpd_epi32(_mm256_div_pd(l, r)));
+    }
+    div_scalar(left + i, right + i, out + i, count - i);
+}
+
+enum { OP_MULT, OP_DIV, OP_ADD, OP_SUB, OP_COUNT };
+
+static int op_code_to_index(char op_code) {
+    switch(op_code) {
+        case '*':
+            return OP_MULT;
+        case '/':
+            return OP_DIV;
+        case '-':
+            return OP_SUB;
+        default:
+            return OP_ADD;
+    }
+}
+
+static batch_kernel const scalar_kernels[OP_COUNT] = {
+    mult_scalar, div_scalar, add_scalar, sub_scalar
+};
+
+static batch_kernel const avx2_kernels[OP_COUNT] = {
+    mult_avx2, div_avx2, add_avx2, sub_avx2
+};
+
+static batch_kernel const * pick_kernels() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return avx2_kernels;
+    return scalar_kernels;
+}
+
+void eval_expression_batch(expr_batch_t const * batch, int* results) {
+    static batch_kernel const * kernels = NULL;
+    if (kernels == NULL)
+        kernels = pick_kernels();
+
+    size_t indices[BLOCK_SIZE];
+    int left[BLOCK_SIZE];
+    int right[BLOCK_SIZE];
+    int out[BLOCK_SIZE];
+
+    for (int op = 0; op < OP_COUNT; ++op) {
+        size_t next = 0;
+        while (next < batch->count) {
+            /* gather the next block of expressions with this operator */
+            size_t found = 0;
+            for (; next < batch->count && found < BLOCK_SIZE; ++next) {
+                if (op_code_to_index(batch->op_codes[next]) == op) {
+                    indices[found] = next;
+                    left[found] = batch->left_operands[next];
+                    right[found] = batch->right_operands[next];
+                    ++found;
+                }
+            }
+
+            kernels[op](left, right, out, found);
+
+            for (size_t i = 0; i < found; ++i)
+                results[indices[i]] = out[i];
+        }
+    }
+}
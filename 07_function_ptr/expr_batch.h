@@ -0,0 +1,29 @@
+/* Evaluating many simple arithmetical expressions at once. */
+
+#ifndef EXPR_BATCH_H
+#define EXPR_BATCH_H
+
+#include <stddef.h>
+
+/* An expr_batch_t holds count expressions, like count expression_t structs,
+   but stored as a STRUCTURE OF ARRAYS: all the left operands together, all the
+   right operands together, and all the operators together.
+
+   Operators are stored as the symbols * / + - that math_symbol_to_func takes.
+   As in math_symbol_to_func, any other symbol means +.
+*/
+typedef struct {
+    int const * left_operands;
+    int const * right_operands;
+    char const * op_codes;
+    size_t count;
+} expr_batch_t;
+
+/* Evaluates every expression in batch, and stores the result of expression i
+   in results[i]. Gives the same results as calling eval_expression on each
+   one. As with eval_expression, dividing by zero or INT_MIN / -1 is
+   undefined.
+*/
+void eval_expression_batch(expr_batch_t const * batch, int* results);
+
+#endif /* EXPR_BATCH_H */
@@ -0,0 +1,586 @@
+#include "expr_compiler.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compiling happens in four steps, like a (very) small C compiler:
+
+   1. PARSE the text into an ABSTRACT SYNTAX TREE (AST). "(x + 2) * -y" becomes
+
+            *
+           / \
+          +   -
+         / \   \
+        x   2   y
+
+   2. CONSTANT FOLD: any part of the tree that only involves numbers, like
+      "2 * 3", is worked out once now instead of on every evaluation.
+
+   3. GENERATE BYTECODE for a REGISTER MACHINE. Each instruction reads two
+      registers and writes a third, e.g. "r4 = r0 + r2". Variables and
+      constants get registers of their own, so no instruction ever needs to
+      load anything.
+
+   4. EVALUATE the bytecode as often as needed, see run_program.
+*/
+
+#define MAX_REGISTERS 256
+
+/* Parsing, constant folding and code generation all call themselves once
+   for each level of the tree, or of parentheses. Something like "------x"
+   a million chars long would run out of stack, so deeper expressions are
+   refused. */
+#define MAX_DEPTH 1000
+
+typedef enum {
+    NODE_NUMBER,
+    NODE_VARIABLE,
+    NODE_NEGATE,
+    NODE_BINARY
+} node_kind_t;
+
+typedef struct node {
+    node_kind_t kind;
+    char op;          /* NODE_BINARY: one of + - * / */
+    int value;        /* NODE_NUMBER: the number, NODE_VARIABLE: its index */
+    int reg;          /* register holding the value, once assigned */
+    int depth;        /* levels of nodes from this one down, at least 1 */
+    struct node* left;  /* NODE_NEGATE only uses left */
+    struct node* right;
+} node_t;
+
+typedef enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MULT,
+    OP_DIV,
+    OP_NEGATE,
+    OP_RETURN
+} opcode_t;
+
+typedef struct {
+    unsigned char op;
+    unsigned char dst;
+    unsigned char a;
+    unsigned char b;
+} instruction_t;
+
+/* Registers are numbered:
+   [0, var_count)                         the variables
+   [var_count, var_count + const_count)   the constants
+   the rest                               temporary results
+*/
+struct expr_program {
+    int var_count;
+    int const_count;
+    int register_count;
+    int constants[MAX_REGISTERS];
+    size_t code_size;
+    instruction_t code[];
+};
+
+/* Arithmetic is done on unsigned ints, which wrap around instead of
+   overflowing. gcc converts the result back to int by wrapping as well. */
+
+static int wrap_add(int x, int y) {
+    return (int)((unsigned)x + (unsigned)y);
+}
+
+static int wrap_sub(int x, int y) {
+    return (int)((unsigned)x - (unsigned)y);
+}
+
+static int wrap_mult(int x, int y) {
+    return (int)((unsigned)x * (unsigned)y);
+}
+
+static int wrap_negate(int x) {
+    return (int)(0u - (unsigned)x);
+}
+
+/* ---------- 1. parsing ---------- */
+
+typedef struct {
+    char const * source;
+    char const * pos;
+    char const * const * var_names;
+    int var_count;
+
+    /* Every node uses up at least one char of the source, so a source of n
+       chars never needs more than n nodes. */
+    node_t* nodes;
+    size_t node_count;
+
+    int open_parens;  /* how many '(' we are inside of */
+
+    char* error;
+    size_t error_size;
+    int failed;
+} parser_t;
+
+static void fail(parser_t* parser, char const * where, char const * format, ...) {
+    if (parser->failed)
+        return;
+    parser->failed = 1;
+
+    char message[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (parser->error_size > 0) {
+        snprintf(parser->error, parser->error_size, "column %d: %s",
+                 (int)(where - parser->source) + 1, message);
+    }
+}
+
+static node_t* new_node(parser_t* parser, node_kind_t kind) {
+    node_t* node = &parser->nodes[parser->node_count++];
+    memset(node, 0, sizeof(*node));
+    node->kind = kind;
+    node->depth = 1;
+    return node;
+}
+
+/* Makes node an operator over left and right (NULL for unary minus).
+   Returns 0 if the tree gets too deep. */
+static int set_operands(parser_t* parser, node_t* node, node_t* left,
+                        node_t* right, char const * where) {
+    node->left = left;
+    node->right = right;
+    node->depth = left->depth + 1;
+    if (right != NULL && right->depth >= left->depth)
+        node->depth = right->depth + 1;
+    if (node->depth > MAX_DEPTH) {
+        fail(parser, where, "expression is nested too deeply");
+        return 0;
+    }
+    return 1;
+}
+
+static void skip_space(parser_t* parser) {
+    while (isspace((unsigned char)*parser->pos))
+        ++parser->pos;
+}
+
+static int is_name_char(char ch) {
+    return isalnum((unsigned char)ch) || ch == '_';
+}
+
+static node_t* parse_sum(parser_t* parser);
+
+static node_t* parse_number(parser_t* parser) {
+    char const * start = parser->pos;
+    long value = 0;
+    for (; isdigit((unsigned char)*parser->pos); ++parser->pos) {
+        value = value * 10 + (*parser->pos - '0');
+        if (value > INT_MAX) {
+            fail(parser, start, "number is too large");
+            return NULL;
+        }
+    }
+
+    node_t* node = new_node(parser, NODE_NUMBER);
+    node->value = (int)value;
+    return node;
+}
+
+static node_t* parse_variable(parser_t* parser) {
+    char const * start = parser->pos;
+    while (is_name_char(*parser->pos))
+        ++parser->pos;
+    size_t length = parser->pos - start;
+
+    for (int i = 0; i < parser->var_count; ++i) {
+        if (strlen(parser->var_names[i]) == length &&
+            strncmp(parser->var_names[i], start, length) == 0) {
+            node_t* node = new_node(parser, NODE_VARIABLE);
+            node->value = i;
+            return node;
+        }
+    }
+
+    fail(parser, start, "unknown variable '%.*s'", (int)length, start);
+    return NULL;
+}
+
+/* primary: number | variable | '(' sum ')' */
+static node_t* parse_primary(parser_t* parser) {
+    skip_space(parser);
+    char ch = *parser->pos;
+
+    if (isdigit((unsigned char)ch))
+        return parse_number(parser);
+    if (is_name_char(ch))
+        return parse_variable(parser);
+
+    if (ch == '(') {
+        char const * open = parser->pos++;
+        if (++parser->open_parens > MAX_DEPTH) {
+            fail(parser, open, "expression is nested too deeply");
+            return NULL;
+        }
+        node_t* node = parse_sum(parser);
+        --parser->open_parens;
+        if (node == NULL)
+            return NULL;
+        skip_space(parser);
+        if (*parser->pos != ')') {
+            fail(parser, open, "'(' is never closed");
+            return NULL;
+        }
+        ++parser->pos;
+        return node;
+    }
+
+    if (ch == '\0')
+        fail(parser, parser->pos, "unexpected end of expression");
+    else
+        fail(parser, parser->pos, "expected a number, variable or '(', "
+             "found '%c'", ch);
+    return NULL;
+}
+
+/* unary: '-' unary | '+' unary | primary
+
+   The signs are counted in a loop rather than by parse_unary calling
+   itself, so a long run of them can't overflow the stack. */
+static node_t* parse_unary(parser_t* parser) {
+    char const * start = parser->pos;
+    long minus_count = 0;
+    for (;;) {
+        skip_space(parser);
+        if (*parser->pos == '-')
+            ++minus_count;
+        else if (*parser->pos != '+')
+            break;
+        ++parser->pos;
+    }
+
+    node_t* node = parse_primary(parser);
+    for (; node != NULL && minus_count > 0; --minus_count) {
+        node_t* negate = new_node(parser, NODE_NEGATE);
+        if (!set_operands(parser, negate, node, NULL, start))
+            return NULL;
+        node = negate;
+    }
+    return node;
+}
+
+/* Parses a chain of operands separated by the operators in ops, such as
+   "a * b / c", into a left leaning tree: ((a * b) / c). */
+static node_t* parse_chain(parser_t* parser, char const * ops,
+                           node_t* (*parse_operand)(parser_t*)) {
+    node_t* left = parse_operand(parser);
+    for (;;) {
+        if (left == NULL)
+            return NULL;
+        skip_space(parser);
+        char op = *parser->pos;
+        if (op == '\0' || strchr(ops, op) == NULL)
+            return left;
+        char const * op_pos = parser->pos++;
+
+        node_t* right = parse_operand(parser);
+        if (right == NULL)
+            return NULL;
+        node_t* node = new_node(parser, NODE_BINARY);
+        node->op = op;
+        if (!set_operands(parser, node, left, right, op_pos))
+            return NULL;
+        left = node;
+    }
+}
+
+/* product: unary (('*' | '/') unary)* */
+static node_t* parse_product(parser_t* parser) {
+    return parse_chain(parser, "*/", parse_unary);
+}
+
+/* sum: product (('+' | '-') product)* */
+static node_t* parse_sum(parser_t* parser) {
+    return parse_chain(parser, "+-", parse_product);
+}
+
+/* ---------- 2. constant folding ---------- */
+
+static void fold_constants(node_t* node) {
+    if (node->kind == NODE_NEGATE) {
+        fold_constants(node->left);
+        if (node->left->kind == NODE_NUMBER) {
+            node->kind = NODE_NUMBER;
+            node->value = wrap_negate(node->left->value);
+        }
+    } else if (node->kind == NODE_BINARY) {
+        fold_constants(node->left);
+        fold_constants(node->right);
+        if (node->left->kind != NODE_NUMBER || node->right->kind != NODE_NUMBER)
+            return;
+
+        int x = node->left->value;
+        int y = node->right->value;
+        switch (node->op) {
+            case '+':
+                node->value = wrap_add(x, y);
+                break;
+            case '-':
+                node->value = wrap_sub(x, y);
+                break;
+            case '*':
+                node->value = wrap_mult(x, y);
+                break;
+            case '/':
+                /* leave undefined divisions for run time, as C does */
+                if (y == 0 || (x == INT_MIN && y == -1))
+                    return;
+                node->value = x / y;
+                break;
+        }
+        node->kind = NODE_NUMBER;
+    }
+}
+
+/* ---------- 3. code generation ---------- */
+
+typedef struct {
+    expr_program_t* program;
+    int next_temp;
+    int failed;
+} codegen_t;
+
+/* Returns 0 if there were too many constants to give each a register. */
+static int assign_constant_registers(expr_program_t* program, node_t* node) {
+    if (node->kind == NODE_NUMBER) {
+        /* reuse the register of an equal constant */
+        for (int i = 0; i < program->const_count; ++i) {
+            if (program->constants[i] == node->value) {
+                node->reg = program->var_count + i;
+                return 1;
+            }
+        }
+        node->reg = program->var_count + program->const_count;
+        if (node->reg >= MAX_REGISTERS)
+            return 0;
+        program->constants[program->const_count++] = node->value;
+        return 1;
+    }
+
+    if (node->kind == NODE_VARIABLE) {
+        node->reg = node->value;
+        return 1;
+    }
+
+    if (!assign_constant_registers(program, node->left))
+        return 0;
+    return node->right == NULL ||
+           assign_constant_registers(program, node->right);
+}
+
+static void emit(codegen_t* gen, opcode_t op, int dst, int a, int b) {
+    instruction_t* instruction = &gen->program->code[gen->program->code_size++];
+    instruction->op = op;
+    instruction->dst = dst;
+    instruction->a = a;
+    instruction->b = b;
+}
+
+/* Returns the register that will hold node's value.
+
+   Temporary registers are handed out like a stack. Once an instruction has
+   read its operands, their temporaries are free again, so the result can go
+   in the first of them.
+*/
+static int generate(codegen_t* gen, node_t* node) {
+    if (node->kind == NODE_NUMBER || node->kind == NODE_VARIABLE)
+        return node->reg;
+
+    int first_temp = gen->next_temp;
+    int a = generate(gen, node->left);
+    int b = node->kind == NODE_BINARY ? generate(gen, node->right) : 0;
+    gen->next_temp = first_temp;
+
+    int dst = gen->next_temp++;
+    if (gen->next_temp > gen->program->register_count)
+        gen->program->register_count = gen->next_temp;
+    if (dst >= MAX_REGISTERS) {
+        gen->failed = 1;
+        return 0;
+    }
+
+    if (node->kind == NODE_NEGATE) {
+        emit(gen, OP_NEGATE, dst, a, 0);
+    } else {
+        switch (node->op) {
+            case '+':
+                emit(gen, OP_ADD, dst, a, b);
+                break;
+            case '-':
+                emit(gen, OP_SUB, dst, a, b);
+                break;
+            case '*':
+                emit(gen, OP_MULT, dst, a, b);
+                break;
+            case '/':
+                emit(gen, OP_DIV, dst, a, b);
+                break;
+        }
+    }
+    return dst;
+}
+
+expr_program_t* expr_compile(char const * source,
+                             char const * const * var_names, int var_count,
+                             char* error, size_t error_size) {
+    size_t length = strlen(source);
+    parser_t parser = {source, source, var_names, var_count};
+    parser.error = error;
+    parser.error_size = error_size;
+
+    if (var_count > MAX_REGISTERS / 2) {
+        fail(&parser, source, "too many variables");
+        return NULL;
+    }
+
+    parser.nodes = (node_t*)malloc((length + 1) * sizeof(node_t));
+    /* at most one instruction per node, plus the return */
+    expr_program_t* program = (expr_program_t*)calloc(
+        1, sizeof(expr_program_t) + (length + 1) * sizeof(instruction_t));
+    if (parser.nodes == NULL || program == NULL) {
+        fail(&parser, source, "out of memory");
+        free(parser.nodes);
+        free(program);
+        return NULL;
+    }
+
+    node_t* root = parse_sum(&parser);
+    skip_space(&parser);
+    if (root != NULL && *parser.pos != '\0')
+        fail(&parser, parser.pos, "unexpected '%c'", *parser.pos);
+
+    if (!parser.failed) {
+        fold_constants(root);
+
+        program->var_count = var_count;
+        codegen_t gen = {program};
+        gen.failed = !assign_constant_registers(program, root);
+
+        gen.next_temp = var_count + program->const_count;
+        program->register_count = gen.next_temp;
+        if (!gen.failed) {
+            int result = generate(&gen, root);
+            emit(&gen, OP_RETURN, 0, result, 0);
+        }
+
+        if (gen.failed)
+            fail(&parser, source, "expression is too complicated");
+    }
+
+    free(parser.nodes);
+    if (parser.failed) {
+        free(program);
+        return NULL;
+    }
+    return program;
+}
+
+void expr_program_free(expr_program_t* program) {
+    free(program);
+}
+
+/* ---------- 4. evaluation ---------- */
+
+/* The usual way to run bytecode is a loop around a switch statement. Every
+   instruction then jumps back to the top of the loop, and from there through
+   one shared indirect jump, which the processor has a hard time predicting.
+
+   GNU C lets us take the address of a label with && and jump to it with
+   goto *. This is called a COMPUTED GOTO. Each instruction's code ends with its
+   own jump to the next instruction's code (THREADED DISPATCH). The processor
+   can then learn patterns like "an add is usually followed by a multiply".
+*/
+
+static int run_program(instruction_t const * ip, int* regs) {
+    static void* const dispatch[] = {
+        [OP_ADD] = &&do_add,
+        [OP_SUB] = &&do_sub,
+        [OP_MULT] = &&do_mult,
+        [OP_DIV] = &&do_div,
+        [OP_NEGATE] = &&do_negate,
+        [OP_RETURN] = &&do_return
+    };
+
+#define NEXT_INSTRUCTION goto *dispatch[(++ip)->op]
+
+    goto *dispatch[ip->op];
+
+do_add:
+    regs[ip->dst] = wrap_add(regs[ip->a], regs[ip->b]);
+    NEXT_INSTRUCTION;
+do_sub:
+    regs[ip->dst] = wrap_sub(regs[ip->a], regs[ip->b]);
+    NEXT_INSTRUCTION;
+do_mult:
+    regs[ip->dst] = wrap_mult(regs[ip->a], regs[ip->b]);
+    NEXT_INSTRUCTION;
+do_div:
+    regs[ip->dst] = regs[ip->a] / regs[ip->b];
+    NEXT_INSTRUCTION;
+do_negate:
+    regs[ip->dst] = wrap_negate(regs[ip->a]);
+    NEXT_INSTRUCTION;
+do_return:
+    return regs[ip->a];
+
+#undef NEXT_INSTRUCTION
+}
+
+int expr_program_eval(expr_program_t const * program, int const * vars) {
+    int regs[MAX_REGISTERS];
+    memcpy(regs, vars, program->var_count * sizeof(int));
+    memcpy(regs + program->var_count, program->constants,
+           program->const_count * sizeof(int));
+    return run_program(program->code, regs);
+}
+
+void expr_program_eval_many(expr_program_t const * program, int const * vars,
+                            size_t row_count, int* results) {
+    int regs[MAX_REGISTERS];
+    int var_count = program->var_count;
+
+    /* the constants never change, so only copy them once */
+    memcpy(regs + var_count, program->constants,
+           program->const_count * sizeof(int));
+
+    for (size_t row = 0; row < row_count; ++row, vars += var_count) {
+        memcpy(regs, vars, var_count * sizeof(int));
+        results[row] = run_program(program->code, regs);
+    }
+}
+
+void expr_program_print(expr_program_t const * program, FILE* out) {
+    for (int i = 0; i < program->const_count; ++i) {
+        fprintf(out, "r%d = %d\n", program->var_count + i,
+                program->constants[i]);
+    }
+
+    static char const symbols[] = "+-*/";
+    for (size_t i = 0; i < program->code_size; ++i) {
+        instruction_t const * ins = &program->code[i];
+        switch (ins->op) {
+            case OP_NEGATE:
+                fprintf(out, "r%d = -r%d\n", ins->dst, ins->a);
+                break;
+            case OP_RETURN:
+                fprintf(out, "return r%d\n", ins->a);
+                break;
+            default:
+                fprintf(out, "r%d = r%d %c r%d\n", ins->dst, ins->a,
+                        symbols[ins->op], ins->b);
+                break;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/* Compiling whole arithmetical expressions, such as "(x + 2) * -y", once, and
+   evaluating them many times. */
+
+#ifndef EXPR_COMPILER_H
+#define EXPR_COMPILER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* A compiled expression. Opaque: only expr_compiler.c knows what is inside. */
+typedef struct expr_program expr_program_t;
+
+/* Compiles source, which may contain:
+
+   - decimal numbers
+   - the variables named in var_names, which are made of letters, digits and _
+   - the operators + - * / and unary -
+   - parentheses
+
+   * and / bind tighter than + and -, and operators of the same kind go left
+   to right, as in C.
+
+   Expressions more than 1000 levels deep, counting each operator and each
+   pair of parentheses as a level, are refused.
+
+   On success returns a program, which must be freed with expr_program_free.
+   On failure returns NULL and writes a message, including the column of the
+   problem, to error (which has room for error_size chars).
+*/
+expr_program_t* expr_compile(char const * source,
+                             char const * const * var_names, int var_count,
+                             char* error, size_t error_size);
+
+void expr_program_free(expr_program_t* program);
+
+/* Evaluates the program. vars[i] is the value of var_names[i].
+
+   Arithmetic wraps around on overflow, like unsigned arithmetic does. Dividing
+   by zero, or INT_MIN by -1, is undefined, just like in C.
+*/
+int expr_program_eval(expr_program_t const * program, int const * vars);
+
+/* Evaluates the program once for each of row_count sets of variables.
+   vars holds the rows one after another, var_count ints per row, and the
+   result for row i is stored in results[i].
+*/
+void expr_program_eval_many(expr_program_t const * program, int const * vars,
+                            size_t row_count, int* results);
+
+/* Prints the bytecode, one instruction per line. */
+void expr_program_print(expr_program_t const * program, FILE* out);
+
+#endif /* EXPR_COMPILER_H */
@@ -0,0 +1,273 @@
+#include "expr_reader.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Why is scanf slow?
+
+   Every call has to parse the format string "%d %c %d" again, check the
+   locale, and lock the FILE. For short lines this overhead costs far more
+   than the actual work.
+
+   expr_reader_t instead read()s BLOCK_SIZE bytes at a time into its own
+   buffer, and parses each complete line straight out of the buffer. A line
+   that is cut in half by the end of a block is moved to the front of the
+   buffer, and the rest of it is read in behind it.
+
+   The buffer has PADDING extra bytes at the end, so the number parser can
+   always load 8 bytes at once without reading past the buffer.
+*/
+
+#define BLOCK_SIZE (1024 * 1024)
+#define PADDING 8
+
+struct expr_reader {
+    int fd;
+    int at_end;
+    int skipping_line; /* in the middle of a line that was too long */
+    expr_reader_error_func on_error;
+    void* context;
+    size_t error_count;
+    size_t line;
+
+    char* data;    /* unparsed input is [data, limit) */
+    char* limit;
+    char buffer[];
+};
+
+expr_reader_t* expr_reader_create(int fd, expr_reader_error_func on_error,
+                                  void* context) {
+    expr_reader_t* reader = (expr_reader_t*)malloc(sizeof(expr_reader_t) +
+                                                   BLOCK_SIZE + PADDING);
+    if (reader == NULL)
+        return NULL;
+    reader->fd = fd;
+    reader->at_end = 0;
+    reader->skipping_line = 0;
+    reader->on_error = on_error;
+    reader->context = context;
+    reader->error_count = 0;
+    reader->line = 0;
+    reader->data = reader->buffer;
+    reader->limit = reader->buffer;
+    return reader;
+}
+
+void expr_reader_free(expr_reader_t* reader) {
+    free(reader);
+}
+
+size_t expr_reader_error_count(expr_reader_t const * reader) {
+    return reader->error_count;
+}
+
+static void report_error(expr_reader_t* reader, size_t column,
+                         char const * message) {
+    ++reader->error_count;
+    if (reader->on_error)
+        reader->on_error(reader->line, column, message, reader->context);
+}
+
+/* Moves the unparsed input to the front of the buffer, and fills the rest.
+   Returns 0 if nothing new could be read. */
+static int refill(expr_reader_t* reader) {
+    size_t left_over = reader->limit - reader->data;
+    memmove(reader->buffer, reader->data, left_over);
+    reader->data = reader->buffer;
+    reader->limit = reader->buffer + left_over;
+
+    while (!reader->at_end && reader->limit < reader->buffer + BLOCK_SIZE) {
+        ssize_t count = read(reader->fd, reader->limit,
+                             reader->buffer + BLOCK_SIZE - reader->limit);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            reader->at_end = 1;
+            break;
+        }
+        reader->limit += count;
+        /* parse what we have rather than wait on a slow pipe */
+        break;
+    }
+
+    memset(reader->limit, 0, PADDING);
+    return reader->limit != reader->buffer + left_over;
+}
+
+/* SWAR number parsing: 8 digits at a time in one 64 bit integer.
+
+   x holds 8 chars, the first in the lowest byte. After x ^ 0x30 in every
+   byte, digits become their values 0 to 9. Any byte that is not a digit
+   either has a bit set in its high nibble, or becomes >= 16 after adding 6.
+   The lowest such byte marks the end of the digits.
+*/
+
+#define REPEAT_BYTE(b) (0x0101010101010101ULL * (b))
+
+static size_t count_digits(uint64_t x) {
+    uint64_t values = x ^ REPEAT_BYTE(0x30);
+    uint64_t not_digit = (values | (values + REPEAT_BYTE(0x06))) &
+                         REPEAT_BYTE(0xf0);
+    return not_digit ? __builtin_ctzll(not_digit) / 8 : 8;
+}
+
+/* Converts the first count (1 to 8) digit chars in x to a number.
+
+   Shifting the digits to the top of the word puts zeros in front of them.
+   Then three multiplies combine pairs of digits, pairs of pairs, and so on.
+*/
+static uint32_t convert_digits(uint64_t x, size_t count) {
+    x = (x ^ REPEAT_BYTE(0x30)) << (8 * (8 - count));
+    x = (x * 10) + (x >> 8);
+    x = (((x & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+         (((x >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+    return (uint32_t)x;
+}
+
+static uint64_t load_8_chars(char const * p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static int64_t const powers_of_ten[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+/* Parses an optionally signed int at *pos. Returns an error message, or NULL
+   on success. */
+static char const * parse_int(char const ** pos, int* result) {
+    char const * p = *pos;
+    int negative = 0;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        ++p;
+    }
+
+    size_t count = count_digits(load_8_chars(p));
+    if (count == 0)
+        return "expected a number";
+
+    int64_t value = 0;
+    for (;;) {
+        value = value * powers_of_ten[count] +
+                convert_digits(load_8_chars(p), count);
+        p += count;
+        if (value > (int64_t)INT_MAX + 1)
+            return "number is out of range";
+        if (count < 8)
+            break;
+        count = count_digits(load_8_chars(p));
+        if (count == 0)
+            break;
+    }
+
+    if (!negative && value > INT_MAX)
+        return "number is out of range";
+    *result = (int)(negative ? -value : value);
+    *pos = p;
+    return NULL;
+}
+
+static char const * skip_blanks(char const * p) {
+    while (*p == ' ' || *p == '\t')
+        ++p;
+    return p;
+}
+
+static int is_operator(char ch) {
+    return ch == '*' || ch == '/' || ch == '+' || ch == '-';
+}
+
+/* Parses one line that ends at line_end (the '\n', or the end of input).
+   Returns an error message, or NULL on success. *where is set to the
+   problem. */
+static char const * parse_line(char const * p, char const * line_end,
+                               int* left, char* op_code, int* right,
+                               char const ** where) {
+    char const * message;
+
+    p = skip_blanks(p);
+    *where = p;
+    if ((message = parse_int(&p, left)) != NULL)
+        return message;
+
+    p = skip_blanks(p);
+    *where = p;
+    if (p == line_end || !is_operator(*p))
+        return "expected one of * / + -";
+    *op_code = *p++;
+
+    p = skip_blanks(p);
+    *where = p;
+    if ((message = parse_int(&p, right)) != NULL)
+        return message;
+
+    p = skip_blanks(p);
+    if (p != line_end && *p == '\r')
+        ++p;
+    *where = p;
+    if (p != line_end)
+        return "unexpected text after expression";
+    return NULL;
+}
+
+size_t expr_reader_next_batch(expr_reader_t* reader, int* left_operands,
+                              int* right_operands, char* op_codes,
+                              size_t capacity) {
+    size_t count = 0;
+
+    while (count < capacity) {
+        char* line_end = (char*)memchr(reader->data, '\n',
+                                       reader->limit - reader->data);
+        if (line_end == NULL) {
+            if (refill(reader))
+                continue;
+            if (reader->data == reader->limit)
+                break;
+            if (!reader->at_end) {
+                /* the buffer is full, and still holds no whole line */
+                if (!reader->skipping_line) {
+                    ++reader->line;
+                    report_error(reader, 1, "line is too long");
+                    reader->skipping_line = 1;
+                }
+                reader->data = reader->limit;
+                continue;
+            }
+            /* the last line has no '\n' */
+            line_end = reader->limit;
+        }
+
+        char const * line_begin = reader->data;
+        reader->data = line_end == reader->limit ? line_end : line_end + 1;
+
+        /* the end of a line that was too long */
+        if (reader->skipping_line) {
+            reader->skipping_line = 0;
+            continue;
+        }
+
+        ++reader->line;
+        char const * blank_end = skip_blanks(line_begin);
+        if (blank_end == line_end || (*blank_end == '\r' &&
+                                      blank_end + 1 == line_end))
+            continue;
+
+        char const * where;
+        char const * message = parse_line(line_begin, line_end,
+                                          &left_operands[count],
+                                          &op_codes[count],
+                                          &right_operands[count], &where);
+        if (message == NULL)
+            ++count;
+        else
+            report_error(reader, where - line_begin + 1, message);
+    }
+
+    return count;
+}
@@ -0,0 +1,44 @@
+/* Reading large numbers of NUMBER OPERATOR NUMBER expressions quickly. */
+
+#ifndef EXPR_READER_H
+#define EXPR_READER_H
+
+#include <stddef.h>
+
+/* An expr_reader_t reads expressions, one per line, from a file descriptor.
+   It reads the input in big blocks, and parses the text itself instead of
+   calling scanf for every expression. Opaque, see expr_reader.c.
+
+   Each line must look like
+
+       NUMBER OPERATOR NUMBER
+
+   where the numbers are ints, optionally signed, and the operator is one of
+   * / + -. Spaces and tabs between them are optional. Empty lines are
+   skipped.
+*/
+typedef struct expr_reader expr_reader_t;
+
+/* Called for every bad line. line and column count from 1. The bad line is
+   skipped, and reading carries on with the next one. */
+typedef void (*expr_reader_error_func)(size_t line, size_t column,
+                                       char const * message, void* context);
+
+/* Returns NULL if out of memory. The reader does not close fd.
+   on_error may be NULL to silently skip bad lines. */
+expr_reader_t* expr_reader_create(int fd, expr_reader_error_func on_error,
+                                  void* context);
+void expr_reader_free(expr_reader_t* reader);
+
+/* Reads up to capacity expressions into the three arrays, which can then be
+   passed to eval_expression_batch as an expr_batch_t. Returns how many were
+   read. Returns 0 only at the end of the input, or if reading failed.
+*/
+size_t expr_reader_next_batch(expr_reader_t* reader, int* left_operands,
+                              int* right_operands, char* op_codes,
+                              size_t capacity);
+
+/* The number of bad lines skipped so far. */
+size_t expr_reader_error_count(expr_reader_t const * reader);
+
+#endif /* EXPR_READER_H */
@@ -0,0 +1,54 @@
+#include "expression.h"
+
+#include <stdio.h>
+
+int mult(int x, int y) {
+    return x * y;
+}
+
+int div(int x, int y) {
+    return x / y;
+}
+
+int add(int x, int y) {
+    return x + y;
+}
+
+int sub(int x, int y) {
+    return x - y;
+}
+
+int eval_expression(expression_t exp) {
+    return exp.operator(exp.left_operand, exp.right_operand);
+}
+
+operation_ptr math_symbol_to_func(char op_code) {
+    switch(op_code) {
+        case '*':
+            return mult;
+        case '/':
+            return div;
+        case '+':
+            return add;
+        case '-':
+            return  sub;
+        default:
+            return add;
+    }
+}
+
+expression_t read_expression() {
+    /* Set defaults in case scanf fails */
+    expression_t exp = {0, 0, add};
+    char op_code = '*';
+    while(scanf("%d %c %d",
+                &exp.left_operand, &op_code, &exp.right_operand) != 3) {
+        /* This is really limited error checking. Just checks that 3 items
+           matched */
+        puts("Bad input. Must be of format NUMBER OPERATOR NUMBER");
+    }
+
+    exp.operator = math_symbol_to_func(op_code);
+    
+    return exp;
+}
@@ -0,0 +1,32 @@
+/* NUMBER OPERATOR NUMBER expressions, stored as two ints and a pointer to the
+   function that does the operation. From function_ptr.c, in their own file
+   so the benchmarks in bench/ can use them too. */
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+/* Note this div clashes with the one in stdlib.h, so files that include this
+   header can't include stdlib.h. */
+int mult(int x, int y);
+int div(int x, int y);
+int add(int x, int y);
+int sub(int x, int y);
+
+typedef int (*operation_ptr)(int, int);
+
+typedef struct {
+    int left_operand;
+    int right_operand;
+    operation_ptr operator;
+} expression_t;
+
+int eval_expression(expression_t exp);
+
+/* Maps the symbols * / + - to mult, div, add and sub. Anything else is add. */
+operation_ptr math_symbol_to_func(char op_code);
+
+/* Reads an expression from stdin with scanf, asking again until one is
+   well formed. */
+expression_t read_expression();
+
+#endif /* EXPRESSION_H */
@@ -16,7 +16,30 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "char_class.h"
+#include "expr_batch.h"
+#include "expr_compiler.h"
+#include "expr_reader.h"
+#include "expression.h"
+#include "higher_order.h"
+#include "parallel.h"
+#include "stream.h"
+#include "transforms.h"
+
+#include "../instrument/instrument.h"
+
+/* Several parts of this lesson check fast code against simple code that
+   does the same thing. Each failed check is counted here, and the program
+   exits with an error if there were any. */
+int failed_checks = 0;
 
 void some_function() {
     puts("some_function() called");
@@ -55,86 +78,41 @@ void put_a_function_in_a_variable() {
    equation in a struct.
 */
 
-int mult(int x, int y) {
-    return x * y;
-}
-
-int div(int x, int y) {
-    return x / y;
-}
-
-int add(int x, int y) {
-    return x + y;
-}
-
-int sub(int x, int y) {
-    return x - y;
-}
+/* The code for this example is in expression.h and expression.c, where the
+   benchmarks can use it too. Open them next to this file.
 
+   expression.c starts with four functions that take two ints and return an
+   int: mult, div, add and sub.
+*/
 
 /* wasn't the syntax for declaring function pointer variables a little
    awkward? The way to make weird looking types more readable in c and c++
    is the typedef.
    
    We can give "pointer to function that takes two ints and returns an int"
-   another name.
+   another name. expression.h calls it operation_ptr.
 */
 
-typedef int (*operation_ptr)(int, int);
-
 /* Now we can define a struct that has all the information we need about a
-   simple arithmetical expression.
+   simple arithmetical expression: expression_t in expression.h holds a left
+   operand, a right operand, and an operation_ptr called operator.
 
    This struct is fairly small, so we will just pass it around by value.
 */
 
-typedef struct {
-    int left_operand;
-    int right_operand;
-    operation_ptr operator;
-} expression_t;
-
-/* and a function that given an expression, can evaluate it.
-   Note it is const, because we don't modify exp.*/
-int eval_expression(expression_t exp) {
-    return exp.operator(exp.left_operand, exp.right_operand);
-}
-
-/* a function to map mathematical symbols * / + - to functions */
-operation_ptr math_symbol_to_func(char op_code) {
-    switch(op_code) {
-        case '*':
-            return mult;
-        case '/':
-            return div;
-        case '+':
-            return add;
-        case '-':
-            return  sub;
-        default:
-            return add;
-    }
-}
-
+/* expression.c then has:
 
-/* and a function that reads an expression from the user.
-*/
+   eval_expression, which given an expression, evaluates it by calling its
+   operator on its two operands. It takes the expression by value, because
+   it doesn't modify it.
 
-expression_t read_expression() {
-    /* Set defaults in case scanf fails */
-    expression_t exp = {0, 0, add};
-    char op_code = '*';
-    while(scanf("%d %c %d",
-                &exp.left_operand, &op_code, &exp.right_operand) != 3) {
-        /* This is really limited error checking. Just checks that 3 items
-           matched */
-        puts("Bad input. Must be of format NUMBER OPERATOR NUMBER");
-    }
+   math_symbol_to_func, which maps the mathematical symbols * / + - to those
+   functions, with a switch.
 
-    exp.operator = math_symbol_to_func(op_code);
-    
-    return exp;
-}
+   read_expression, which reads an expression from the user. It sets
+   defaults in case scanf fails, and its error checking is really limited:
+   it just checks that 3 items matched.
+*/
 
 
 void use_expressions() {
@@ -149,6 +127,506 @@ void use_expressions() {
 }
 
 
+/* Calling eval_expression on millions of expressions means millions of
+   indirect calls. expr_batch.h has eval_expression_batch, which evaluates a
+   whole array of expressions at once, grouped by operator.
+
+   It stores expressions as separate arrays of left operands, right operands
+   and operator symbols. eval_expression is the reference it must agree with.
+*/
+
+#define BATCH_SIZE 10000
+
+void using_expression_batches() {
+    puts(__func__);
+
+    static int lefts[BATCH_SIZE];
+    static int rights[BATCH_SIZE];
+    static char op_codes[BATCH_SIZE];
+    static int results[BATCH_SIZE];
+    char const symbols[] = "*/+-";
+
+    /* a simple pseudo random number generator, so the expressions are mixed */
+    unsigned random = 12345;
+    for (int i = 0; i < BATCH_SIZE; ++i) {
+        random = random * 1103515245 + 12345;
+        lefts[i] = (int)(random >> 12) - (1 << 19);
+        random = random * 1103515245 + 12345;
+        rights[i] = (int)(random >> 20) - 2048;
+        if (rights[i] == 0)
+            rights[i] = 1;
+        op_codes[i] = symbols[(random >> 4) % 4];
+    }
+
+    expr_batch_t batch = {lefts, rights, op_codes, BATCH_SIZE};
+    eval_expression_batch(&batch, results);
+
+    int mismatches = 0;
+    for (int i = 0; i < BATCH_SIZE; ++i) {
+        expression_t exp = {lefts[i], rights[i],
+                            math_symbol_to_func(op_codes[i])};
+        if (eval_expression(exp) != results[i])
+            ++mismatches;
+    }
+    printf("%d expressions, %d mismatches\n", BATCH_SIZE, mismatches);
+    if (mismatches != 0)
+        ++failed_checks;
+}
+
+/* read_expression calls scanf once per expression, which is fine for a human
+   typing, but slow for files with millions of lines. expr_reader.h reads a
+   whole file in big blocks and parses the lines itself. It fills the arrays
+   of an expr_batch_t directly, and tells us the line and column of any bad
+   input.
+*/
+
+void print_reader_error(size_t line, size_t column, char const * message,
+                        void* context) {
+    printf("line %zu, column %zu: %s\n", line, column, message);
+}
+
+#define READ_BATCH_SIZE 4
+
+void using_expression_reader() {
+    puts(__func__);
+
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        puts("Could not create a temporary file");
+        return;
+    }
+    fputs("1 + 2\n"
+          "6 * 7\n"
+          "100 / 7\n"
+          "3 x 4\n"
+          "-5 - -8\n"
+          "2147483647 + 0\n", file);
+    fflush(file);
+    rewind(file);
+
+    expr_reader_t* reader = expr_reader_create(fileno(file),
+                                               print_reader_error, NULL);
+    if (reader != NULL) {
+        int lefts[READ_BATCH_SIZE];
+        int rights[READ_BATCH_SIZE];
+        char op_codes[READ_BATCH_SIZE];
+        int results[READ_BATCH_SIZE];
+        size_t count;
+
+        while ((count = expr_reader_next_batch(reader, lefts, rights, op_codes,
+                                               READ_BATCH_SIZE)) > 0) {
+            expr_batch_t batch = {lefts, rights, op_codes, count};
+            eval_expression_batch(&batch, results);
+            for (size_t i = 0; i < count; ++i)
+                printf("%d %c %d = %d\n", lefts[i], op_codes[i], rights[i],
+                       results[i]);
+        }
+        expr_reader_free(reader);
+    }
+
+    fclose(file);
+}
+
+/* The reader must read exactly what scanf reads. check_expr_reader writes a
+   few MB of random expressions, spread over several of the reader's blocks,
+   with every kind of spacing, signs, leading zeros, the biggest and smallest
+   ints, blank lines and "\r\n" line ends. Then it reads the same file with
+   fscanf("%d %c %d"), as read_expression does, and with the reader, and
+   compares them one by one.
+
+   scanf can't say where a bad line went wrong, so the errors are checked
+   separately, against lines where we know the line and column.
+*/
+
+#define CHECK_READER_LINES 200000
+
+/* Writes a number, in one of several ways that scanf and the reader both
+   accept. */
+void write_check_number(FILE* file, unsigned random) {
+    static int const special[] = {0, -1, 1, INT_MAX, INT_MIN, 99999999,
+                                  100000000, -123456789, 2000000000};
+    int value = (int)(random >> 3);
+    if (random % 4 == 0)
+        value = special[(random >> 2) % (sizeof(special) / sizeof(int))];
+    else if (random % 4 == 1)
+        value %= 1000;
+    switch ((random >> 12) % 4) {
+        case 0:
+            fprintf(file, "%+d", value);
+            break;
+        case 1:
+            fprintf(file, "%012d", value);
+            break;
+        default:
+            fprintf(file, "%d", value);
+    }
+}
+
+void write_check_blanks(FILE* file, unsigned random) {
+    char const * blanks[] = {"", "", " ", "  ", "\t", " \t "};
+    fputs(blanks[random % 6], file);
+}
+
+typedef struct {
+    size_t count;
+    size_t lines[8];
+    size_t columns[8];
+} reader_errors_t;
+
+void record_reader_error(size_t line, size_t column, char const * message,
+                         void* context) {
+    reader_errors_t* errors = (reader_errors_t*)context;
+    if (errors->count < 8) {
+        errors->lines[errors->count] = line;
+        errors->columns[errors->count] = column;
+    }
+    ++errors->count;
+}
+
+/* Reads all of file with a reader, CHECK_READER_BATCH expressions at a
+   time. Returns how many expressions were read, at most capacity. */
+#define CHECK_READER_BATCH 1000
+
+size_t read_all_expressions(FILE* file, int* lefts, int* rights,
+                            char* op_codes, size_t capacity,
+                            reader_errors_t* errors) {
+    expr_reader_t* reader = expr_reader_create(fileno(file),
+                                               record_reader_error, errors);
+    if (reader == NULL)
+        return 0;
+    size_t total = 0;
+    size_t count;
+    while (total + CHECK_READER_BATCH <= capacity &&
+           (count = expr_reader_next_batch(reader, lefts + total,
+                                           rights + total, op_codes + total,
+                                           CHECK_READER_BATCH)) > 0)
+        total += count;
+    expr_reader_free(reader);
+    return total;
+}
+
+void check_expr_reader() {
+    puts(__func__);
+    static int lefts[CHECK_READER_LINES + CHECK_READER_BATCH];
+    static int rights[CHECK_READER_LINES + CHECK_READER_BATCH];
+    static char op_codes[CHECK_READER_LINES + CHECK_READER_BATCH];
+    size_t capacity = CHECK_READER_LINES + CHECK_READER_BATCH;
+    int mismatches = 0;
+
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        puts("Could not create a temporary file");
+        ++failed_checks;
+        return;
+    }
+    unsigned random = 2024;
+    for (int line = 0; line < CHECK_READER_LINES; ++line) {
+        random = random * 1103515245 + 12345;
+        if (random % 50 == 0) {
+            write_check_blanks(file, random >> 8);
+        } else {
+            write_check_blanks(file, random >> 8);
+            write_check_number(file, random * 2654435761u);
+            write_check_blanks(file, random >> 11);
+            fputc("*/+-"[(random >> 14) % 4], file);
+            write_check_blanks(file, random >> 17);
+            write_check_number(file, random * 2246822519u);
+            write_check_blanks(file, random >> 20);
+        }
+        if (line + 1 < CHECK_READER_LINES)
+            fputs((random >> 24) % 8 == 0 ? "\r\n" : "\n", file);
+    }
+    fflush(file);
+
+    reader_errors_t errors = {0};
+    rewind(file);
+    size_t read = read_all_expressions(file, lefts, rights, op_codes,
+                                       capacity, &errors);
+    if (errors.count != 0)
+        ++mismatches;
+
+    rewind(file);
+    size_t scanned = 0;
+    int left;
+    char op_code;
+    int right;
+    while (fscanf(file, "%d %c %d", &left, &op_code, &right) == 3) {
+        if (scanned >= read || lefts[scanned] != left ||
+            op_codes[scanned] != op_code || rights[scanned] != right)
+            ++mismatches;
+        ++scanned;
+    }
+    if (scanned != read)
+        ++mismatches;
+    printf("%zu expressions read by scanf, %zu by expr_reader_t, "
+           "%d mismatches\n", scanned, read, mismatches);
+    fclose(file);
+
+    /* Bad lines are skipped, and reported where they go wrong. */
+    file = tmpfile();
+    if (file == NULL) {
+        puts("Could not create a temporary file");
+        ++failed_checks;
+        return;
+    }
+    fputs("1 + 2\n"
+          "3 x 4\n"
+          "\n"
+          "  5 * 99999999999\n"
+          "6 / 7 junk\n"
+          "\t8 - 9\n"
+          "+ 1\n"
+          "10 * 2", file);
+    fflush(file);
+    rewind(file);
+    size_t const expected_lines[] = {2, 4, 5, 7};
+    size_t const expected_columns[] = {3, 7, 7, 1};
+    memset(&errors, 0, sizeof(errors));
+    read = read_all_expressions(file, lefts, rights, op_codes, capacity,
+                                &errors);
+    fclose(file);
+
+    int error_mismatches = 0;
+    if (read != 3 || lefts[0] != 1 || op_codes[1] != '-' || rights[2] != 2)
+        ++error_mismatches;
+    if (errors.count != 4) {
+        ++error_mismatches;
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            if (errors.lines[i] != expected_lines[i] ||
+                errors.columns[i] != expected_columns[i])
+                ++error_mismatches;
+        }
+    }
+    printf("bad lines found at the right line and column: %s\n",
+           error_mismatches == 0 ? "yes" : "NO");
+
+    if (mismatches != 0 || error_mismatches != 0)
+        ++failed_checks;
+}
+
+/* expression_t can only hold NUMBER OPERATOR NUMBER. expr_compiler.h can
+   handle whole expressions with parentheses and variables. The text is
+   parsed and compiled into bytecode once, then evaluated as many times as we
+   like, with different values for the variables.
+*/
+
+#define ROW_COUNT 1000000
+
+/* a helper for timing things with clock_gettime */
+double seconds_between(struct timespec start, struct timespec stop) {
+    return (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void using_compiled_expressions() {
+    puts(__func__);
+
+    char const * var_names[] = {"x", "y"};
+    char const * source = "(x + 2) * (y - 3) / 2 + 4 * 5 - -x";
+    char error[128];
+
+    expr_program_t* program = expr_compile(source, var_names, 2,
+                                           error, sizeof(error));
+    if (program == NULL) {
+        printf("Could not compile: %s\n", error);
+        return;
+    }
+
+    puts(source);
+    /* 4 * 5 has been folded into the constant 20 */
+    expr_program_print(program, stdout);
+
+    int vars[] = {10, 7};
+    printf("x = 10, y = 7: %d\n", expr_program_eval(program, vars));
+
+    /* evaluate a million different (x, y) pairs */
+    static int rows[ROW_COUNT * 2];
+    static int results[ROW_COUNT];
+    for (int i = 0; i < ROW_COUNT; ++i) {
+        rows[2 * i] = i;
+        rows[2 * i + 1] = i % 1000;
+    }
+
+    struct timespec start;
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    expr_program_eval_many(program, rows, ROW_COUNT, results);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    printf("%.1f ns per evaluation\n",
+           seconds_between(start, stop) * 1e9 / ROW_COUNT);
+
+    /* the same expression written in C, to check the million results */
+    int mismatches = 0;
+    for (int i = 0; i < ROW_COUNT; ++i) {
+        int x = rows[2 * i];
+        int y = rows[2 * i + 1];
+        if (results[i] != (x + 2) * (y - 3) / 2 + 4 * 5 - -x)
+            ++mismatches;
+    }
+    if (mismatches != 0) {
+        printf("%d of %d evaluations were wrong\n", mismatches, ROW_COUNT);
+        ++failed_checks;
+    }
+
+    expr_program_free(program);
+
+    /* errors say where the problem is */
+    if (expr_compile("(x + z", var_names, 2, error, sizeof(error)) == NULL)
+        printf("Could not compile: %s\n", error);
+}
+
+/* The compiler is checked against C itself: each expression below is also
+   written as a C function, and both are evaluated for many random x, y and
+   z. Function pointers make the table easy to write.
+
+   The expressions cover the things a parser gets wrong most easily: which
+   operators bind tighter, that a - b - c is (a - b) - c, unary minus, and
+   constant folding. Each one is evaluated with expr_program_eval and with
+   expr_program_eval_many, which must agree too.
+
+   y and z are kept away from 0, and all values small, so the C versions
+   never divide by 0 or overflow, which would be undefined.
+*/
+
+typedef int (*reference_func)(int x, int y, int z);
+
+int ref_precedence(int x, int y, int z) {
+    return x + y * z;
+}
+
+int ref_parentheses(int x, int y, int z) {
+    return (x + y) * z;
+}
+
+int ref_sub_left(int x, int y, int z) {
+    return x - y - z;
+}
+
+int ref_div_left(int x, int y, int z) {
+    return x / y / z;
+}
+
+int ref_mixed_left(int x, int y, int z) {
+    return x - y + z * x / y;
+}
+
+int ref_negate(int x, int y, int z) {
+    return -x * y - -z;
+}
+
+int ref_double_negate(int x, int y, int z) {
+    return - -x + -(y - z);
+}
+
+/* the rest are partly or all constants, which are folded */
+
+int ref_folded(int x, int y, int z) {
+    return 2 * 3 + x * (4 - 2 * 2) + 7 / 2;
+}
+
+int ref_folded_negate(int x, int y, int z) {
+    return -(2 - 5) * x - 100 / 7 / 3;
+}
+
+int ref_folded_mixed(int x, int y, int z) {
+    return (x + 2) * (y - 3) / 2 + 4 * 5 - -x;
+}
+
+int ref_variable(int x, int y, int z) {
+    return z;
+}
+
+int ref_constant(int x, int y, int z) {
+    return -42;
+}
+
+typedef struct {
+    char const * source;
+    reference_func reference;
+} compiled_case_t;
+
+#define CHECK_ROWS 1000
+
+void check_compiled_expressions() {
+    puts(__func__);
+    compiled_case_t const cases[] = {
+        {"x + y * z", ref_precedence},
+        {"(x + y) * z", ref_parentheses},
+        {"x - y - z", ref_sub_left},
+        {"x / y / z", ref_div_left},
+        {"x - y + z * x / y", ref_mixed_left},
+        {"-x * y - -z", ref_negate},
+        {"- -x + -(y - z)", ref_double_negate},
+        {"2 * 3 + x * (4 - 2 * 2) + 7 / 2", ref_folded},
+        {"-(2 - 5) * x - 100 / 7 / 3", ref_folded_negate},
+        {"(x + 2) * (y - 3) / 2 + 4 * 5 - -x", ref_folded_mixed},
+        {"+z", ref_variable},
+        {"-+-+-42", ref_constant},
+    };
+    char const * var_names[] = {"x", "y", "z"};
+    static int rows[CHECK_ROWS * 3];
+    static int results[CHECK_ROWS];
+    char error[128];
+
+    unsigned random = 12345;
+    for (int i = 0; i < CHECK_ROWS; ++i) {
+        random = random * 1103515245 + 12345;
+        rows[3 * i] = (int)(random >> 16) % 2001 - 1000;
+        for (int j = 1; j < 3; ++j) {
+            random = random * 1103515245 + 12345;
+            int value = (int)(random >> 16) % 50 + 1;
+            rows[3 * i + j] = random & 1 ? value : -value;
+        }
+    }
+
+    int mismatches = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        expr_program_t* program = expr_compile(cases[c].source, var_names, 3,
+                                               error, sizeof(error));
+        if (program == NULL) {
+            printf("\"%s\" did not compile: %s\n", cases[c].source, error);
+            ++mismatches;
+            continue;
+        }
+
+        expr_program_eval_many(program, rows, CHECK_ROWS, results);
+        int wrong = 0;
+        for (int i = 0; i < CHECK_ROWS; ++i) {
+            int const * vars = rows + 3 * i;
+            int expected = cases[c].reference(vars[0], vars[1], vars[2]);
+            if (expr_program_eval(program, vars) != expected ||
+                results[i] != expected)
+                ++wrong;
+        }
+        if (wrong != 0)
+            printf("\"%s\": %d of %d wrong\n", cases[c].source, wrong,
+                   CHECK_ROWS);
+        mismatches += wrong;
+        expr_program_free(program);
+    }
+
+    /* Too deep an expression is an error, not a stack overflow. */
+    static char deep[100000 + 2];
+    memset(deep, '-', sizeof(deep) - 2);
+    deep[sizeof(deep) - 2] = 'x';
+    if (expr_compile(deep, var_names, 3, error, sizeof(error)) != NULL) {
+        puts("100000 minus signs compiled");
+        ++mismatches;
+    }
+    memset(deep, '(', sizeof(deep) - 2);
+    if (expr_compile(deep, var_names, 3, error, sizeof(error)) != NULL) {
+        puts("100000 parentheses compiled");
+        ++mismatches;
+    } else {
+        printf("Could not compile: %s\n", error);
+    }
+
+    if (mismatches != 0)
+        ++failed_checks;
+    printf("compiled expressions checked against C: %s\n",
+           mismatches == 0 ? "no mismatches" : "MISMATCHES");
+}
+
 /*
   HIGHER ORDER FUNCTIONS:
 
@@ -158,15 +636,11 @@ void use_expressions() {
   If you have an algorithm that you want to customize for a given situation,
   you can make it take functions as arguments to change its behavior.
   
-  In the last lesson we had a function called char_find that I will duplicate
-  here.
+  In the last lesson we had a function called find_char. Rather than copy
+  it, this lesson uses that one: it is in ../06_pointer_arithmetic/slices.c,
+  and higher_order.h includes its header.
  */
 
-char* find_char(char* begin, char* end, char ch) {
-    for(; begin != end && *begin != ch; ++begin);
-    return begin;
-}
-
 /* find_char can find the first char ch. But what if you want to find a certain
    KIND of char? What if you want to find the first upper case char? Or the
    first number? Or the first whitespac char (including tabs and spaces)?
@@ -197,19 +671,15 @@ char* find_char(char* begin, char* end, char ch) {
       However, for historical reasons, they take int as arguments.
 */
 
-typedef int (*unary_pred)(int);
-
-/* Now lets make our customizeable find function.
+/* higher_order.h calls a pointer to a unary predicate on chars unary_pred.
+   Open higher_order.c next to this file for the rest.
+*/
 
-   Instead of stopping when we match the char ch, we stop on the char for which
-   is_found returns true.
+/* Now lets make our customizeable find function, find_char_if in
+   higher_order.c. It is find_char with one change: instead of stopping when
+   we match the char ch, we stop on the char for which is_found returns true.
  */
 
-char* find_char_if(char* begin, char* end, unary_pred is_found) {
-    for(; begin != end && !is_found(*begin); ++begin);
-    return begin;
-}
-
 /* Now we can reuse the character predicates found in ctype.h.
 
    For details:
@@ -233,35 +703,150 @@ void using_find_char_if() {
     printf("Found first punctuation: %c\n", *find_char_if(begin, end, ispunct));
 }
 
-/* Not all higher order functions need to take predicates as arguments.
-   
-   unary_func is *not* a predicate because it does not return true or false.
-   It may also not be referentially transparent.
- */
-
-typedef void (*unary_func)(char* char_ptr);
+/* find_char_if has to call is_found through a pointer for every single char.
+   The compiler cannot see which function that will be, so it cannot inline
+   it, and it cannot make the loop check several chars at once.
 
-void for_each_char(char* begin, char* end, unary_func func) {
-    for(; begin != end; ++begin)
-        func(begin);
-}
+   Since a char only has 256 possible values, we can instead ask the predicate
+   about every char ONCE, and remember the answers in a char_class_t (see
+   char_class.h). Searching then only needs table lookups, which
+   find_char_in_class does 16 or 32 chars at a time.
 
-/* To use for_each_char we must have a function ready to pass to it. Lets write
-   a function that capitalizes a char.
+   Building the class costs 256 predicate calls, so it pays off when the class
+   is reused, or the slice is long.
 */
 
-void cap_char(char* char_ptr) {
-    *char_ptr = toupper(*char_ptr);
+void using_char_classes() {
+    puts(__func__);
+
+    char string[] = "A string full of words and 1 number.";
+    char* begin = string;
+    char* end = string + strlen(string);
+
+    char_class_t digits;
+    char_class_t upper;
+    char_class_t punct;
+    char_class_from_pred(&digits, isdigit);
+    char_class_from_pred(&upper, isupper);
+    char_class_from_pred(&punct, ispunct);
+
+    printf("Found first digit: %c\n", *find_char_in_class(begin, end, &digits));
+    printf("Found first upper case: %c\n",
+           *find_char_in_class(begin, end, &upper));
+    printf("Found first punctuation: %c\n",
+           *find_char_in_class(begin, end, &punct));
+
+    /* classes can also be built from ranges, without any predicate */
+    char_class_t vowels;
+    char_class_clear(&vowels);
+    char_class_add(&vowels, 'a');
+    char_class_add(&vowels, 'e');
+    char_class_add(&vowels, 'i');
+    char_class_add(&vowels, 'o');
+    char_class_add(&vowels, 'u');
+
+    char_class_t lower;
+    char_class_clear(&lower);
+    char_class_add_range(&lower, 'a', 'z');
+
+    printf("Found first vowel: %c\n", *find_char_in_class(begin, end, &vowels));
+    printf("Found first lower case: %c\n",
+           *find_char_in_class(begin, end, &lower));
 }
 
-/* Now we can rewrite the capitalize_chars function from the last lesson using
-   for_each_char
+/* find_char_in_class must find exactly what find_char_if finds, for every
+   predicate and every char. Chars from 128 to 255 are negative when char is
+   signed, and the vector code looks at chars in groups, so both are checked:
+   every char in every position of a vector, from several alignments. If any
+   check fails, the program exits with an error.
 */
 
-void capitalize_chars(char* begin, char* end) {
-    for_each_char(begin, end, cap_char);
+typedef struct {
+    char const * name;
+    unary_pred pred;
+} named_pred_t;
+
+#define CHECK_SLICE 96
+#define CHECK_ALIGNMENTS 34
+
+void check_char_classes() {
+    puts(__func__);
+    named_pred_t const preds[] = {
+        {"isalnum", isalnum}, {"isalpha", isalpha}, {"isblank", isblank},
+        {"iscntrl", iscntrl}, {"isdigit", isdigit}, {"isgraph", isgraph},
+        {"islower", islower}, {"isprint", isprint}, {"ispunct", ispunct},
+        {"isspace", isspace}, {"isupper", isupper}, {"isxdigit", isxdigit},
+    };
+    static char buffer[CHECK_ALIGNMENTS + 256];
+
+    for (size_t i = 0; i < sizeof(preds) / sizeof(preds[0]); ++i) {
+        char_class_t cls;
+        char_class_from_pred(&cls, preds[i].pred);
+        int mismatches = 0;
+
+        /* all 256 chars, in every rotation, at every alignment */
+        for (int rotation = 0; rotation < 256; ++rotation) {
+            for (int start = 0; start < CHECK_ALIGNMENTS; ++start) {
+                char* begin = buffer + start;
+                char* end = begin + (rotation * 7 + start) % 257;
+                for (int j = 0; j < 256; ++j)
+                    begin[j] = (char)(j + rotation);
+                if (find_char_in_class(begin, end, &cls) !=
+                    find_char_if(begin, end, preds[i].pred))
+                    ++mismatches;
+            }
+        }
+
+        /* a single char in the class, everywhere in a slice of chars that
+           are not */
+        int outsider = 0;
+        while (outsider < 256 && char_class_contains(&cls, (char)outsider))
+            ++outsider;
+        for (int ch = 0; ch < 256; ++ch) {
+            if (!char_class_contains(&cls, (char)ch))
+                continue;
+            for (int start = 0; start < CHECK_ALIGNMENTS; start += 11) {
+                char* begin = buffer + start;
+                char* end = begin + CHECK_SLICE;
+                memset(begin, outsider, CHECK_SLICE);
+                for (int at = 0; at < 64; ++at) {
+                    begin[at] = (char)ch;
+                    if (find_char_in_class(begin, end, &cls) !=
+                        find_char_if(begin, end, preds[i].pred))
+                        ++mismatches;
+                    begin[at] = (char)outsider;
+                }
+            }
+        }
+
+        if (mismatches != 0) {
+            printf("find_char_in_class with %s: %d mismatches\n",
+                   preds[i].name, mismatches);
+            ++failed_checks;
+        }
+    }
+    printf("find_char_in_class checked against find_char_if: %s\n",
+           failed_checks == 0 ? "no mismatches" : "MISMATCHES");
 }
 
+/* Not all higher order functions need to take predicates as arguments.
+   
+   unary_func is *not* a predicate because it does not return true or false.
+   It may also not be referentially transparent.
+ */
+
+/* unary_func in higher_order.h is a pointer to such a function, one that
+   takes a pointer to a char. for_each_char in higher_order.c calls func on
+   every char of the slice.
+
+   To use for_each_char we must have a function ready to pass to it.
+   cap_char, also in higher_order.c, capitalizes a char.
+
+   With them, the capitalize_chars function from the last lesson is just
+   for_each_char(begin, end, cap_char). The benchmarks time both, to see what
+   the indirect call costs.
+*/
+
 /* Now we can rewrite our example from last time that demonstrated slicing
    using higher order functions */
 
@@ -285,6 +870,308 @@ void capitalize_word_in_string() {
     puts(string);
 }
 
+/* for_each_char only uses one processor core. Since cap_char only looks at
+   the char it is given, different parts of the slice can be capitalized at
+   the same time on different cores.
+
+   parallel.h has a thread pool that splits a slice into chunks and runs
+   for_each_char style work on each chunk in parallel. Because we pass in a
+   plain function pointer, the same cap_char works for both versions.
+
+   To add something up in parallel, like counting digits, each chunk is
+   counted separately with parallel_map_chunks, and then we add the counts.
+*/
+
+long count_digits(char* begin, char* end) {
+    long count = 0;
+    for (; begin != end; ++begin) {
+        if (isdigit(*begin))
+            ++count;
+    }
+    return count;
+}
+
+/* fill_with_text, in transforms.c, fills a slice with a short sentence of
+   words and digits, repeated. It makes the stream for the benchmarks too. */
+
+/* stdlib.h declares its own div(), which clashes with ours, so this lesson
+   does not use malloc. A static array does the job just as well. */
+
+#define BIG_SIZE (64 * 1024 * 1024)
+#define GRAIN (256 * 1024)
+#define MAX_CHUNKS (BIG_SIZE / GRAIN + 1)
+
+void using_parallel_for_each_char() {
+    puts(__func__);
+
+    static char big_string[BIG_SIZE];
+    char* begin = big_string;
+    char* end = big_string + BIG_SIZE;
+    fill_with_text(begin, end);
+
+    struct timespec start;
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for_each_char(begin, end, cap_char);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double one_core = seconds_between(start, stop);
+    printf("for_each_char:            %.3f s\n", one_core);
+
+    /* try every number of threads from 1 up to the number of cores */
+    thread_pool_t* pool = thread_pool_create(0);
+    if (pool == NULL) {
+        puts("Could not start threads");
+        return;
+    }
+    int max_threads = thread_pool_size(pool);
+    thread_pool_destroy(pool);
+
+    for (int threads = 1; threads <= max_threads; ++threads) {
+        pool = thread_pool_create(threads);
+        if (pool == NULL)
+            return;
+
+        fill_with_text(begin, end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        parallel_for_each_char(pool, begin, end, GRAIN, cap_char);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double seconds = seconds_between(start, stop);
+        printf("parallel_for_each_char:   %.3f s on %d threads, %.1fx\n",
+               seconds, threads, one_core / seconds);
+
+        if (threads < max_threads)
+            thread_pool_destroy(pool);
+    }
+
+    static long counts[MAX_CHUNKS];
+    size_t chunks = parallel_chunk_count(begin, end, GRAIN);
+    parallel_map_chunks(pool, begin, end, GRAIN, count_digits, counts);
+    long total = 0;
+    for (size_t i = 0; i < chunks; ++i)
+        total += counts[i];
+    printf("%ld digits in %zu chunks (expected %ld)\n", total, chunks,
+           count_digits(begin, end));
+
+    thread_pool_destroy(pool);
+}
+
+/* Data from a pipe never sits in memory all at once, so there is no one
+   slice to run the functions above on. stream.h cuts the stream into
+   chunks, and calls a TRANSFORM, another function pointer, on each chunk
+   while other threads read and write the chunks before and after it.
+
+   Capitalizing every char doesn't care where a chunk ends. */
+
+/* The transforms are in transforms.c, where the benchmarks can use them
+   too. Open it next to this file.
+
+   capitalize_transform runs for_each_char with cap_char over the chunk.
+
+   Counting lines doesn't change the chunk at all: count_lines_transform
+   calls find_char for each '\n', and adds them up in the long its context
+   points to.
+
+   Capitalizing one particular word, like capitalize_word_in_string does,
+   has to see whole words. If a chunk ends in the middle of a word, that
+   word is left for the next chunk, by returning its length. That is
+   capitalize_word_transform, whose context is a word_t from transforms.h.
+   It finds each word with find_char_if, using isspace and is_not_space.
+
+   To have a fast stream to work on, producer_main writes the same text into
+   a pipe over and over, on a thread of its own.
+*/
+
+/* Runs transform over blocks MB from a producer thread, written to
+   /dev/null, and prints how fast that went. */
+void time_stream(char const * name, int blocks, stream_transform_t transform,
+                 void* context) {
+    int fds[2];
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) {
+        perror("time_stream");
+        return;
+    }
+    if (pipe(fds) != 0) {
+        perror("time_stream");
+        close(null_fd);
+        return;
+    }
+    producer_t producer = {fds[1], blocks};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, producer_main, &producer) != 0) {
+        puts("Could not start a thread");
+        close(fds[0]);
+        close(fds[1]);
+        close(null_fd);
+        return;
+    }
+
+    struct timespec start;
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ok = stream_run(fds[0], null_fd, transform, context, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    close(null_fd);
+
+    double gigabytes = (double)blocks * PRODUCER_BLOCK / 1e9;
+    if (!ok)
+        perror(name);
+    else
+        printf("%-28s %.2f GB/s\n", name,
+               gigabytes / seconds_between(start, stop));
+}
+
+void using_streams() {
+    puts(__func__);
+
+    /* A tiny chunk size, so words are cut by chunk boundaries all the time.
+       The input fits in the pipe's buffer, so it can be written in full
+       before the stream starts. The output is small too. */
+    char const input[] = "foo bar\tspam bar eggs barn\nfoobar bar\n";
+    int in_fds[2], out_fds[2];
+    if (pipe(in_fds) != 0 || pipe(out_fds) != 0) {
+        perror("pipe");
+        return;
+    }
+    if (write(in_fds[1], input, strlen(input)) != (ssize_t)strlen(input))
+        perror("write");
+    close(in_fds[1]);
+
+    word_t bar = {"bar", 3};
+    stream_options_t tiny = {.chunk_size = 4, .max_carry = 16,
+                             .chunk_count = 3};
+    if (!stream_run(in_fds[0], out_fds[1], capitalize_word_transform, &bar,
+                    &tiny))
+        perror("stream_run");
+    close(in_fds[0]);
+    close(out_fds[1]);
+
+    char output[sizeof(input)];
+    ssize_t size = read(out_fds[0], output, sizeof(output));
+    close(out_fds[0]);
+    printf("%.*s", (int)(size > 0 ? size : 0), output);
+
+    long lines = 0;
+    time_stream("capitalize_transform", 256, capitalize_transform, NULL);
+    time_stream("count_lines_transform", 256, count_lines_transform, &lines);
+    time_stream("capitalize_word_transform", 256, capitalize_word_transform,
+                &bar);
+}
+
+/* Cutting the stream into chunks must not change the result. Here random
+   text is streamed with random chunk sizes, and the output compared with
+   capitalize_word_transform run once over the whole text.
+
+   The text is words of 'b', 'a' and 'r' (so plenty of them are "bar") up
+   to MAX_CHECK_WORD chars long, between runs of spaces, tabs and newlines.
+   max_carry is never less than MAX_CHECK_WORD: a longer word would be split
+   on purpose (see stream.h), and then the results may rightly differ.
+
+   The text fits in a pipe's buffer, so it can be written in full before
+   the stream starts, and the output can be read after it ends.
+*/
+
+#define CHECK_STREAM_RUNS 500
+#define MAX_CHECK_TEXT 4096
+#define MAX_CHECK_WORD 8
+
+void check_streams() {
+    puts(__func__);
+    static char text[MAX_CHECK_TEXT];
+    static char expected[MAX_CHECK_TEXT];
+    static char output[MAX_CHECK_TEXT + 1];
+    word_t bar = {"bar", 3};
+    unsigned random = 12345;
+    int mismatches = 0;
+
+    for (int run = 0; run < CHECK_STREAM_RUNS; ++run) {
+        random = random * 1103515245 + 12345;
+        size_t size = (random >> 8) % MAX_CHECK_TEXT;
+        size_t i = 0;
+        while (i < size) {
+            random = random * 1103515245 + 12345;
+            size_t word_length = 1 + (random >> 16) % MAX_CHECK_WORD;
+            for (size_t j = 0; j < word_length && i < size; ++j, ++i) {
+                random = random * 1103515245 + 12345;
+                text[i] = "bar"[(random >> 16) % 3];
+            }
+            random = random * 1103515245 + 12345;
+            size_t spaces = 1 + (random >> 16) % 3;
+            for (size_t j = 0; j < spaces && i < size; ++j, ++i) {
+                random = random * 1103515245 + 12345;
+                text[i] = " \t\n"[(random >> 16) % 3];
+            }
+        }
+        memcpy(expected, text, size);
+        capitalize_word_transform(expected, expected + size, 1, &bar);
+
+        random = random * 1103515245 + 12345;
+        stream_options_t options = {
+            .chunk_size = 1 + (random >> 8) % 64,
+            .max_carry = MAX_CHECK_WORD + (random >> 16) % 32,
+            .chunk_count = 3 + (random >> 24) % 4,
+        };
+
+        int in_fds[2], out_fds[2];
+        if (pipe(in_fds) != 0) {
+            perror("check_streams");
+            ++failed_checks;
+            return;
+        }
+        if (pipe(out_fds) != 0) {
+            perror("check_streams");
+            close(in_fds[0]);
+            close(in_fds[1]);
+            ++failed_checks;
+            return;
+        }
+        int ok = write(in_fds[1], text, size) == (ssize_t)size;
+        close(in_fds[1]);
+        ok = ok && stream_run(in_fds[0], out_fds[1],
+                              capitalize_word_transform, &bar, &options);
+        close(in_fds[0]);
+        close(out_fds[1]);
+
+        /* read until the end, so missing or extra output is noticed too */
+        size_t got = 0;
+        ssize_t count;
+        while (got < sizeof(output) &&
+               (count = read(out_fds[0], output + got,
+                             sizeof(output) - got)) > 0)
+            got += count;
+        close(out_fds[0]);
+
+        if (!ok || got != size || memcmp(output, expected, size) != 0) {
+            if (mismatches == 0)
+                printf("%zu chars in chunks of %zu, max_carry %zu, %d chunks: "
+                       "%s\n", size, options.chunk_size, options.max_carry,
+                       options.chunk_count, ok ? "wrong output" : "failed");
+            ++mismatches;
+        }
+    }
+
+    if (mismatches != 0) {
+        printf("stream_run: %d of %d runs differ\n", mismatches,
+               CHECK_STREAM_RUNS);
+        ++failed_checks;
+    }
+    printf("stream_run checked against the whole text: %s\n",
+           mismatches == 0 ? "no mismatches" : "MISMATCHES");
+}
+
+/* ./function_ptr --capitalize WORD capitalizes WORD everywhere in stdin,
+   and writes the result to stdout. */
+int capitalize_word_in_stream(char const * word_text) {
+    word_t word = {word_text, strlen(word_text)};
+    if (!stream_run(0, 1, capitalize_word_transform, &word, NULL)) {
+        perror("function_ptr");
+        return 1;
+    }
+    return 0;
+}
+
 /* Higher order functions make algorithms much more flexible!
 
    However... in C there are some limitations!
@@ -343,9 +1230,23 @@ void capitalize_word_in_string() {
 */
 
 int main(int argc, char* argv[]) {
-    put_a_function_in_a_variable();
-    use_expressions();
-    using_find_char_if();
-    capitalize_word_in_string();
-    return 0;
+    INSTRUMENT_FUNCTION();
+    if (argc == 3 && strcmp(argv[1], "--capitalize") == 0)
+        return capitalize_word_in_stream(argv[2]);
+
+    INSTRUMENTED(put_a_function_in_a_variable());
+    INSTRUMENTED(use_expressions());
+    INSTRUMENTED(using_expression_batches());
+    INSTRUMENTED(using_expression_reader());
+    INSTRUMENTED(check_expr_reader());
+    INSTRUMENTED(using_compiled_expressions());
+    INSTRUMENTED(check_compiled_expressions());
+    INSTRUMENTED(using_find_char_if());
+    INSTRUMENTED(using_char_classes());
+    INSTRUMENTED(check_char_classes());
+    INSTRUMENTED(capitalize_word_in_string());
+    INSTRUMENTED(using_parallel_for_each_char());
+    INSTRUMENTED(using_streams());
+    INSTRUMENTED(check_streams());
+    return failed_checks == 0 ? 0 : 1;
 }
@@ -0,0 +1,17 @@
+#include "higher_order.h"
+
+#include <ctype.h>
+
+char* find_char_if(char* begin, char* end, unary_pred is_found) {
+    for(; begin != end && !is_found(*begin); ++begin);
+    return begin;
+}
+
+void for_each_char(char* begin, char* end, unary_func func) {
+    for(; begin != end; ++begin)
+        func(begin);
+}
+
+void cap_char(char* char_ptr) {
+    *char_ptr = toupper((unsigned char)*char_ptr);
+}
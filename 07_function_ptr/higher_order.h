@@ -0,0 +1,25 @@
+/* The higher order slice functions from function_ptr.c, in their own file so
+   the benchmarks in bench/ can use them too. The plain slice functions they
+   build on, find_char and capitalize_chars, are lesson 06's, in
+   ../06_pointer_arithmetic/slices.c. */
+
+#ifndef HIGHER_ORDER_H
+#define HIGHER_ORDER_H
+
+#include "../06_pointer_arithmetic/slices.h"
+
+typedef int (*unary_pred)(int);
+
+/* The first char in [begin, end) for which is_found returns true, or end. */
+char* find_char_if(char* begin, char* end, unary_pred is_found);
+
+typedef void (*unary_func)(char* char_ptr);
+
+/* Calls func on a pointer to every char in [begin, end). */
+void for_each_char(char* begin, char* end, unary_func func);
+
+/* Upper cases *char_ptr. for_each_char with cap_char does the same as
+   capitalize_chars. */
+void cap_char(char* char_ptr);
+
+#endif /* HIGHER_ORDER_H */
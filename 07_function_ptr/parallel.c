@@ -0,0 +1,269 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../instrument/instrument.h"
+
+#define CACHE_LINE 64
+#define DEFAULT_GRAIN (256 * 1024)
+
+/* How chunks are shared out: WORK STEALING.
+
+   Each thread starts with its own equal share of the chunks, and takes them
+   one at a time from the front of its share. When its share is empty, the
+   thread STEALS the next chunk from another thread's share.
+
+   If some chunks are slower than others, or some threads get less processor
+   time, the fast threads end up doing more of the chunks, and nobody sits
+   idle while work is left.
+
+   A share is just a counter (next) and a limit (end). Taking a chunk is one
+   atomic_fetch_add on the counter, so the owner and thieves can never take
+   the same chunk. Each share sits on its own cache line, so threads taking
+   from their own share don't slow each other down.
+*/
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_size_t next;
+    size_t end;
+} chunk_share_t;
+
+typedef struct {
+    char* begin;
+    char* end;
+    char* base; /* begin rounded down to a cache line */
+    size_t grain;
+    size_t chunk_count;
+    chunk_share_t* shares;
+
+    /* exactly one of these is set */
+    void (*char_func)(char*);
+    void (*chunk_func)(char*, char*);
+    long (*map_func)(char*, char*);
+    long* results;
+} job_t;
+
+struct thread_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    job_t* job;
+    unsigned long generation; /* incremented for every new job */
+    int busy_threads;
+    int shutting_down;
+
+    int thread_count;
+    pthread_t* threads;
+};
+
+static size_t round_up_grain(size_t grain) {
+    if (grain == 0)
+        grain = DEFAULT_GRAIN;
+    return (grain + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+static char* chunk_base(char const * begin) {
+    return (char*)((uintptr_t)begin / CACHE_LINE * CACHE_LINE);
+}
+
+size_t parallel_chunk_count(char const * begin, char const * end, size_t grain) {
+    if (begin == end)
+        return 0;
+    grain = round_up_grain(grain);
+    return (end - chunk_base(begin) + grain - 1) / grain;
+}
+
+static void run_chunk(job_t* job, size_t chunk) {
+    char* chunk_begin = job->base + chunk * job->grain;
+    char* chunk_end = chunk_begin + job->grain;
+    if (chunk_begin < job->begin)
+        chunk_begin = job->begin;
+    if (chunk_end > job->end)
+        chunk_end = job->end;
+
+    if (job->char_func) {
+        for (; chunk_begin != chunk_end; ++chunk_begin)
+            job->char_func(chunk_begin);
+    } else if (job->chunk_func) {
+        job->chunk_func(chunk_begin, chunk_end);
+    } else {
+        job->results[chunk] = job->map_func(chunk_begin, chunk_end);
+    }
+}
+
+static int take_chunk(chunk_share_t* share, size_t* chunk) {
+    if (atomic_load_explicit(&share->next, memory_order_relaxed) >= share->end)
+        return 0;
+    *chunk = atomic_fetch_add(&share->next, 1);
+    return *chunk < share->end;
+}
+
+static void work_on_job(job_t* job, int thread_index, int thread_count) {
+    INSTRUMENT_FUNCTION();
+    size_t chunk;
+    int64_t stolen = 0;
+    for (int i = 0; i < thread_count; ++i) {
+        /* first our own share, then everybody else's */
+        chunk_share_t* share = &job->shares[(thread_index + i) % thread_count];
+        while (take_chunk(share, &chunk)) {
+            run_chunk(job, chunk);
+            stolen += i > 0;
+        }
+    }
+    INSTRUMENT_COUNT("parallel chunks stolen", stolen);
+}
+
+typedef struct {
+    thread_pool_t* pool;
+    int index;
+} worker_arg_t;
+
+static void* worker_main(void* arg_ptr) {
+    worker_arg_t* arg = (worker_arg_t*)arg_ptr;
+    thread_pool_t* pool = arg->pool;
+    int index = arg->index;
+    free(arg);
+
+    unsigned long seen_generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutting_down && pool->generation == seen_generation)
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        if (pool->shutting_down)
+            break;
+
+        seen_generation = pool->generation;
+        job_t* job = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+
+        work_on_job(job, index, pool->thread_count);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy_threads == 0)
+            pthread_cond_signal(&pool->work_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool_t* thread_pool_create(int thread_count) {
+    if (thread_count <= 0)
+        thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count <= 0)
+        thread_count = 1;
+
+    thread_pool_t* pool = (thread_pool_t*)calloc(1, sizeof(thread_pool_t));
+    if (pool == NULL)
+        return NULL;
+    pool->thread_count = thread_count;
+    pool->threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    /* Thread 0 is whoever submits the job, so only start the others. */
+    for (int i = 1; i < thread_count; ++i) {
+        worker_arg_t* arg = (worker_arg_t*)malloc(sizeof(worker_arg_t));
+        if (arg != NULL) {
+            arg->pool = pool;
+            arg->index = i;
+        }
+        if (arg == NULL ||
+            pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0) {
+            free(arg);
+            pool->thread_count = i;
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void thread_pool_destroy(thread_pool_t* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->thread_count; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+int thread_pool_size(thread_pool_t const * pool) {
+    return pool->thread_count;
+}
+
+static void run_job(thread_pool_t* pool, job_t* job) {
+    int thread_count = pool->thread_count;
+    job->grain = round_up_grain(job->grain);
+    job->base = chunk_base(job->begin);
+    job->chunk_count = parallel_chunk_count(job->begin, job->end, job->grain);
+    if (job->chunk_count == 0)
+        return;
+
+    chunk_share_t shares[thread_count];
+    for (int i = 0; i < thread_count; ++i) {
+        atomic_init(&shares[i].next, job->chunk_count * i / thread_count);
+        shares[i].end = job->chunk_count * (i + 1) / thread_count;
+    }
+    job->shares = shares;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->busy_threads = thread_count - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    work_on_job(job, 0, thread_count);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy_threads > 0)
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    pool->job = NULL;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void parallel_for_each_char(thread_pool_t* pool, char* begin, char* end,
+                            size_t grain, void (*func)(char* char_ptr)) {
+    job_t job = {begin, end};
+    job.grain = grain;
+    job.char_func = func;
+    run_job(pool, &job);
+}
+
+void parallel_for_each_chunk(thread_pool_t* pool, char* begin, char* end,
+                             size_t grain,
+                             void (*func)(char* chunk_begin, char* chunk_end)) {
+    job_t job = {begin, end};
+    job.grain = grain;
+    job.chunk_func = func;
+    run_job(pool, &job);
+}
+
+void parallel_map_chunks(thread_pool_t* pool, char* begin, char* end,
+                         size_t grain,
+                         long (*func)(char* chunk_begin, char* chunk_end),
+                         long* results) {
+    job_t job = {begin, end};
+    job.grain = grain;
+    job.map_func = func;
+    job.results = results;
+    run_job(pool, &job);
+}
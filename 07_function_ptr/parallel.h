@@ -0,0 +1,60 @@
+/* Running for_each_char style algorithms on several processor cores. */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/* A thread pool is a group of threads that are started once, and then reused
+   for many jobs. Starting threads is slow, so we don't want to do it for
+   every call.
+
+   thread_pool_t is OPAQUE. Users only ever see pointers to it, and cannot
+   look at or copy its members. Only parallel.c knows what is inside.
+*/
+typedef struct thread_pool thread_pool_t;
+
+/* Creates a pool that runs jobs on thread_count threads, counting the thread
+   that submits the job. Pass 0 to use one thread per processor core.
+   Returns NULL if the threads could not be started.
+   Free the pool with thread_pool_destroy.
+*/
+thread_pool_t* thread_pool_create(int thread_count);
+void thread_pool_destroy(thread_pool_t* pool);
+int thread_pool_size(thread_pool_t const * pool);
+
+/* All of the parallel functions split [begin, end) into CHUNKS of grain
+   chars, and hand the chunks out to the threads of the pool.
+
+   grain is rounded up to a multiple of the 64 byte cache line, and chunks
+   start on cache line boundaries, so two threads never write to the same
+   cache line. Only the first and last chunks may be shorter than grain.
+   Pass 0 to use a default grain.
+
+   Every function returns once all chunks are done. Only one job runs on a
+   pool at a time.
+*/
+
+/* Calls func on every char, like for_each_char. */
+void parallel_for_each_char(thread_pool_t* pool, char* begin, char* end,
+                            size_t grain, void (*func)(char* char_ptr));
+
+/* Calls func once per chunk. Use this to run a slice algorithm such as
+   capitalize_chars over a big slice. */
+void parallel_for_each_chunk(thread_pool_t* pool, char* begin, char* end,
+                             size_t grain,
+                             void (*func)(char* chunk_begin, char* chunk_end));
+
+/* The number of chunks [begin, end) is split into for this grain. */
+size_t parallel_chunk_count(char const * begin, char const * end, size_t grain);
+
+/* Calls func once per chunk, and stores what it returns for chunk i in
+   results[i]. results must have room for parallel_chunk_count() longs.
+   Adding up the results is left to the caller. This is called a REDUCTION.
+*/
+void parallel_map_chunks(thread_pool_t* pool, char* begin, char* end,
+                         size_t grain,
+                         long (*func)(char* chunk_begin, char* chunk_end),
+                         long* results);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,276 @@
+/* for F_SETPIPE_SZ */
+#define _GNU_SOURCE
+
+#include "stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define DEFAULT_MAX_CARRY 4096
+#define DEFAULT_CHUNK_COUNT 4
+
+/* Each chunk has max_carry chars of room in front of the chars read into
+   it, so the chars carried over from the chunk before can be put right in
+   front of them without moving anything. */
+typedef struct {
+    char* memory;
+    char* begin;
+    char* end;
+    int is_last;
+} chunk_t;
+
+/* A queue of chunks that blocks: pop waits while it is empty, and push
+   waits while it is full. */
+typedef struct {
+    chunk_t** items;
+    int capacity;
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} queue_t;
+
+static void queue_init(queue_t* queue, chunk_t** items, int capacity) {
+    queue->items = items;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void queue_destroy(queue_t* queue) {
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+static void queue_push(queue_t* queue, chunk_t* chunk) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity)
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    queue->items[(queue->head + queue->count) % queue->capacity] = chunk;
+    ++queue->count;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static chunk_t* queue_pop(queue_t* queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0)
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    chunk_t* chunk = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    --queue->count;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return chunk;
+}
+
+typedef struct {
+    int in_fd;
+    int out_fd;
+    size_t chunk_size;
+    size_t max_carry;
+
+    queue_t empty;        /* writer -> reader */
+    queue_t filled;       /* reader -> transform */
+    queue_t transformed;  /* transform -> writer */
+
+    /* errno of a failed read or write, 0 if none */
+    int read_error;
+    int write_error;
+    /* Set when writing fails. The reader stops reading, and the writer
+       stops writing but still hands back chunks, so nobody waits forever. */
+    atomic_int failed;
+} stream_t;
+
+/* The reader fills a chunk completely before passing it on, unless the
+   stream ends. A pipe gives at most what fits in it per read, so that can
+   take several reads. */
+static void* reader_main(void* arg) {
+    stream_t* stream = (stream_t*)arg;
+    for (;;) {
+        chunk_t* chunk = queue_pop(&stream->empty);
+        char* data = chunk->memory + stream->max_carry;
+        size_t size = 0;
+        int done = atomic_load(&stream->failed);
+        while (!done && size < stream->chunk_size) {
+            ssize_t count = read(stream->in_fd, data + size,
+                                 stream->chunk_size - size);
+            if (count > 0) {
+                size += count;
+            } else if (count == 0) {
+                done = 1;
+            } else if (errno != EINTR) {
+                stream->read_error = errno;
+                done = 1;
+            }
+        }
+
+        chunk->begin = data;
+        chunk->end = data + size;
+        chunk->is_last = done;
+        queue_push(&stream->filled, chunk);
+        if (done)
+            return NULL;
+    }
+}
+
+static int write_all(int fd, char const * begin, char const * end) {
+    while (begin != end) {
+        ssize_t count = write(fd, begin, end - begin);
+        if (count >= 0)
+            begin += count;
+        else if (errno != EINTR)
+            return 0;
+    }
+    return 1;
+}
+
+static void* writer_main(void* arg) {
+    stream_t* stream = (stream_t*)arg;
+    for (;;) {
+        chunk_t* chunk = queue_pop(&stream->transformed);
+        if (!atomic_load(&stream->failed) &&
+            !write_all(stream->out_fd, chunk->begin, chunk->end)) {
+            stream->write_error = errno;
+            atomic_store(&stream->failed, 1);
+        }
+        int is_last = chunk->is_last;
+        queue_push(&stream->empty, chunk);
+        if (is_last)
+            return NULL;
+    }
+}
+
+/* The transform runs on the calling thread. */
+static void transform_chunks(stream_t* stream, stream_transform_t transform,
+                             void* context, char* carried) {
+    size_t carry = 0;
+    for (;;) {
+        chunk_t* chunk = queue_pop(&stream->filled);
+        chunk->begin -= carry;
+        memcpy(chunk->begin, carried, carry);
+
+        size_t left = transform(chunk->begin, chunk->end, chunk->is_last,
+                                context);
+        if (chunk->is_last || left > (size_t)(chunk->end - chunk->begin))
+            left = 0;
+        if (left > stream->max_carry) {
+            transform(chunk->end - left, chunk->end, 1, context);
+            left = 0;
+        }
+
+        chunk->end -= left;
+        memcpy(carried, chunk->end, left);
+        carry = left;
+
+        int is_last = chunk->is_last;
+        queue_push(&stream->transformed, chunk);
+        if (is_last)
+            return;
+    }
+}
+
+/* A pipe holds 64 KB by default, so each read or write on it moves at most
+   that much, and the threads take turns far more often than needed. Linux
+   can make a pipe bigger. This does nothing if fd isn't a pipe. */
+static void grow_pipe(int fd, size_t size) {
+#ifdef F_SETPIPE_SZ
+    fcntl(fd, F_SETPIPE_SZ, (int)size);
+#endif
+}
+
+int stream_run(int in_fd, int out_fd, stream_transform_t transform,
+               void* context, stream_options_t const * options) {
+    stream_t stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.in_fd = in_fd;
+    stream.out_fd = out_fd;
+    stream.chunk_size = DEFAULT_CHUNK_SIZE;
+    stream.max_carry = DEFAULT_MAX_CARRY;
+    int chunk_count = DEFAULT_CHUNK_COUNT;
+    if (options != NULL) {
+        if (options->chunk_size > 0)
+            stream.chunk_size = options->chunk_size;
+        if (options->max_carry > 0)
+            stream.max_carry = options->max_carry;
+        if (options->chunk_count > 0)
+            chunk_count = options->chunk_count < 3 ? 3 : options->chunk_count;
+    }
+    grow_pipe(in_fd, stream.chunk_size);
+    grow_pipe(out_fd, stream.chunk_size);
+
+    /* All the memory is allocated up front: the chunks, the queues, and
+       room for the chars carried from one chunk to the next. */
+    size_t chunk_bytes = stream.max_carry + stream.chunk_size;
+    chunk_t* chunks = (chunk_t*)calloc(chunk_count, sizeof(chunk_t));
+    chunk_t** queue_items = (chunk_t**)calloc(3 * chunk_count,
+                                              sizeof(chunk_t*));
+    char* memory = (char*)malloc(chunk_count * chunk_bytes + stream.max_carry);
+    if (chunks == NULL || queue_items == NULL || memory == NULL) {
+        free(memory);
+        free(queue_items);
+        free(chunks);
+        errno = ENOMEM;
+        return 0;
+    }
+
+    queue_init(&stream.empty, queue_items, chunk_count);
+    queue_init(&stream.filled, queue_items + chunk_count, chunk_count);
+    queue_init(&stream.transformed, queue_items + 2 * chunk_count,
+               chunk_count);
+    for (int i = 0; i < chunk_count; ++i) {
+        chunks[i].memory = memory + i * chunk_bytes;
+        queue_push(&stream.empty, &chunks[i]);
+    }
+
+    /* The writer starts first. If the reader can't be started, an empty
+       last chunk tells the writer to stop. */
+    int started = 0;
+    pthread_t reader, writer;
+    if (pthread_create(&writer, NULL, writer_main, &stream) == 0) {
+        if (pthread_create(&reader, NULL, reader_main, &stream) == 0) {
+            char* carried = memory + chunk_count * chunk_bytes;
+            transform_chunks(&stream, transform, context, carried);
+            pthread_join(reader, NULL);
+            started = 1;
+        } else {
+            chunk_t* last = queue_pop(&stream.empty);
+            last->begin = last->end = last->memory;
+            last->is_last = 1;
+            queue_push(&stream.transformed, last);
+        }
+        pthread_join(writer, NULL);
+    }
+
+    queue_destroy(&stream.transformed);
+    queue_destroy(&stream.filled);
+    queue_destroy(&stream.empty);
+    free(memory);
+    free(queue_items);
+    free(chunks);
+
+    if (!started) {
+        errno = EAGAIN;
+        return 0;
+    }
+    if (stream.read_error != 0) {
+        errno = stream.read_error;
+        return 0;
+    }
+    if (stream.write_error != 0) {
+        errno = stream.write_error;
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,61 @@
+/* Running slice functions over a stream, such as a pipe, that can't be held
+   in memory all at once. */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+/* A file can be mapped into memory and sliced whole. A pipe can't: its data
+   only arrives a piece at a time, and may never end. So the stream is cut
+   into CHUNKS, and the slice functions run on one chunk at a time.
+
+   Three stages work on different chunks at the same time: the reader and
+   the writer on threads of their own, and the transform on the thread that
+   called stream_run:
+
+       reader  --chunk-->  transform  --chunk-->  writer
+          ^                                         |
+          +------------- empty chunk ---------------+
+
+   While the transform works on one chunk, the reader is already filling the
+   next one and the writer is writing the previous one. There is a fixed
+   number of chunks, handed from stage to stage through QUEUES. If one stage
+   is slower than the others, the chunks pile up in front of it, and the
+   stages before it wait for an empty chunk. That is called BACKPRESSURE: the
+   memory used stays the same however long the stream is.
+
+   The transform sees each chunk as a slice it can change in place. But a
+   chunk boundary can cut a word, or a line, in two. So the transform
+   returns how many chars at the END of the slice it did NOT finish with,
+   such as the start of a word it hasn't seen the end of yet. Those chars
+   are not written out yet, but put in front of the next chunk, so the
+   transform sees them again together with the rest of the word. When
+   is_last is true there is no next chunk, and it must finish everything.
+*/
+typedef size_t (*stream_transform_t)(char* begin, char* end, int is_last,
+                                     void* context);
+
+typedef struct {
+    /* chars read per chunk, 0 for 1 MB */
+    size_t chunk_size;
+    /* the most chars the transform may leave unfinished at the end of a
+       chunk, 0 for 4096. If it leaves more, it is called again on just those
+       chars, with is_last true, so a longer word is split after all. */
+    size_t max_carry;
+    /* how many chunks there are, at least 3, 0 for 4 */
+    int chunk_count;
+} stream_options_t;
+
+/* Reads in_fd to its end, calls transform on each chunk, and writes the
+   result to out_fd. options may be NULL for the defaults. Returns 1 on
+   success, or 0 with errno set if reading or writing failed or there wasn't
+   enough memory.
+
+   If out_fd is a pipe whose reader has gone away, writing to it raises
+   SIGPIPE, which ends the program unless SIGPIPE is ignored.
+*/
+int stream_run(int in_fd, int out_fd, stream_transform_t transform,
+               void* context, stream_options_t const * options);
+
+#endif /* STREAM_H */
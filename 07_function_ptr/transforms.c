@@ -0,0 +1,67 @@
+#include "transforms.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "higher_order.h"
+
+void fill_with_text(char* begin, char* end) {
+    char const text[] = "foo bar 42 spam eggs 7 ";
+    for (size_t i = 0; begin != end; ++begin, ++i)
+        *begin = text[i % (sizeof(text) - 1)];
+}
+
+size_t capitalize_transform(char* begin, char* end, int is_last,
+                            void* context) {
+    for_each_char(begin, end, cap_char);
+    return 0;
+}
+
+size_t count_lines_transform(char* begin, char* end, int is_last,
+                             void* context) {
+    long* lines = (long*)context;
+    for (char* newline = find_char(begin, end, '\n'); newline != end;
+         newline = find_char(newline + 1, end, '\n'))
+        ++*lines;
+    return 0;
+}
+
+int is_not_space(int ch) {
+    return !isspace(ch);
+}
+
+size_t capitalize_word_transform(char* begin, char* end, int is_last,
+                                 void* context) {
+    word_t const * word = (word_t const *)context;
+    char* word_begin = find_char_if(begin, end, is_not_space);
+    while (word_begin != end) {
+        char* word_end = find_char_if(word_begin, end, isspace);
+        if (word_end == end && !is_last)
+            return end - word_begin;
+        if ((size_t)(word_end - word_begin) == word->length &&
+            memcmp(word_begin, word->word, word->length) == 0)
+            capitalize_chars(word_begin, word_end);
+        word_begin = find_char_if(word_end, end, is_not_space);
+    }
+    return 0;
+}
+
+void* producer_main(void* arg) {
+    producer_t* producer = (producer_t*)arg;
+    static char block[PRODUCER_BLOCK];
+    fill_with_text(block, block + PRODUCER_BLOCK);
+    for (int i = 0; i < producer->blocks; ++i) {
+        char* begin = block;
+        while (begin != block + PRODUCER_BLOCK) {
+            ssize_t count = write(producer->fd, begin,
+                                  block + PRODUCER_BLOCK - begin);
+            if (count <= 0)
+                break;
+            begin += count;
+        }
+    }
+    close(producer->fd);
+    return NULL;
+}
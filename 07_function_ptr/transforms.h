@@ -0,0 +1,46 @@
+/* The stream transforms from function_ptr.c, and a thread that produces a
+   stream for them to work on. In their own file so the benchmarks in bench/
+   can use them too. */
+
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <stddef.h>
+
+/* Fills [begin, end) with words, spaces and a few numbers. */
+void fill_with_text(char* begin, char* end);
+
+/* stream_transform_t's, see stream.h. */
+
+/* Capitalizes every char. */
+size_t capitalize_transform(char* begin, char* end, int is_last,
+                            void* context);
+
+/* Adds the number of '\n's to *(long*)context. */
+size_t count_lines_transform(char* begin, char* end, int is_last,
+                             void* context);
+
+int is_not_space(int ch);
+
+typedef struct {
+    char const * word;
+    size_t length;
+} word_t;
+
+/* Capitalizes every whole word equal to *(word_t const *)context. A word cut
+   off by the end of the chunk is left for the next chunk. */
+size_t capitalize_word_transform(char* begin, char* end, int is_last,
+                                 void* context);
+
+/* producer_main writes blocks blocks of PRODUCER_BLOCK bytes of
+   fill_with_text into fd, on a thread of its own, then closes fd. */
+#define PRODUCER_BLOCK (1024 * 1024)
+
+typedef struct {
+    int fd;
+    int blocks;
+} producer_t;
+
+void* producer_main(void* arg);
+
+#endif /* TRANSFORMS_H */
@@ -0,0 +1,87 @@
+/* Generic versions of the slice algorithms from lessons 06 and 07.
+
+   Everything here is a FUNCTION TEMPLATE, so it lives entirely in this header.
+   The compiler needs to see the whole definition to stamp out a version for
+   each type you use it with.
+*/
+
+#ifndef ALGORITHMS_HPP
+#define ALGORITHMS_HPP
+
+#include <cstddef>
+
+namespace algo {
+
+/* Each algorithm works on a slice [begin, end), just like find_char did.
+   Iter can be any pointer type (char*, int*, record*...), or anything else
+   that acts like a pointer.
+
+   Pred and Func can be a function pointer, a struct with operator(), or a
+   lambda. For the last two the compiler knows exactly which code is called,
+   so it can inline it into the loop.
+*/
+
+/* Returns the first element for which is_found returns true, or end. */
+template <typename Iter, typename Pred>
+Iter find_if(Iter begin, Iter end, Pred is_found) {
+    for (; begin != end && !is_found(*begin); ++begin);
+    return begin;
+}
+
+/* Calls func on every element. Unlike for_each_char, func is passed the
+   element itself (by reference if func asks for it) instead of a pointer.
+   Returns func, so a functor can carry results back out. */
+template <typename Iter, typename Func>
+Func for_each(Iter begin, Iter end, Func func) {
+    for (; begin != end; ++begin)
+        func(*begin);
+    return func;
+}
+
+/* Counts the elements for which pred returns true. */
+template <typename Iter, typename Pred>
+std::ptrdiff_t count_if(Iter begin, Iter end, Pred pred) {
+    std::ptrdiff_t count = 0;
+    for (; begin != end; ++begin) {
+        if (pred(*begin))
+            ++count;
+    }
+    return count;
+}
+
+/* Writes func(element) for every element to the slice starting at out.
+   out may be begin, to transform in place. Returns the end of the output. */
+template <typename InIter, typename OutIter, typename Func>
+OutIter transform(InIter begin, InIter end, OutIter out, Func func) {
+    for (; begin != end; ++begin, ++out)
+        *out = func(*begin);
+    return out;
+}
+
+/* [begin, end) must be PARTITIONED by pred: every element for which pred is
+   true comes before every element for which it is false. Returns the first
+   element for which pred is false.
+
+   Because of the partition we can binary search, so this takes log(n) calls
+   to pred instead of n. Iter must support it + n and it2 - it1, like a
+   pointer does.
+*/
+template <typename Iter, typename Pred>
+Iter partition_point(Iter begin, Iter end, Pred pred) {
+    std::ptrdiff_t count = end - begin;
+    while (count > 0) {
+        std::ptrdiff_t half = count / 2;
+        Iter middle = begin + half;
+        if (pred(*middle)) {
+            begin = middle + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return begin;
+}
+
+} // namespace algo
+
+#endif /* ALGORITHMS_HPP */
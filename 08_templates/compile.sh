@@ -0,0 +1,11 @@
+#! /bin/bash
+
+set -x
+
+# -O2 matters for this lesson. Without optimization nothing is inlined, and
+# templates look no faster than function pointers.
+# There is no -DNDEBUG, so the spans of span.hpp check every access.
+# instrument.c is C, so it is compiled by gcc
+gcc -O2 -Wall -Werror -c -o instrument.o ../instrument/instrument.c
+g++ -std=c++11 -O2 -Wall -Werror -o templates templates.cpp instrument.o
+rm instrument.o
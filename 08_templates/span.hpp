@@ -0,0 +1,332 @@
+/* A slice as one value: span<T> holds the begin and end pointers of a slice
+   together, and checks every use of them in debug builds.
+
+   Lessons 06 and 07 pass slices around as two separate pointers, and nothing
+   stops a pointer from wandering outside its slice. basic_ptr_arithmetic even
+   does it on purpose:
+
+       char* char_ptr = string;
+       --char_ptr;          // before the start of string: undefined behavior
+
+   A span knows where its slice starts and ends, so it can check:
+
+       algo::span<char> s(string);
+       algo::span<char>::iterator it = s.begin();
+       --it;                // debug build: "span check failed: ptr_ > first_"
+
+   In a debug build (without NDEBUG, like assert) the iterators of a span are
+   CHECKED ITERATORS, which carry the slice's bounds and check every step
+   and every access. That makes them three times bigger and a lot slower.
+   With NDEBUG they are plain pointers, and the checks are gone: code using
+   a span compiles to nearly the same instructions as code using two
+   pointers. span_codegen.sh compares the two. With gcc 12 at -O2 most
+   functions come out the same length, only with operands swapped or
+   instructions in a different order. count_words, which splits a span over
+   and over, is 5 instructions longer, because gcc copies the end of the
+   loop, but its inner loop is the same.
+
+   Define SPAN_CHECKS as 1 or 0 to choose, regardless of NDEBUG. Every file
+   of a program must make the same choice, since span<T>::iterator is a
+   different type in each case.
+*/
+
+#ifndef SPAN_HPP
+#define SPAN_HPP
+
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "algorithms.hpp"
+
+#ifndef SPAN_CHECKS
+#ifdef NDEBUG
+#define SPAN_CHECKS 0
+#else
+#define SPAN_CHECKS 1
+#endif
+#endif
+
+#if SPAN_CHECKS
+#define SPAN_CHECK(condition) \
+    ((condition) ? (void)0 : \
+     algo::span_check_failed(#condition, __FILE__, __LINE__))
+#else
+#define SPAN_CHECK(condition) ((void)0)
+#endif
+
+namespace algo {
+
+[[noreturn]] inline void span_check_failed(char const * condition,
+                                           char const * file, int line) {
+    std::fprintf(stderr, "%s:%d: span check failed: %s\n", file, line,
+                 condition);
+    std::abort();
+}
+
+#if SPAN_CHECKS
+
+/* A pointer that knows the slice [first_, last_) it belongs to. It may point
+   anywhere from first_ to last_, which is one past the end, and be
+   dereferenced anywhere but last_. Just like for a pointer. */
+template <typename T>
+class checked_iterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef typename std::remove_cv<T>::type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef T& reference;
+
+    checked_iterator() : ptr_(nullptr), first_(nullptr), last_(nullptr) {}
+    checked_iterator(T* ptr, T* first, T* last)
+        : ptr_(ptr), first_(first), last_(last) {}
+
+    /* an iterator to T converts to an iterator to const T, like T* does */
+    operator checked_iterator<T const>() const {
+        return checked_iterator<T const>(ptr_, first_, last_);
+    }
+
+    T* get() const { return ptr_; }
+
+    T& operator*() const {
+        SPAN_CHECK(ptr_ >= first_ && ptr_ < last_);
+        return *ptr_;
+    }
+    T* operator->() const { return &**this; }
+    T& operator[](difference_type n) const { return *(*this + n); }
+
+    checked_iterator& operator++() {
+        SPAN_CHECK(ptr_ < last_);
+        ++ptr_;
+        return *this;
+    }
+    checked_iterator& operator--() {
+        SPAN_CHECK(ptr_ > first_);
+        --ptr_;
+        return *this;
+    }
+    checked_iterator operator++(int) {
+        checked_iterator old = *this;
+        ++*this;
+        return old;
+    }
+    checked_iterator operator--(int) {
+        checked_iterator old = *this;
+        --*this;
+        return old;
+    }
+
+    checked_iterator& operator+=(difference_type n) {
+        SPAN_CHECK(n <= last_ - ptr_ && n >= first_ - ptr_);
+        ptr_ += n;
+        return *this;
+    }
+    checked_iterator& operator-=(difference_type n) { return *this += -n; }
+    checked_iterator operator+(difference_type n) const {
+        checked_iterator moved = *this;
+        return moved += n;
+    }
+    checked_iterator operator-(difference_type n) const {
+        checked_iterator moved = *this;
+        return moved -= n;
+    }
+
+    /* Subtracting or comparing pointers into different arrays is undefined
+       too. */
+    difference_type operator-(checked_iterator other) const {
+        SPAN_CHECK(first_ == other.first_);
+        return ptr_ - other.ptr_;
+    }
+    bool operator==(checked_iterator other) const { return ptr_ == other.ptr_; }
+    bool operator!=(checked_iterator other) const { return ptr_ != other.ptr_; }
+    bool operator<(checked_iterator other) const {
+        SPAN_CHECK(first_ == other.first_);
+        return ptr_ < other.ptr_;
+    }
+    bool operator>(checked_iterator other) const { return other < *this; }
+    bool operator<=(checked_iterator other) const { return !(other < *this); }
+    bool operator>=(checked_iterator other) const { return !(*this < other); }
+
+private:
+    T* ptr_;
+    T* first_;
+    T* last_;
+};
+
+template <typename T>
+checked_iterator<T> operator+(std::ptrdiff_t n, checked_iterator<T> it) {
+    return it + n;
+}
+
+template <typename T>
+T* to_pointer(checked_iterator<T> it) {
+    return it.get();
+}
+
+#endif /* SPAN_CHECKS */
+
+/* To hand a span's iterator to a function that wants a plain pointer. */
+template <typename T>
+T* to_pointer(T* ptr) {
+    return ptr;
+}
+
+template <typename T>
+class span {
+public:
+#if SPAN_CHECKS
+    typedef checked_iterator<T> iterator;
+#else
+    typedef T* iterator;
+#endif
+    typedef typename std::remove_cv<T>::type value_type;
+
+    span() : begin_(nullptr), end_(nullptr) {}
+    span(T* begin, T* end) : begin_(begin), end_(end) {
+        SPAN_CHECK(begin <= end);
+    }
+    span(T* data, std::size_t size) : begin_(data), end_(data + size) {}
+
+    /* A whole array. The compiler fills in N. */
+    template <std::size_t N>
+    span(T (&array)[N]) : begin_(array), end_(array + N) {}
+
+    /* span<char> converts to span<char const>, but not the other way. */
+    template <typename U, typename = typename std::enable_if<
+                  std::is_convertible<U (*)[], T (*)[]>::value>::type>
+    span(span<U> other) : begin_(other.data()),
+                          end_(other.data() + other.size()) {}
+
+    iterator begin() const { return make_iterator(begin_); }
+    iterator end() const { return make_iterator(end_); }
+    T* data() const { return begin_; }
+    std::size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+
+    T& operator[](std::size_t i) const {
+        SPAN_CHECK(i < size());
+        return begin_[i];
+    }
+    T& front() const {
+        SPAN_CHECK(!empty());
+        return *begin_;
+    }
+    T& back() const {
+        SPAN_CHECK(!empty());
+        return end_[-1];
+    }
+
+    /* ---- smaller spans of the same slice ---- */
+
+    /* count elements starting at offset */
+    span subspan(std::size_t offset, std::size_t count) const {
+        SPAN_CHECK(offset <= size() && count <= size() - offset);
+        return span(begin_ + offset, begin_ + offset + count);
+    }
+    span first(std::size_t count) const { return subspan(0, count); }
+    span last(std::size_t count) const {
+        SPAN_CHECK(count <= size());
+        return subspan(size() - count, count);
+    }
+
+    /* [it, end) and [begin, it), for an iterator it of this span */
+    span from(iterator it) const { return span(check(it), end_); }
+    span until(iterator it) const { return span(begin_, check(it)); }
+
+    /* [begin, it) and [it, end) */
+    std::pair<span, span> split_at(iterator it) const {
+        return std::make_pair(until(it), from(it));
+    }
+
+    /* The part before the first separator, and the part after it. If there
+       is no separator, the whole span and an empty span at its end. */
+    std::pair<span, span> split(value_type const & separator) const {
+        iterator found = find(separator);
+        if (found == end())
+            return std::make_pair(*this, span(end_, end_));
+        return std::make_pair(until(found), from(found + 1));
+    }
+
+    /* ---- searching ---- */
+
+    iterator find(value_type const & value) const {
+        return algo::find_if(begin(), end(),
+                             [&](value_type const & element) {
+                                 return element == value;
+                             });
+    }
+
+    template <typename Pred>
+    iterator find_if(Pred is_found) const {
+        return algo::find_if(begin(), end(), is_found);
+    }
+
+private:
+    iterator make_iterator(T* ptr) const {
+#if SPAN_CHECKS
+        return iterator(ptr, begin_, end_);
+#else
+        return ptr;
+#endif
+    }
+
+    /* it must belong to this span. Returns it as a pointer. */
+    T* check(iterator it) const {
+        T* ptr = to_pointer(it);
+        SPAN_CHECK(ptr >= begin_ && ptr <= end_);
+        return ptr;
+    }
+
+    T* begin_;
+    T* end_;
+};
+
+/* ---- the algorithms from algorithms.hpp, taking a span ---- */
+
+template <typename T, typename Pred>
+typename span<T>::iterator find_if(span<T> s, Pred is_found) {
+    return algo::find_if(s.begin(), s.end(), is_found);
+}
+
+template <typename T, typename Func>
+Func for_each(span<T> s, Func func) {
+    return algo::for_each(s.begin(), s.end(), func);
+}
+
+template <typename T, typename Pred>
+std::ptrdiff_t count_if(span<T> s, Pred pred) {
+    return algo::count_if(s.begin(), s.end(), pred);
+}
+
+/* ---- the slice functions of lessons 06 and 07, taking a span ----
+
+   C has no overloading, so these can only exist in C++. They do the same
+   as the C versions. */
+
+inline span<char>::iterator find_char(span<char> s, char ch) {
+    return s.find(ch);
+}
+
+inline void capitalize_chars(span<char> s) {
+    for (char& ch : s)
+        ch = std::toupper(ch);
+}
+
+inline span<char>::iterator find_char_if(span<char> s,
+                                         int (*is_found)(int)) {
+    return s.find_if(is_found);
+}
+
+inline void for_each_char(span<char> s, void (*func)(char* char_ptr)) {
+    for (span<char>::iterator it = s.begin(); it != s.end(); ++it)
+        func(&*it);
+}
+
+} // namespace algo
+
+#endif /* SPAN_HPP */
@@ -0,0 +1,97 @@
+/* The same slice functions written twice: with two pointers, as in lessons
+   06 and 07, and with a span. span_codegen.sh compiles this file and
+   compares the machine code of each pair.
+
+   With NDEBUG a span is two pointers in a struct, passed in the same two
+   registers, and its iterators are plain pointers, so each pair should
+   compile to much the same code. With gcc 12 at -O2, third is identical,
+   and find_char, capitalize_chars and sum are the same length, with
+   operands swapped or instructions moved. count_words is 5 instructions
+   longer: gcc copies the end of the loop in span_count_words, though the
+   inner loop that looks for the space is the same. Without NDEBUG the span
+   versions carry the bounds checks, and are longer.
+
+   extern "C" keeps the names short in the disassembly.
+*/
+
+#include <cctype>
+#include <cstddef>
+
+#include "span.hpp"
+
+extern "C" {
+
+/* ---- find_char ---- */
+
+char* raw_find_char(char* begin, char* end, char ch) {
+    for (; begin != end && *begin != ch; ++begin);
+    return begin;
+}
+
+algo::span<char>::iterator span_find_char(algo::span<char> s, char ch) {
+    return algo::find_char(s, ch);
+}
+
+/* ---- capitalize_chars ---- */
+
+void raw_capitalize_chars(char* begin, char* end) {
+    for (; begin != end; ++begin)
+        *begin = std::toupper(*begin);
+}
+
+void span_capitalize_chars(algo::span<char> s) {
+    algo::capitalize_chars(s);
+}
+
+/* ---- summing a slice of ints ---- */
+
+long raw_sum(int const * begin, int const * end) {
+    long sum = 0;
+    for (; begin != end; ++begin)
+        sum += *begin;
+    return sum;
+}
+
+long span_sum(algo::span<int const> s) {
+    long sum = 0;
+    for (int n : s)
+        sum += n;
+    return sum;
+}
+
+/* ---- indexing ---- */
+
+int raw_third(int const * begin, int const * end) {
+    (void)end;
+    return begin[2];
+}
+
+int span_third(algo::span<int const> s) {
+    return s[2];
+}
+
+/* ---- counting words by splitting off one at a time ---- */
+
+std::size_t raw_count_words(char* begin, char* end) {
+    std::size_t count = 0;
+    while (begin != end) {
+        char* space = raw_find_char(begin, end, ' ');
+        if (space != begin)
+            ++count;
+        begin = space == end ? end : space + 1;
+    }
+    return count;
+}
+
+std::size_t span_count_words(algo::span<char> s) {
+    std::size_t count = 0;
+    while (!s.empty()) {
+        std::pair<algo::span<char>, algo::span<char> > parts = s.split(' ');
+        if (!parts.first.empty())
+            ++count;
+        s = parts.second;
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,76 @@
+#! /bin/bash
+
+# Shows what span costs. Compiles span_codegen.cpp with -O2 -DNDEBUG,
+# disassembles it, and compares the machine code of each raw_NAME function
+# with that of span_NAME. Then does the same without NDEBUG, where the span
+# versions do bounds checks.
+#
+# Usage:
+#
+#   ./span_codegen.sh [-d] [extra compiler flags, e.g. -O3]
+#
+# -d prints the disassembly of every pair that isn't identical, side by
+# side.
+#
+# "identical" means the very same instructions. Often gcc writes the same
+# loop with the operands of a cmp swapped, or a mov in a different place.
+# That is no slower, and shows up as a pair of the same length. A span
+# version that is longer does extra work.
+
+set -e
+
+show_diff=0
+if [ "$1" = "-d" ]; then
+    show_diff=1
+    shift
+fi
+
+functions=(find_char capitalize_chars sum third count_words)
+
+# Prints the instructions of function $2 in the disassembly $1, without
+# addresses, so two functions can be compared. Jumps name their target as
+# <function+offset>, of which only the offset is kept.
+instructions() {
+    awk -v name="$2" '
+        /^[0-9a-f]+ <.*>:$/ { inside = ($2 == "<" name ">:"); next }
+        inside && NF == 0   { inside = 0 }
+        inside && /\tnop/   { next }
+        inside {
+            sub(/^ *[0-9a-f]+:\t/, "")
+            gsub(/[0-9a-f]+ <[a-z_]+\+/, "<+")
+            gsub(/[0-9a-f]+ <[a-z_]+>/, "<>")
+            print
+        }' "$1"
+}
+
+compare() {
+    (set -x; g++ -std=c++11 -O2 "$@" -Wall -Werror -c \
+        -o span_codegen.o span_codegen.cpp)
+    objdump -d --no-show-raw-insn span_codegen.o > span_codegen.txt
+    rm span_codegen.o
+
+    for name in "${functions[@]}"; do
+        instructions span_codegen.txt "raw_$name" > raw.txt
+        instructions span_codegen.txt "span_$name" > span.txt
+        raw_count=$(wc -l < raw.txt)
+        span_count=$(wc -l < span.txt)
+        if cmp -s raw.txt span.txt; then
+            result="identical"
+        elif [ "$raw_count" -eq "$span_count" ]; then
+            result="same length"
+        else
+            result="$((span_count - raw_count)) more"
+        fi
+        printf "  %-18s raw %3d instructions   span %3d   %s\n" \
+            "$name" "$raw_count" "$span_count" "$result"
+        if [ $show_diff -eq 1 ] && [ "$result" != "identical" ]; then
+            diff -y -W 80 raw.txt span.txt || true
+        fi
+    done
+    rm raw.txt span.txt span_codegen.txt
+}
+
+echo "without checks (NDEBUG):"
+compare -DNDEBUG "$@"
+echo "with checks:"
+compare "$@"
@@ -0,0 +1,267 @@
+/*
+   At the end of the last lesson we ran into two limitations of C's higher
+   order functions:
+
+   1. for_each_char and find_char_if only work on chars.
+   2. They always call their function argument through a pointer.
+
+   C++ FUNCTION TEMPLATES fix both. algorithms.hpp has template versions of
+   find_if, for_each, count_if, transform and partition_point. This lesson
+   shows how to use them, and measures how much faster they are than the
+   function pointer versions.
+*/
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "algorithms.hpp"
+#include "span.hpp"
+
+#include "../instrument/instrument.h"
+
+/* A template is used just like a normal function. The compiler looks at the
+   argument types and writes the matching version for us. This is called
+   INSTANTIATING the template.
+*/
+
+void using_templates_with_many_types() {
+    std::puts(__func__);
+
+    char string[] = "A string full of words and 1 number.";
+    char* begin = string;
+    char* end = string + std::strlen(string);
+
+    /* An instance for char* and a function pointer, just like find_char_if. */
+    std::printf("Found first digit: %c\n", *algo::find_if(begin, end, isdigit));
+
+    /* The same template, instantiated for int* and a LAMBDA. The lambda is
+       written right where it is used, which we wished we could do in C. */
+    int numbers[] = {3, 8, 12, 7, 20};
+    int* found = algo::find_if(numbers, numbers + 5,
+                               [](int n) { return n > 10; });
+    std::printf("Found first number over 10: %d\n", *found);
+
+    /* Lambdas can also use local variables. The [&] means "capture local
+       variables by reference". */
+    int limit = 5;
+    std::printf("Numbers over %d: %d\n", limit,
+                (int)algo::count_if(numbers, numbers + 5,
+                                    [&](int n) { return n > limit; }));
+
+    /* capitalize_chars, without a separate cap_char function */
+    algo::for_each(begin, end, [](char& ch) { ch = std::toupper(ch); });
+    std::puts(string);
+
+    /* transform writes its results to a second slice */
+    int squares[5];
+    algo::transform(numbers, numbers + 5, squares, [](int n) { return n * n; });
+    for (int square : squares)
+        std::printf("%d ", square);
+    std::puts("");
+
+    /* partition_point needs a partitioned slice. A sorted slice is
+       partitioned by "less than x" for any x. */
+    int sorted[] = {1, 3, 5, 7, 9, 11};
+    int* first_big = algo::partition_point(sorted, sorted + 6,
+                                           [](int n) { return n < 6; });
+    std::printf("First number not less than 6: %d\n", *first_big);
+}
+
+/* A CLASS TEMPLATE works the same way. span.hpp has algo::span<T>, which
+   keeps the two pointers of a slice together, and checks them in debug
+   builds. The slice functions from lessons 06 and 07 have overloads that
+   take a span.
+*/
+
+void using_spans() {
+    std::puts(__func__);
+
+    char string[] = "foo bar spam eggs";
+    /* the whole array, without its terminating '\0' */
+    algo::span<char> all = algo::span<char>(string).first(std::strlen(string));
+
+    /* find_char returns an iterator of the span */
+    algo::span<char>::iterator space = algo::find_char(all, ' ');
+    algo::span<char> foo = all.until(space);
+    std::printf("First word: %.*s\n", (int)foo.size(), foo.data());
+
+    /* split takes one word off the front, so this visits every word */
+    for (algo::span<char> rest = all; !rest.empty();) {
+        std::pair<algo::span<char>, algo::span<char> > parts = rest.split(' ');
+        std::printf("[%.*s] ", (int)parts.first.size(), parts.first.data());
+        rest = parts.second;
+    }
+    std::puts("");
+
+    /* capitalize "bar", like demonstrate_slicing did in lesson 06 */
+    algo::capitalize_chars(all.subspan(4, 3));
+    std::puts(string);
+
+    /* The algorithms from algorithms.hpp take a span instead of two
+       pointers. A span<int> converts to a span<int const>. */
+    int numbers[] = {3, 8, 12, 7, 20};
+    algo::span<int> span_of_numbers(numbers);
+    algo::span<int const> read_only = span_of_numbers;
+    std::printf("Numbers over 5: %d, last: %d\n",
+                (int)algo::count_if(read_only, [](int n) { return n > 5; }),
+                read_only.back());
+
+    /* In a debug build, going outside the span stops the program with a
+       message, instead of being undefined behavior:
+
+           span_of_numbers[5];     // span check failed: i < size()
+           all.subspan(10, 20);    // span check failed: offset <= size() && ...
+
+           algo::span<int>::iterator it = span_of_numbers.begin();
+           --it;                   // span check failed: ptr_ > first_
+    */
+}
+
+/* Why are templates faster?
+
+   When find_char_if calls is_found through a function pointer, the compiler
+   does not know which function it will be. So it has to:
+   1. do a real call for every element, saving and restoring registers,
+   2. assume the call could read or write any memory,
+   3. check one element per loop iteration.
+
+   When algo::find_if is instantiated with a lambda, every lambda has its own
+   type, so the compiler knows exactly which code runs. It inlines it, and can
+   then often make the loop handle several elements per iteration.
+
+   To compare fairly, these are the C versions from lesson 07 (plus an int
+   version). noinline stops gcc from cheating by inlining them here. In a real
+   C program they would usually live in another .c file, like qsort lives in
+   the C library, and could not be inlined either.
+*/
+
+typedef int (*unary_pred)(int);
+typedef void (*unary_func)(char* char_ptr);
+typedef void (*unary_int_func)(int* int_ptr);
+
+__attribute__((noinline))
+char* find_char_if(char* begin, char* end, unary_pred is_found) {
+    for (; begin != end && !is_found(*begin); ++begin);
+    return begin;
+}
+
+__attribute__((noinline))
+int* find_int_if(int* begin, int* end, unary_pred is_found) {
+    for (; begin != end && !is_found(*begin); ++begin);
+    return begin;
+}
+
+__attribute__((noinline))
+void for_each_char(char* begin, char* end, unary_func func) {
+    for (; begin != end; ++begin)
+        func(begin);
+}
+
+__attribute__((noinline))
+void for_each_int(int* begin, int* end, unary_int_func func) {
+    for (; begin != end; ++begin)
+        func(begin);
+}
+
+int is_negative(int n) {
+    return n < 0;
+}
+
+void cap_char(char* char_ptr) {
+    *char_ptr = std::toupper(*char_ptr);
+}
+
+void double_int(int* int_ptr) {
+    *int_ptr *= 2;
+}
+
+/* A tiny stopwatch. steady_clock never jumps backwards, unlike the wall
+   clock. */
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void print_times(char const * what, double pointer_time, double template_time) {
+    std::printf("%-22s function pointer %7.3f s   template %7.3f s   %5.1fx\n",
+                what, pointer_time, template_time, pointer_time / template_time);
+}
+
+void compare_with_function_pointers(std::size_t count) {
+    std::puts(__func__);
+    std::printf("%zu elements\n", count);
+
+    /* find_if over a slice with no match, so every element is looked at */
+    std::vector<int> ints(count, 1);
+    std::vector<char> chars(count, 'x');
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int* int_found = find_int_if(ints.data(), ints.data() + count, is_negative);
+    double pointer_time = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    int* int_found2 = algo::find_if(ints.data(), ints.data() + count,
+                                    [](int n) { return n < 0; });
+    print_times("find_if int", pointer_time, seconds_since(start));
+
+    start = std::chrono::steady_clock::now();
+    char* char_found = find_char_if(chars.data(), chars.data() + count, isdigit);
+    pointer_time = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    char* char_found2 = algo::find_if(chars.data(), chars.data() + count,
+                                      [](char ch) { return ch >= '0' && ch <= '9'; });
+    print_times("find_if char", pointer_time, seconds_since(start));
+
+    /* for_each that modifies every element */
+    start = std::chrono::steady_clock::now();
+    for_each_int(ints.data(), ints.data() + count, double_int);
+    pointer_time = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    algo::for_each(ints.data(), ints.data() + count, [](int& n) { n *= 2; });
+    print_times("for_each int", pointer_time, seconds_since(start));
+
+    start = std::chrono::steady_clock::now();
+    for_each_char(chars.data(), chars.data() + count, cap_char);
+    pointer_time = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    algo::for_each(chars.data(), chars.data() + count, [](char& ch) {
+        if (ch >= 'a' && ch <= 'z')
+            ch -= 'a' - 'A';
+    });
+    print_times("for_each char", pointer_time, seconds_since(start));
+
+    /* use the results, so the compiler cannot skip the work */
+    if (int_found != int_found2 || char_found != char_found2 ||
+        ints[count / 2] != 4 || chars[count / 2] != 'X')
+        std::puts("results differ!");
+}
+
+/* NOTE: the lambda in the char for_each is not exactly cap_char. toupper
+   depends on the LOCALE, and the compiler cannot see inside it. Writing the
+   ASCII rule out lets the compiler vectorize the loop. In the default "C"
+   locale both give the same answer.
+*/
+
+int main(int argc, char* argv[]) {
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(using_templates_with_many_types());
+    INSTRUMENTED(using_spans());
+
+    /* The number of elements can be passed on the command line. */
+    std::size_t count = 100000000;
+    if (argc > 1)
+        count = std::strtoul(argv[1], NULL, 10);
+    /* 0 skips the comparison, which checks the middle element */
+    if (count > 0)
+        INSTRUMENTED(compare_with_function_pointers(count));
+
+    return 0;
+}
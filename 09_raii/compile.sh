@@ -0,0 +1,8 @@
+#! /bin/bash
+
+set -x
+
+# instrument.c is C, so it is compiled by gcc
+gcc -O2 -Wall -Werror -c -o instrument.o ../instrument/instrument.c
+g++ -std=c++11 -O2 -Wall -Werror -o raii raii.cpp instrument.o
+rm instrument.o
@@ -0,0 +1,325 @@
+/*
+   In lesson 05 we saw the C pattern:
+
+       record_t* bob = make_record(48, 72);
+       function_that_fails(bob);
+       free(bob);
+
+   and that in C++ it leaks bob if function_that_fails throws an exception.
+
+   This lesson fixes that with RAII. The record is owned by an object, a
+   unique_handle (see unique_handle.hpp), whose destructor frees it. C++ always
+   runs destructors of local variables when leaving a scope, whether by return
+   or by exception, so the free can't be skipped.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+#include "small_vector.hpp"
+#include "unique_handle.hpp"
+
+#include "../instrument/instrument.h"
+
+struct record_t {
+    int age;
+    int height; /* in inches */
+};
+
+typedef unique_handle<record_t> unique_record;
+
+/* The handle costs nothing in size: it is just the pointer. */
+static_assert(sizeof(unique_record) == sizeof(record_t*),
+              "unique_record must be the size of a raw pointer");
+
+/* make_record from lesson 05, but returning a unique_record. Returning it BY
+   VALUE moves ownership out to the caller; nothing is copied.
+
+   Instead of printing a message and calling exit, we throw std::bad_alloc,
+   which is what new does when out of memory.
+*/
+unique_record make_unique_record(int age, int height) {
+    record_t* rec = (record_t*)std::malloc(sizeof(record_t));
+    if (rec == nullptr)
+        throw std::bad_alloc();
+    rec->age = age;
+    rec->height = height;
+    return unique_record(rec);
+}
+
+void function_that_fails(record_t& rec) {
+    /* this time it really does throw */
+    throw std::runtime_error("function_that_fails failed");
+}
+
+void exception_example() {
+    std::puts(__func__);
+    try {
+        unique_record bob = make_unique_record(48, 72);
+        function_that_fails(*bob);
+        /* no free needed here, or anywhere */
+    } catch (std::runtime_error const & error) {
+        /* bob has already been freed by the time we get here */
+        std::printf("caught: %s\n", error.what());
+    }
+}
+
+/* Passing ownership around. A function that takes a unique_record by value
+   becomes the new owner, and the caller must say so with std::move. */
+
+void take_ownership(unique_record rec) {
+    std::printf("now own a record aged %d\n", rec->age);
+    /* freed here */
+}
+
+void moving_ownership() {
+    std::puts(__func__);
+    unique_record bob = make_unique_record(48, 72);
+
+    /* take_ownership(bob); would not compile: that would be a copy. */
+    take_ownership(std::move(bob));
+
+    /* bob is now empty, so it will not be freed twice */
+    std::printf("bob is %s\n", bob ? "still here" : "empty");
+}
+
+/* The deleter can also be a plain function. A FILE* from fopen is freed with
+   fclose, so a function pointer to fclose makes a handle that closes the file.
+   A function pointer can't be an empty base, so this handle holds two
+   pointers: the FILE* and &fclose.
+*/
+typedef unique_handle<std::FILE, int (*)(std::FILE*)> unique_file;
+
+static_assert(sizeof(unique_file) == 2 * sizeof(void*),
+              "unique_file stores the function pointer next to the FILE*");
+
+/* A deleter class declared final can't be a base class either, so it is
+   stored as a member too, even though it has no data. */
+struct final_free_deleter final {
+    void operator()(void* ptr) const {
+        std::free(ptr);
+    }
+};
+
+static_assert(sizeof(unique_handle<record_t, final_free_deleter>) >
+                  sizeof(record_t*),
+              "a final deleter is stored as a member");
+
+void other_deleters() {
+    std::puts(__func__);
+    unique_file file(std::tmpfile(), &std::fclose);
+    if (!file) {
+        std::puts("tmpfile failed");
+        return;
+    }
+    std::fputs("closed by unique_file\n", file.get());
+    std::printf("wrote %ld bytes\n", std::ftell(file.get()));
+
+    unique_handle<record_t, final_free_deleter> rec(
+        (record_t*)std::malloc(sizeof(record_t)));
+    std::printf("final deleter record is %s\n", rec ? "allocated" : "empty");
+    /* both are freed here: fclose(file), then free(rec) */
+}
+
+/* Records don't have to come from malloc. Here is an allocator that counts
+   how many records are live, which lets us check that nothing leaks. A
+   unique_handle with an allocator_deleter gives the record back to whichever
+   allocator it came from.
+*/
+
+class counting_allocator {
+public:
+    counting_allocator() : live_(0) {}
+
+    record_t* allocate() {
+        record_t* rec = (record_t*)std::malloc(sizeof(record_t));
+        if (rec == nullptr)
+            throw std::bad_alloc();
+        ++live_;
+        return rec;
+    }
+
+    void deallocate(record_t* rec) {
+        --live_;
+        std::free(rec);
+    }
+
+    long live() const { return live_; }
+
+private:
+    long live_;
+};
+
+typedef unique_handle<record_t, allocator_deleter<counting_allocator> >
+    counted_record;
+
+template <typename Allocator>
+unique_handle<record_t, allocator_deleter<Allocator> >
+make_record_in(Allocator& allocator, int age, int height) {
+    record_t* rec = allocator.allocate();
+    rec->age = age;
+    rec->height = height;
+    allocator_deleter<Allocator> deleter = {&allocator};
+    return unique_handle<record_t, allocator_deleter<Allocator> >(rec, deleter);
+}
+
+void sometimes_fails(record_t& rec) {
+    if (rec.age % 7 == 0)
+        throw std::runtime_error("age divisible by 7");
+}
+
+void exceptions_on_the_hot_path() {
+    std::puts(__func__);
+    counting_allocator allocator;
+    int caught = 0;
+
+    for (int i = 0; i < 100000; ++i) {
+        try {
+            counted_record rec = make_record_in(allocator, i, 70);
+            counted_record moved = std::move(rec);
+            sometimes_fails(*moved);
+        } catch (std::runtime_error const &) {
+            ++caught;
+        }
+    }
+
+    std::printf("%d exceptions, %ld records leaked\n", caught, allocator.live());
+}
+
+/* Arrays can own their memory too. small_vector (see small_vector.hpp)
+   replaces the fixed stack arrays and VLAs of lesson 05: it starts out
+   inside itself, like a stack array, and moves to the heap when it grows.
+
+   This allocator prints what it does, so we can see when that happens.
+*/
+
+struct logging_allocator {
+    void* allocate(std::size_t bytes) {
+        std::printf("  allocate %zu bytes\n", bytes);
+        return std::malloc(bytes);
+    }
+
+    void* reallocate(void* ptr, std::size_t old_bytes, std::size_t new_bytes) {
+        std::printf("  reallocate %zu -> %zu bytes\n", old_bytes, new_bytes);
+        return std::realloc(ptr, new_bytes);
+    }
+
+    void deallocate(void* ptr, std::size_t bytes) {
+        std::printf("  deallocate %zu bytes\n", bytes);
+        std::free(ptr);
+    }
+};
+
+void using_small_vector() {
+    std::puts(__func__);
+    {
+        /* room for 4 ints inside, then 8, 16, 32 on the heap */
+        small_vector<int, 4, logging_allocator> squares;
+        std::size_t capacity = squares.capacity();
+        for (int i = 0; i < 20; ++i) {
+            squares.push_back(i * i);
+            if (squares.capacity() != capacity) {
+                capacity = squares.capacity();
+                std::printf("size %zu, capacity %zu\n", squares.size(),
+                            capacity);
+            }
+        }
+        std::printf("last square: %d\n", squares.back());
+        /* the heap array is freed here */
+    }
+
+    /* int array[size] with 10 million ints would need 40 MB of stack, and
+       the stack is usually 8 MB. */
+    small_vector<int, 16> big;
+    big.resize(10000000);
+    std::printf("%zu ints, %s\n", big.size(),
+                big.is_inline() ? "inline" : "on the heap");
+
+    /* More ints than fit in memory at all can't be asked for: the size in
+       bytes would overflow. reserve throws before anything is allocated. */
+    try {
+        big.reserve(big.max_size() + 1);
+    } catch (std::length_error const & error) {
+        std::printf("caught: %s\n", error.what());
+    }
+
+    /* unique_records can't simply be realloc'ed, their move constructor
+       must run. It moves the pointers, so every record is still owned
+       exactly once. */
+    small_vector<unique_record, 2> records;
+    for (int age = 40; age < 45; ++age)
+        records.push_back(make_unique_record(age, 70));
+    for (unique_record const & rec : records)
+        std::printf("%d ", rec->age);
+    std::puts("");
+}
+
+/* Does RAII cost anything at run time? The handle is one pointer, and its
+   member functions are all inline, so the compiler should produce the same
+   code as for the raw pointer version. We time both to check.
+
+   noinline keeps the compiler from merging the loops into the caller.
+*/
+
+__attribute__((noinline))
+long raw_pointer_loop(int count) {
+    long total = 0;
+    for (int i = 0; i < count; ++i) {
+        record_t* rec = (record_t*)std::malloc(sizeof(record_t));
+        if (rec == nullptr)
+            throw std::bad_alloc();
+        rec->age = i;
+        rec->height = 70;
+        total += rec->age + rec->height;
+        std::free(rec);
+    }
+    return total;
+}
+
+__attribute__((noinline))
+long unique_record_loop(int count) {
+    long total = 0;
+    for (int i = 0; i < count; ++i) {
+        unique_record rec = make_unique_record(i, 70);
+        total += rec->age + rec->height;
+    }
+    return total;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void compare_with_raw_pointers() {
+    std::puts(__func__);
+    int const count = 10000000;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long raw_total = raw_pointer_loop(count);
+    double raw_time = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    long raii_total = unique_record_loop(count);
+    double raii_time = seconds_since(start);
+
+    std::printf("raw pointer   %.3f s\nunique_record %.3f s\n", raw_time,
+                raii_time);
+    if (raw_total != raii_total)
+        std::puts("results differ!");
+}
+
+int main(int argc, char* argv[]) {
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(exception_example());
+    INSTRUMENTED(moving_ownership());
+    INSTRUMENTED(other_deleters());
+    INSTRUMENTED(exceptions_on_the_hot_path());
+    INSTRUMENTED(using_small_vector());
+    INSTRUMENTED(compare_with_raw_pointers());
+    return 0;
+}
@@ -0,0 +1,328 @@
+/* small_vector: a growable array that keeps short arrays inside itself,
+   instead of on the heap. */
+
+#ifndef SMALL_VECTOR_HPP
+#define SMALL_VECTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/* Lesson 05 had two kinds of arrays on the stack:
+
+       int array[5];        fixed size, can't grow
+       int array[size];     a VLA: any size, but only decided once, and a big
+                            size overflows the stack and crashes
+
+   small_vector<T, N> owns an array that grows as elements are added, like
+   std::vector. It has room for N elements INSIDE itself, so while there are
+   at most N elements it is as cheap as a stack array: no malloc, no free,
+   and the elements sit right next to the other local variables, in the
+   cache. Only when it outgrows that room does it move to the heap.
+
+   Growing is GEOMETRIC: when the array is full, its capacity doubles. Each
+   time it grows, every element is moved, but after moving n elements there
+   is room for n more, so on average each push_back moves at most one
+   element: pushing n elements costs O(n), not O(n^2). If the final size is
+   known, reserve makes room for it up front and nothing moves at all.
+
+   Moving the elements is called RELOCATING them. In general each element is
+   move-constructed into the new array and the old one destroyed. But if T is
+   TRIVIALLY COPYABLE (int, record_t, anything C could have), its bytes are
+   all there is to it, and the heap array can be grown with realloc. realloc
+   can often just extend the block where it is, and copy nothing.
+
+   Like unique_handle, a small_vector cleans up after itself: its destructor
+   destroys the elements and frees the heap array. It can be moved, which
+   steals the heap array, and copied, which copies the elements.
+*/
+
+/* An Allocator says WHERE the heap array comes from. It needs these three
+   member functions, which work in bytes and return nullptr on failure, like
+   malloc does. Like malloc, it must return memory aligned for any type
+   (alignof(std::max_align_t)). This one uses malloc itself.
+*/
+struct malloc_allocator {
+    void* allocate(std::size_t bytes) {
+        return std::malloc(bytes);
+    }
+
+    /* Grows or shrinks a block from allocate, keeping its first old_bytes
+       bytes. Only used for trivially copyable elements. */
+    void* reallocate(void* ptr, std::size_t old_bytes, std::size_t new_bytes) {
+        (void)old_bytes;
+        return std::realloc(ptr, new_bytes);
+    }
+
+    void deallocate(void* ptr, std::size_t bytes) {
+        (void)bytes;
+        std::free(ptr);
+    }
+};
+
+/* small_vector derives from Allocator for the same reason unique_handle
+   derives from an empty Deleter: the EMPTY BASE OPTIMIZATION makes an
+   allocator without data members, like malloc_allocator, take no space.
+
+   N may be 0, for a vector that always uses the heap, like std::vector.
+*/
+template <typename T, std::size_t N, typename Allocator = malloc_allocator>
+class small_vector : private Allocator {
+    /* The allocator only promises malloc's alignment, so an over-aligned T,
+       such as a struct declared alignas(64), can't be kept on the heap. */
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "small_vector can't hold over-aligned types");
+
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef T const * const_iterator;
+
+    static const std::size_t inline_capacity = N;
+
+    explicit small_vector(Allocator allocator = Allocator())
+        : Allocator(allocator), begin_(inline_data()), size_(0),
+          capacity_(N) {}
+
+    ~small_vector() {
+        clear();
+        free_heap();
+    }
+
+    small_vector(small_vector const & other)
+        : Allocator(other.get_allocator()), begin_(inline_data()), size_(0),
+          capacity_(N) {
+        reserve(other.size_);
+        for (T const & element : other)
+            push_back(element);
+    }
+
+    small_vector& operator=(small_vector const & other) {
+        if (this != &other) {
+            clear();
+            reserve(other.size_);
+            for (T const & element : other)
+                push_back(element);
+        }
+        return *this;
+    }
+
+    small_vector(small_vector&& other)
+        noexcept(std::is_nothrow_move_constructible<T>::value)
+        : Allocator(std::move(other.get_allocator())), begin_(inline_data()),
+          size_(0), capacity_(N) {
+        take(other);
+    }
+
+    small_vector& operator=(small_vector&& other)
+        noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (this != &other) {
+            clear();
+            free_heap();
+            get_allocator() = std::move(other.get_allocator());
+            take(other);
+        }
+        return *this;
+    }
+
+    T* data() { return begin_; }
+    T const * data() const { return begin_; }
+    iterator begin() { return begin_; }
+    iterator end() { return begin_ + size_; }
+    const_iterator begin() const { return begin_; }
+    const_iterator end() const { return begin_ + size_; }
+
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return capacity_; }
+
+    /* The most elements whose size in bytes fits in a std::size_t. */
+    static std::size_t max_size() { return SIZE_MAX / sizeof(T); }
+    bool empty() const { return size_ == 0; }
+
+    /* true while the elements are inside the small_vector itself */
+    bool is_inline() const { return begin_ == inline_data(); }
+
+    T& operator[](std::size_t i) { return begin_[i]; }
+    T const & operator[](std::size_t i) const { return begin_[i]; }
+    T& front() { return begin_[0]; }
+    T& back() { return begin_[size_ - 1]; }
+
+    Allocator& get_allocator() { return *this; }
+    Allocator const & get_allocator() const { return *this; }
+
+    /* Makes room for at least capacity elements. Throws std::bad_alloc if
+       the allocator fails, or std::length_error if capacity is more than
+       max_size(), and then the vector is unchanged. */
+    void reserve(std::size_t capacity) {
+        if (capacity > capacity_)
+            relocate(capacity);
+    }
+
+    /* Constructs an element at the end from args. */
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == capacity_)
+            return emplace_back_growing(std::forward<Args>(args)...);
+        T* element = new (begin_ + size_) T(std::forward<Args>(args)...);
+        ++size_;
+        return *element;
+    }
+
+    void push_back(T const & value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() {
+        --size_;
+        begin_[size_].~T();
+    }
+
+    /* Adds default constructed elements, or destroys elements at the end,
+       until there are size. */
+    void resize(std::size_t size) {
+        reserve(size);
+        while (size_ < size)
+            emplace_back();
+        while (size_ > size)
+            pop_back();
+    }
+
+    /* Destroys the elements. The capacity stays. */
+    void clear() {
+        destroy(begin_, begin_ + size_);
+        size_ = 0;
+    }
+
+private:
+    /* The room for N elements, uninitialized: elements are constructed in it
+       with placement new only as they are added. */
+    typedef typename std::aligned_storage<
+        sizeof(T) * (N > 0 ? N : 1), alignof(T)>::type inline_storage;
+
+    T* inline_data() { return reinterpret_cast<T*>(&inline_); }
+    T const * inline_data() const {
+        return reinterpret_cast<T const *>(&inline_);
+    }
+
+    static void destroy(T* begin, T* end) {
+        for (; begin != end; ++begin)
+            begin->~T();
+    }
+
+    /* The slow path of emplace_back, kept out of line so the fast path
+       stays small enough to inline everywhere. The new element is built
+       first, because args may refer to an element of this very vector,
+       which relocating would move away. */
+    template <typename... Args>
+    __attribute__((noinline))
+    T& emplace_back_growing(Args&&... args) {
+        T value(std::forward<Args>(args)...);
+        if (capacity_ == max_size())
+            throw std::length_error("small_vector is full");
+        /* doubling stops at max_size(), instead of overflowing */
+        relocate(capacity_ == 0 ? 1
+                 : capacity_ > max_size() / 2 ? max_size() : 2 * capacity_);
+        T* element = new (begin_ + size_) T(std::move(value));
+        ++size_;
+        return *element;
+    }
+
+    /* Moves the elements to an array with room for capacity elements, which
+       is never the inline one. Every heap array is made here, so this is
+       where capacity * sizeof(T) is checked for overflow: without the
+       check, a huge capacity would wrap around to a small number of bytes,
+       and the elements would be written past the end of the array. */
+    void relocate(std::size_t capacity) {
+        if (capacity > max_size())
+            throw std::length_error("small_vector capacity too large");
+        T* moved;
+        if (std::is_trivially_copyable<T>::value) {
+            if (is_inline()) {
+                moved = allocate(capacity);
+                if (size_ > 0)
+                    std::memcpy(static_cast<void*>(moved), begin_,
+                                size_ * sizeof(T));
+            } else {
+                moved = static_cast<T*>(get_allocator().reallocate(
+                    begin_, capacity_ * sizeof(T), capacity * sizeof(T)));
+                if (moved == nullptr)
+                    throw std::bad_alloc();
+            }
+        } else if (std::is_nothrow_move_constructible<T>::value) {
+            /* Each element is destroyed right after it is moved, while it is
+               still in the cache. The loop uses local pointers, not begin_
+               and size_: T's move constructor writes to memory, and unless
+               the compiler can see it doesn't write to begin_ or size_, it
+               reloads them for every element. For std::string that made
+               growing twice as slow. */
+            moved = allocate(capacity);
+            T* end = begin_ + size_;
+            for (T* from = begin_, * to = moved; from != end; ++from, ++to) {
+                new (to) T(std::move(*from));
+                from->~T();
+            }
+            free_heap();
+        } else {
+            /* T's move constructor can throw, so copy instead: if a copy
+               throws, the old elements are still intact. */
+            moved = allocate(capacity);
+            T* end = begin_ + size_;
+            T* to = moved;
+            try {
+                for (T* from = begin_; from != end; ++from, ++to)
+                    new (to) T(std::move_if_noexcept(*from));
+            } catch (...) {
+                destroy(moved, to);
+                get_allocator().deallocate(moved, capacity * sizeof(T));
+                throw;
+            }
+            destroy(begin_, end);
+            free_heap();
+        }
+        begin_ = moved;
+        capacity_ = capacity;
+    }
+
+    T* allocate(std::size_t capacity) {
+        void* memory = get_allocator().allocate(capacity * sizeof(T));
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T*>(memory);
+    }
+
+    void free_heap() {
+        if (!is_inline())
+            get_allocator().deallocate(begin_, capacity_ * sizeof(T));
+        begin_ = inline_data();
+        capacity_ = N;
+    }
+
+    /* The elements of other become ours, and other is left empty. We must
+       be empty and inline. A heap array is simply taken over, inline
+       elements have to be moved one by one. */
+    void take(small_vector& other) {
+        if (other.is_inline()) {
+            for (T& element : other)
+                new (begin_ + size_++) T(std::move(element));
+            other.clear();
+        } else {
+            begin_ = other.begin_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.begin_ = other.inline_data();
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+    }
+
+    T* begin_;
+    std::size_t size_;
+    std::size_t capacity_;
+    inline_storage inline_;
+};
+
+#endif /* SMALL_VECTOR_HPP */
@@ -0,0 +1,132 @@
+/* unique_handle: a pointer that owns what it points to, and frees it
+   automatically. */
+
+#ifndef UNIQUE_HANDLE_HPP
+#define UNIQUE_HANDLE_HPP
+
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+/* A Deleter says HOW to free the object. It is anything that can be called
+   as deleter(ptr): a class with an operator(), like this one, which calls
+   free for memory that came from malloc, or a plain function pointer, such as
+   int (*)(FILE*) holding fclose.
+*/
+struct free_deleter {
+    void operator()(void* ptr) const {
+        std::free(ptr);
+    }
+};
+
+/* This one hands the object back to any allocator object with a
+   deallocate(T*) member function. */
+template <typename Allocator>
+struct allocator_deleter {
+    Allocator* allocator;
+
+    template <typename T>
+    void operator()(T* ptr) const {
+        allocator->deallocate(ptr);
+    }
+};
+
+/* unique_handle<T, Deleter> owns a T*. When the handle is destroyed, because
+   it goes out of scope, or because an exception passes through, it calls the
+   deleter on the pointer. This is RAII: Resource Acquisition Is
+   Initialization.
+
+   There must only ever be ONE owner, so a unique_handle cannot be copied.
+   Ownership can be MOVED to another handle with std::move, which leaves the
+   old handle empty.
+
+   If Deleter is a class with no data members, like free_deleter,
+   unique_handle derives from it instead of storing it as a member. The EMPTY
+   BASE OPTIMIZATION then makes it take up no space at all, so the handle is
+   exactly the size of a raw pointer. (This is the same thing std::unique_ptr
+   does.) A function pointer can't be a base class, and neither can a class
+   declared final, so those are stored as an ordinary member, and cost their
+   own size.
+*/
+
+/* deleter_storage picks between the two. The true version is the base class
+   trick; the false version is the plain member. (std::is_final only arrived
+   in C++14, so this uses the compiler builtin that it is built on.) */
+template <typename Deleter,
+          bool derive = std::is_empty<Deleter>::value && !__is_final(Deleter)>
+class deleter_storage : private Deleter {
+public:
+    explicit deleter_storage(Deleter deleter) : Deleter(std::move(deleter)) {}
+
+    Deleter& get_deleter() { return *this; }
+    Deleter const & get_deleter() const { return *this; }
+};
+
+template <typename Deleter>
+class deleter_storage<Deleter, false> {
+public:
+    explicit deleter_storage(Deleter deleter) : deleter_(std::move(deleter)) {}
+
+    Deleter& get_deleter() { return deleter_; }
+    Deleter const & get_deleter() const { return deleter_; }
+
+private:
+    Deleter deleter_;
+};
+
+template <typename T, typename Deleter = free_deleter>
+class unique_handle : private deleter_storage<Deleter> {
+    typedef deleter_storage<Deleter> storage;
+
+public:
+    unique_handle() : storage(Deleter()), ptr_(nullptr) {}
+
+    explicit unique_handle(T* ptr, Deleter deleter = Deleter())
+        : storage(std::move(deleter)), ptr_(ptr) {}
+
+    ~unique_handle() {
+        if (ptr_ != nullptr)
+            get_deleter()(ptr_);
+    }
+
+    /* no copying */
+    unique_handle(unique_handle const &) = delete;
+    unique_handle& operator=(unique_handle const &) = delete;
+
+    /* moving takes the pointer, and leaves other empty */
+    unique_handle(unique_handle&& other) noexcept
+        : storage(std::move(other.get_deleter())), ptr_(other.release()) {}
+
+    unique_handle& operator=(unique_handle&& other) noexcept {
+        reset(other.release());
+        get_deleter() = std::move(other.get_deleter());
+        return *this;
+    }
+
+    T* get() const { return ptr_; }
+    T& operator*() const { return *ptr_; }
+    T* operator->() const { return ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+    using storage::get_deleter;
+
+    /* gives up ownership without freeing, and returns the pointer */
+    T* release() {
+        T* ptr = ptr_;
+        ptr_ = nullptr;
+        return ptr;
+    }
+
+    /* frees the current object, if any, and takes ownership of ptr */
+    void reset(T* ptr = nullptr) {
+        T* old = ptr_;
+        ptr_ = ptr;
+        if (old != nullptr)
+            get_deleter()(old);
+    }
+
+private:
+    T* ptr_;
+};
+
+#endif /* UNIQUE_HANDLE_HPP */
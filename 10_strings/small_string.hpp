@@ -0,0 +1,149 @@
+/* small_string: a string that stores short text inside itself, and only uses
+   the heap for long text. */
+
+#ifndef SMALL_STRING_HPP
+#define SMALL_STRING_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/* A string class normally holds three things: a pointer to the chars on the
+   heap, the size, and the capacity. On a 64 bit machine that is 24 bytes.
+
+   SMALL STRING OPTIMIZATION (SSO): most strings are short, and 24 bytes are
+   enough to hold 23 chars plus the '\0'. So short strings are stored right
+   in those 24 bytes, with no heap allocation at all, and no pointer to chase
+   when reading them.
+
+   How do we know which kind we have? The last byte does double duty:
+
+   - inline strings store 23 - size there. A full inline string has size 23,
+     so the last byte is 0, which is also its '\0' terminator.
+   - heap strings: the last byte is the top byte of capacity (x86 is little
+     endian). We set its top bit, which no inline string ever has, and no
+     real capacity ever needs.
+*/
+class small_string {
+public:
+    static const std::size_t inline_capacity = 23;
+
+    small_string() {
+        set_inline_size(0);
+        inline_[0] = '\0';
+    }
+
+    small_string(char const * text) {
+        assign(text, std::strlen(text));
+    }
+
+    small_string(char const * text, std::size_t size) {
+        assign(text, size);
+    }
+
+    small_string(small_string const & other) {
+        assign(other.data(), other.size());
+    }
+
+    /* Moving steals the heap buffer, or copies the 24 bytes of an inline
+       string. Either way, it never allocates. */
+    small_string(small_string&& other) noexcept {
+        std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+        other.set_inline_size(0);
+        other.inline_[0] = '\0';
+    }
+
+    small_string& operator=(small_string const & other) {
+        if (this != &other) {
+            small_string copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    small_string& operator=(small_string&& other) noexcept {
+        small_string moved(static_cast<small_string&&>(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~small_string() {
+        if (!is_inline())
+            std::free(heap_.ptr);
+    }
+
+    void swap(small_string& other) noexcept {
+        char temp[sizeof(bytes_)];
+        std::memcpy(temp, bytes_, sizeof(bytes_));
+        std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+        std::memcpy(other.bytes_, temp, sizeof(bytes_));
+    }
+
+    bool is_inline() const {
+        return (bytes_[sizeof(bytes_) - 1] & heap_flag) == 0;
+    }
+
+    std::size_t size() const {
+        return is_inline() ? inline_capacity - bytes_[sizeof(bytes_) - 1]
+                           : heap_.size;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    char const * data() const { return is_inline() ? inline_ : heap_.ptr; }
+    char const * c_str() const { return data(); }
+
+    bool operator==(small_string const & other) const {
+        return size() == other.size() &&
+               std::memcmp(data(), other.data(), size()) == 0;
+    }
+
+    bool operator!=(small_string const & other) const {
+        return !(*this == other);
+    }
+
+private:
+    static const unsigned char heap_flag = 0x80;
+
+    void set_inline_size(std::size_t size) {
+        bytes_[sizeof(bytes_) - 1] = (unsigned char)(inline_capacity - size);
+    }
+
+    /* only called on a string that owns nothing yet */
+    void assign(char const * text, std::size_t size) {
+        if (size <= inline_capacity) {
+            std::memcpy(inline_, text, size);
+            inline_[size] = '\0';
+            set_inline_size(size);
+            return;
+        }
+
+        char* ptr = (char*)std::malloc(size + 1);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        std::memcpy(ptr, text, size);
+        ptr[size] = '\0';
+
+        heap_.ptr = ptr;
+        heap_.size = size;
+        heap_.capacity = size;
+        bytes_[sizeof(bytes_) - 1] |= heap_flag;
+    }
+
+    struct heap_string {
+        char* ptr;
+        std::size_t size;
+        std::size_t capacity; /* top bit of last byte is heap_flag */
+    };
+
+    union {
+        heap_string heap_;
+        char inline_[inline_capacity + 1];
+        unsigned char bytes_[sizeof(heap_string)];
+    };
+};
+
+static_assert(sizeof(small_string) == 24, "small_string should be 24 bytes");
+
+#endif /* SMALL_STRING_HPP */
@@ -0,0 +1,138 @@
+/* string_table: stores each distinct string once. */
+
+#ifndef STRING_TABLE_HPP
+#define STRING_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+/* If ten million records only use a few thousand different names, storing
+   every name separately wastes a lot of memory. INTERNING stores each
+   distinct string once, and gives everybody who asks for it the same
+   pointer.
+
+   As a bonus, two interned strings are equal exactly when their pointers are
+   equal, so comparing them is one instruction instead of strcmp.
+
+   The chars are kept in big blocks that are never moved or freed until the
+   table is destroyed, so the pointers stay valid as long as the table
+   lives. Lookups use a hash table with OPEN ADDRESSING: all entries live in
+   one array, and a collision just moves on to the next slot.
+*/
+class string_table {
+public:
+    string_table()
+        : count_(0), block_used_(block_size), block_(nullptr),
+          block_bytes_(0) {
+        slots_.resize(64);
+    }
+
+    ~string_table() {
+        for (std::size_t i = 0; i < blocks_.size(); ++i)
+            std::free(blocks_[i]);
+    }
+
+    string_table(string_table const &) = delete;
+    string_table& operator=(string_table const &) = delete;
+
+    /* Returns the one stored copy of text, adding it if needed. */
+    char const * intern(char const * text) {
+        return intern(text, std::strlen(text));
+    }
+
+    char const * intern(char const * text, std::size_t size) {
+        std::uint64_t hash = hash_of(text, size);
+        std::size_t mask = slots_.size() - 1;
+        for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+            slot& s = slots_[i];
+            if (s.text == nullptr) {
+                char const * stored = store(text, size);
+                s.text = stored;
+                s.size = size;
+                s.hash = hash;
+                /* keep at least half the slots empty, so searches stay short */
+                if (++count_ * 2 > slots_.size())
+                    grow();
+                return stored;
+            }
+            if (s.hash == hash && s.size == size &&
+                std::memcmp(s.text, text, size) == 0)
+                return s.text;
+        }
+    }
+
+    /* the number of distinct strings */
+    std::size_t size() const { return count_; }
+
+    /* bytes used by the table itself and its blocks. A string longer than
+       a block gets a block of its own, of just its size. */
+    std::size_t memory_used() const {
+        return slots_.size() * sizeof(slot) + block_bytes_;
+    }
+
+private:
+    static const std::size_t block_size = 64 * 1024;
+
+    struct slot {
+        char const * text;
+        std::size_t size;
+        std::uint64_t hash;
+    };
+
+    /* FNV-1a, a simple hash that is good enough for short strings */
+    static std::uint64_t hash_of(char const * text, std::size_t size) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= (unsigned char)text[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    char const * store(char const * text, std::size_t size) {
+        if (block_used_ + size + 1 > block_size) {
+            std::size_t new_block_size = size + 1 > block_size ? size + 1
+                                                              : block_size;
+            block_ = (char*)std::malloc(new_block_size);
+            if (block_ == nullptr)
+                throw std::bad_alloc();
+            blocks_.push_back(block_);
+            block_bytes_ += new_block_size;
+            block_used_ = 0;
+        }
+        char* stored = block_ + block_used_;
+        std::memcpy(stored, text, size);
+        stored[size] = '\0';
+        block_used_ += size + 1;
+        return stored;
+    }
+
+    /* double the slots, and put every string in its new place */
+    void grow() {
+        std::vector<slot> old;
+        old.swap(slots_);
+        slots_.resize(old.size() * 2);
+        std::size_t mask = slots_.size() - 1;
+        for (std::size_t j = 0; j < old.size(); ++j) {
+            if (old[j].text == nullptr)
+                continue;
+            std::size_t i = old[j].hash & mask;
+            while (slots_[i].text != nullptr)
+                i = (i + 1) & mask;
+            slots_[i] = old[j];
+        }
+    }
+
+    std::vector<slot> slots_;
+    std::size_t count_;
+    std::size_t block_used_;
+    char* block_;
+    std::vector<char*> blocks_;
+    std::size_t block_bytes_; /* the sizes of all of blocks_ added up */
+};
+
+#endif /* STRING_TABLE_HPP */
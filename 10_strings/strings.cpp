@@ -0,0 +1,201 @@
+/*
+   In lesson 03, record_t held its name as a char*, which pointed at a string
+   literal that lived forever. Real programs usually read names at run time,
+   so each record has to OWN a copy of its name.
+
+   The simple way, a heap allocated copy per record, costs a malloc for every
+   record, and reading a name means following a pointer to somewhere else in
+   memory.
+
+   This lesson shows two better ways:
+
+   1. small_string (small_string.hpp) keeps short names inside the record.
+   2. string_table (string_table.hpp) stores each different name only once.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "small_string.hpp"
+#include "string_table.hpp"
+
+#include "../instrument/instrument.h"
+
+void using_small_strings() {
+    std::puts(__func__);
+
+    small_string short_name("Calvin Coolidge");
+    small_string long_name("Franklin Delano Roosevelt, 32nd President");
+    std::printf("%s: %s\n", short_name.c_str(),
+                short_name.is_inline() ? "inline" : "heap");
+    std::printf("%s: %s\n", long_name.c_str(),
+                long_name.is_inline() ? "inline" : "heap");
+
+    /* Moving a heap string just takes its pointer. */
+    small_string moved = std::move(long_name);
+    std::printf("after the move: \"%s\" and \"%s\"\n", long_name.c_str(),
+                moved.c_str());
+}
+
+void using_a_string_table() {
+    std::puts(__func__);
+    string_table names;
+
+    char const * a = names.intern("Herbert Hoover");
+    char buffer[] = "Herbert Hoover";
+    char const * b = names.intern(buffer);
+
+    /* same name, same pointer */
+    std::printf("%s %s the same pointer\n", a, a == b ? "is" : "is not");
+
+    /* A string too long for a block gets a block of exactly its size. */
+    std::size_t before = names.memory_used();
+    std::string long_name(100000, 'x');
+    names.intern(long_name.c_str(), long_name.size());
+    std::printf("a %zu char name added %zu bytes\n", long_name.size(),
+                names.memory_used() - before);
+}
+
+/* Now lets compare the different kinds of records over millions of records.
+
+   Names are picked from a list, so there are many records but only a few
+   different names. Some fit in a small_string, some don't.
+*/
+
+char const * const presidents[] = {
+    "George Washington", "John Adams", "Thomas Jefferson", "James Madison",
+    "James Monroe", "John Quincy Adams", "Andrew Jackson", "Martin Van Buren",
+    "William Henry Harrison", "John Tyler", "James K. Polk",
+    "Zachary Taylor", "Millard Fillmore", "Franklin Pierce",
+    "James Buchanan", "Abraham Lincoln", "Andrew Johnson",
+    "Ulysses S. Grant", "Rutherford B. Hayes", "James A. Garfield",
+    "Chester A. Arthur", "Grover Cleveland", "Benjamin Harrison",
+    "William McKinley", "Theodore Roosevelt", "William Howard Taft",
+    "Woodrow Wilson", "Warren G. Harding", "Calvin Coolidge",
+    "Herbert Hoover", "Franklin Delano Roosevelt, 32nd President",
+    "Harry S. Truman", "Dwight D. Eisenhower", "John F. Kennedy"
+};
+
+std::size_t const president_count = sizeof(presidents) / sizeof(presidents[0]);
+
+struct owned_record {
+    char* name; /* from strdup, must be freed */
+    int age;
+};
+
+struct std_string_record {
+    std::string name;
+    int age;
+};
+
+struct small_string_record {
+    small_string name;
+    int age;
+};
+
+struct interned_record {
+    char const * name; /* owned by a string_table */
+    int age;
+};
+
+/* heap memory currently in use, according to malloc. Big blocks, like the
+   vector of records, are mapped separately and counted in hblkhd. */
+std::size_t heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/* The same way to get at the chars of every kind of name. */
+char const * c_str(char const * name) { return name; }
+char const * c_str(std::string const & name) { return name.c_str(); }
+char const * c_str(small_string const & name) { return name.c_str(); }
+
+template <typename Record>
+void free_names(std::vector<Record>&) {}
+
+void free_names(std::vector<owned_record>& records) {
+    for (std::size_t i = 0; i < records.size(); ++i)
+        std::free(records[i].name);
+}
+
+/* Builds count records with make(i), then adds up the name lengths, which
+   has to read every name. Reports time and memory for both. */
+template <typename Record, typename Make>
+void measure(char const * what, std::size_t count, Make make) {
+    std::size_t heap_before = heap_in_use();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<Record> records;
+    records.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+        records.push_back(make(i));
+    double build_time = seconds_since(start);
+    std::size_t heap_used = heap_in_use() - heap_before;
+
+    start = std::chrono::steady_clock::now();
+    std::size_t total_length = 0;
+    for (std::size_t i = 0; i < records.size(); ++i)
+        total_length += std::strlen(c_str(records[i].name));
+    double scan_time = seconds_since(start);
+
+    std::printf("%-14s %3zu bytes/record  build %.3f s  scan %.3f s  (%zu)\n",
+                what, heap_used / count, build_time, scan_time, total_length);
+
+    /* owned_record needs its names freed by hand */
+    free_names(records);
+}
+
+void compare_record_layouts(std::size_t count) {
+    std::puts(__func__);
+    std::printf("%zu records\n", count);
+
+    measure<owned_record>("char* + strdup", count, [](std::size_t i) {
+        owned_record rec = {strdup(presidents[i % president_count]), (int)i};
+        return rec;
+    });
+
+    measure<std_string_record>("std::string", count, [](std::size_t i) {
+        std_string_record rec = {presidents[i % president_count], (int)i};
+        return rec;
+    });
+
+    measure<small_string_record>("small_string", count, [](std::size_t i) {
+        small_string_record rec = {presidents[i % president_count], (int)i};
+        return rec;
+    });
+
+    /* the table is counted in the memory used, since it is created inside */
+    string_table table;
+    measure<interned_record>("interned", count, [&](std::size_t i) {
+        interned_record rec = {table.intern(presidents[i % president_count]),
+                               (int)i};
+        return rec;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    INSTRUMENT_FUNCTION();
+    INSTRUMENTED(using_small_strings());
+    INSTRUMENTED(using_a_string_table());
+
+    /* The number of records can be passed on the command line. */
+    std::size_t count = 10000000;
+    if (argc > 1)
+        count = std::strtoul(argv[1], NULL, 10);
+    if (count > 0)
+        INSTRUMENTED(compare_record_layouts(count));
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+/* for sched_setaffinity and sched_getcpu */
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_BENCHMARKS 256
+#define MAX_SAMPLES 1000
+
+typedef struct {
+    char const * name;
+    bench_func_t func;
+    void* context;
+    uint64_t bytes;  /* per iteration, 0 if not set */
+} benchmark_t;
+
+static benchmark_t benchmarks[MAX_BENCHMARKS];
+static int benchmark_count;
+
+typedef struct {
+    char const * filter;
+    int samples;
+    double min_time_ns;
+    double warmup_ns;
+    int cpu;
+    char const * json_path;
+} options_t;
+
+/* Everything measured about one benchmark. Times are per iteration. */
+typedef struct {
+    uint64_t iterations;  /* per sample */
+    int samples;
+    int outliers;
+    double median_ns;
+    double mean_ns;
+    double stddev_ns;
+    double ci_low_ns;
+    double ci_high_ns;
+    double min_ns;
+} result_t;
+
+void bench_add(char const * name, bench_func_t func, void* context) {
+    if (benchmark_count == MAX_BENCHMARKS) {
+        fprintf(stderr, "bench_add: more than %d benchmarks\n", MAX_BENCHMARKS);
+        exit(1);
+    }
+    benchmark_t benchmark = {name, func, context, 0};
+    benchmarks[benchmark_count++] = benchmark;
+}
+
+void bench_set_bytes(uint64_t bytes) {
+    if (benchmark_count > 0)
+        benchmarks[benchmark_count - 1].bytes = bytes;
+}
+
+static double now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static double time_loop(benchmark_t const * benchmark, uint64_t iterations) {
+    double start = now_ns();
+    benchmark->func(benchmark->context, iterations);
+    return now_ns() - start;
+}
+
+/* ---------- statistics ---------- */
+
+static int compare_doubles(void const * a, void const * b) {
+    double x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+/* The value a fraction p of the way through the sorted values, interpolating
+   between neighbours. */
+static double quantile(double const * sorted, int count, double p) {
+    double position = p * (count - 1);
+    int below = (int)position;
+    if (below + 1 >= count)
+        return sorted[count - 1];
+    double fraction = position - below;
+    return sorted[below] * (1 - fraction) + sorted[below + 1] * fraction;
+}
+
+/* The 95% confidence interval of a mean is mean +- t * stddev / sqrt(n).
+   With few samples the stddev itself is uncertain, which makes t larger
+   than the 1.96 of the normal distribution. These are Student's t values
+   for n - 1 = 1..30 degrees of freedom. */
+static double const t_95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double t_value(int degrees_of_freedom) {
+    int table_size = (int)(sizeof(t_95) / sizeof(t_95[0]));
+    if (degrees_of_freedom <= table_size)
+        return t_95[degrees_of_freedom - 1];
+    /* close enough to the real values from here on */
+    return 1.96 + 2.4 / degrees_of_freedom;
+}
+
+/* Summarizes the samples, which it sorts. Outliers are found with TUKEY'S
+   FENCES: a sample is an outlier if it is more than 1.5 times the spread of
+   the middle half of the samples (the interquartile range) below or above
+   that middle half. */
+static void summarize(double* samples, int count, result_t* result) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    double q1 = quantile(samples, count, 0.25);
+    double q3 = quantile(samples, count, 0.75);
+    double low_fence = q1 - 1.5 * (q3 - q1);
+    double high_fence = q3 + 1.5 * (q3 - q1);
+
+    int first = 0, last = count;
+    while (first < last && samples[first] < low_fence)
+        ++first;
+    while (last > first && samples[last - 1] > high_fence)
+        --last;
+    double* kept = samples + first;
+    int kept_count = last - first;
+
+    double sum = 0;
+    for (int i = 0; i < kept_count; ++i)
+        sum += kept[i];
+    double mean = sum / kept_count;
+    double squares = 0;
+    for (int i = 0; i < kept_count; ++i)
+        squares += (kept[i] - mean) * (kept[i] - mean);
+    double stddev = kept_count > 1 ? sqrt(squares / (kept_count - 1)) : 0;
+    double half_width = kept_count > 1
+        ? t_value(kept_count - 1) * stddev / sqrt(kept_count) : 0;
+
+    result->samples = count;
+    result->outliers = count - kept_count;
+    result->median_ns = quantile(kept, kept_count, 0.5);
+    result->mean_ns = mean;
+    result->stddev_ns = stddev;
+    result->ci_low_ns = mean - half_width;
+    result->ci_high_ns = mean + half_width;
+    result->min_ns = samples[0];
+}
+
+/* ---------- running ---------- */
+
+static void run_benchmark(benchmark_t const * benchmark,
+                          options_t const * options, result_t* result) {
+    /* Find how many iterations take at least min_time. Grow by at most 10x
+       at a time, since the first, cold runs are the least reliable. */
+    uint64_t iterations = 1;
+    double elapsed;
+    while ((elapsed = time_loop(benchmark, iterations)) < options->min_time_ns) {
+        double factor = elapsed > 0 ? 1.2 * options->min_time_ns / elapsed : 10;
+        if (factor > 10)
+            factor = 10;
+        if (factor < 2)
+            factor = 2;
+        iterations = (uint64_t)(iterations * factor);
+    }
+
+    double warmup_end = now_ns() + options->warmup_ns;
+    while (now_ns() < warmup_end)
+        time_loop(benchmark, iterations);
+
+    static double samples[MAX_SAMPLES];
+    for (int i = 0; i < options->samples; ++i)
+        samples[i] = time_loop(benchmark, iterations) / iterations;
+
+    summarize(samples, options->samples, result);
+    result->iterations = iterations;
+}
+
+/* Returns the processor pinned to, or -1. */
+static int pin_to_cpu(int cpu) {
+    if (cpu == -1)
+        return -1;
+    if (cpu == -2)
+        cpu = sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (cpu < 0 || sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("warning: could not pin to a processor");
+        return -1;
+    }
+    return cpu;
+}
+
+/* Reads the first line of a file into text, without the newline. Leaves text
+   empty if there is no such file. */
+static void read_line(char const * path, char* text, int size) {
+    text[0] = '\0';
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return;
+    if (fgets(text, size, file) != NULL)
+        text[strcspn(text, "\n")] = '\0';
+    fclose(file);
+}
+
+static void read_cpu_model(char* text, int size) {
+    text[0] = '\0';
+    FILE* file = fopen("/proc/cpuinfo", "r");
+    if (file == NULL)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+            snprintf(text, size, "%s", colon + 2);
+            text[strcspn(text, "\n")] = '\0';
+            break;
+        }
+    }
+    fclose(file);
+}
+
+static int parse_options(int argc, char* argv[], options_t* options) {
+    options->filter = "";
+    options->samples = 30;
+    options->min_time_ns = 5e6;
+    options->warmup_ns = 100e6;
+    options->cpu = -2;
+    options->json_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        char const * arg = argv[i];
+        if (strncmp(arg, "--filter=", 9) == 0)
+            options->filter = arg + 9;
+        else if (strncmp(arg, "--samples=", 10) == 0)
+            options->samples = atoi(arg + 10);
+        else if (strncmp(arg, "--min-time=", 11) == 0)
+            options->min_time_ns = atof(arg + 11) * 1e6;
+        else if (strncmp(arg, "--warmup=", 9) == 0)
+            options->warmup_ns = atof(arg + 9) * 1e6;
+        else if (strncmp(arg, "--cpu=", 6) == 0)
+            options->cpu = atoi(arg + 6);
+        else if (strncmp(arg, "--json=", 7) == 0)
+            options->json_path = arg + 7;
+        else {
+            fprintf(stderr, "usage: %s [--filter=TEXT] [--samples=N] "
+                    "[--min-time=MS] [--warmup=MS] [--cpu=N] [--json=FILE]\n",
+                    argv[0]);
+            return 0;
+        }
+    }
+    if (options->samples < 3 || options->samples > MAX_SAMPLES) {
+        fprintf(stderr, "--samples must be from 3 to %d\n", MAX_SAMPLES);
+        return 0;
+    }
+    return 1;
+}
+
+int bench_main(int argc, char* argv[]) {
+    options_t options;
+    if (!parse_options(argc, argv, &options))
+        return 2;
+
+    int cpu = pin_to_cpu(options.cpu);
+    char model[128], governor[64], path[128];
+    read_cpu_model(model, sizeof(model));
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",
+             cpu < 0 ? 0 : cpu);
+    read_line(path, governor, sizeof(governor));
+    if (governor[0] != '\0' && strcmp(governor, "performance") != 0)
+        printf("warning: the %s cpufreq governor changes the clock speed, "
+               "results will vary more\n", governor);
+
+    FILE* json = NULL;
+    if (options.json_path != NULL) {
+        json = fopen(options.json_path, "w");
+        if (json == NULL) {
+            perror(options.json_path);
+            return 1;
+        }
+        /* One benchmark per line, which compare.sh relies on. */
+        char date[32];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        fprintf(json, "{\"program\": \"%s\", \"date\": \"%s\", "
+                "\"cpu_model\": \"%s\", \"pinned_cpu\": %d, "
+                "\"governor\": \"%s\",\n\"benchmarks\": [",
+                argv[0], date, model, cpu, governor);
+    }
+
+    printf("%-36s %12s %12s %24s %9s %8s\n", "benchmark", "iterations",
+           "median ns", "mean ns, 95% interval", "outliers", "GB/s");
+    int first = 1;
+    for (int i = 0; i < benchmark_count; ++i) {
+        benchmark_t const * benchmark = &benchmarks[i];
+        if (strstr(benchmark->name, options.filter) == NULL)
+            continue;
+
+        result_t result;
+        run_benchmark(benchmark, &options, &result);
+
+        char interval[64];
+        snprintf(interval, sizeof(interval), "%.3f +- %.3f", result.mean_ns,
+                 result.ci_high_ns - result.mean_ns);
+        /* bytes per ns is GB per second */
+        char throughput[16] = "";
+        if (benchmark->bytes > 0)
+            snprintf(throughput, sizeof(throughput), "%.2f",
+                     benchmark->bytes / result.median_ns);
+        printf("%-36s %12llu %12.3f %24s %6d/%-2d %8s\n", benchmark->name,
+               (unsigned long long)result.iterations, result.median_ns,
+               interval, result.outliers, result.samples, throughput);
+        fflush(stdout);
+
+        if (json != NULL) {
+            fprintf(json, "%s\n  {\"name\": \"%s\", \"iterations\": %llu, "
+                    "\"samples\": %d, \"outliers\": %d, \"median_ns\": %.4f, "
+                    "\"mean_ns\": %.4f, \"stddev_ns\": %.4f, "
+                    "\"ci_low_ns\": %.4f, \"ci_high_ns\": %.4f, "
+                    "\"min_ns\": %.4f, \"bytes\": %llu}",
+                    first ? "" : ",", benchmark->name,
+                    (unsigned long long)result.iterations, result.samples,
+                    result.outliers, result.median_ns, result.mean_ns,
+                    result.stddev_ns, result.ci_low_ns, result.ci_high_ns,
+                    result.min_ns, (unsigned long long)benchmark->bytes);
+            first = 0;
+        }
+    }
+
+    if (json != NULL) {
+        fprintf(json, "\n]}\n");
+        fclose(json);
+    }
+    return 0;
+}
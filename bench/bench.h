@@ -0,0 +1,100 @@
+/* A small microbenchmark harness.
+
+   A benchmark is a function that runs the code being measured iterations
+   times in a loop:
+
+       static void bench_strlen(void* context, uint64_t iterations) {
+           char const * string = context;
+           for (uint64_t i = 0; i < iterations; ++i) {
+               bench_escape(string);
+               bench_keep(strlen(string));
+           }
+       }
+
+       int main(int argc, char* argv[]) {
+           bench_add("strlen/1024", bench_strlen, string);
+           return bench_main(argc, argv);
+       }
+
+   Timing a single call of something that takes nanoseconds is hopeless: the
+   clock itself takes longer to read. So the harness times whole loops. It
+   first finds an iteration count that makes a loop take at least
+   --min-time, then times that loop --samples times, and reports the time
+   of one iteration.
+
+   Single samples can't be trusted either. The first runs are slower,
+   because the code and data aren't in the caches yet and the processor may
+   still be raising its clock speed, so the harness runs the loop for a
+   while before measuring (WARMUP). Later, an interrupt or another program
+   can make a sample much slower. Such OUTLIERS are recognized by being far
+   outside the range of the other samples, and left out. What remains is
+   summarized as the median and the mean with a 95% CONFIDENCE INTERVAL: if
+   the whole measurement were repeated, the mean would land in that
+   interval 95 times out of 100. Two results whose intervals don't overlap
+   really are different.
+
+   The process is pinned to one processor, so the scheduler can't move it
+   between processors (with cold caches) in the middle of a sample. Threads
+   that a benchmark starts are pinned to the same one, so measure
+   benchmarks that use several threads, like stream_run, with --cpu=-1.
+
+   Options:
+
+     --filter=TEXT      only run benchmarks whose name contains TEXT
+     --samples=N        samples per benchmark, default 30
+     --min-time=MS      minimum time of one sample, default 5 ms
+     --warmup=MS        time to run before measuring, default 100 ms
+     --cpu=N            pin to processor N, default the one we start on,
+                        -1 to not pin
+     --json=FILE        also write the results to FILE, for compare.sh
+
+   Don't include <stdlib.h> here. 07's expression.h declares its own div(),
+   which clashes with the one in stdlib.h. The header works from C++ too,
+   for the C++ lessons.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*bench_func_t)(void* context, uint64_t iterations);
+
+/* Registers a benchmark. name must stay valid, a string literal is best. */
+void bench_add(char const * name, bench_func_t func, void* context);
+
+/* Says that one iteration of the benchmark added last processes bytes
+   bytes, so its throughput is printed too, in GB/s. */
+void bench_set_bytes(uint64_t bytes);
+
+/* Parses the options, runs the benchmarks and prints the results. Returns
+   the exit status for main. */
+int bench_main(int argc, char* argv[]);
+
+/* The compiler is very good at noticing that a result is never used, or
+   that a loop computes the same thing every time, and removing the work
+   that is being measured. These stop it, at the cost of no instructions.
+
+   bench_keep(value)    pretend value is used
+   bench_escape(ptr)    pretend ptr's memory is read and written, so it
+                        can't assume anything about what is there
+*/
+#define bench_keep(value) \
+    do { \
+        __typeof__(value) bench_kept_ = (value); \
+        __asm__ volatile("" : : "r,m"(bench_kept_) : "memory"); \
+    } while (0)
+
+static inline void bench_escape(void const * ptr) {
+    __asm__ volatile("" : : "g"(ptr) : "memory");
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_H */
@@ -0,0 +1,74 @@
+#! /bin/bash
+
+# Compares two result files written by a microbench program's --json option,
+# and flags every benchmark that got slower.
+#
+# Usage:
+#
+#   ./compare.sh [-t PERCENT] before.json after.json
+#
+# A benchmark is a REGRESSION if its mean time went up by more than PERCENT
+# (default 5), and the 95% confidence intervals of the two means don't
+# overlap, so the difference is unlikely to be noise. Improvements are
+# found the same way. Exits with status 1 if there is any regression.
+
+set -e
+
+threshold=5
+while getopts "t:" option; do
+    case $option in
+        t) threshold=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+if [ $# -ne 2 ]; then
+    echo "usage: $0 [-t PERCENT] before.json after.json" >&2
+    exit 2
+fi
+
+# The result files have one benchmark per line. This prints each as
+# "name mean_ns ci_low_ns ci_high_ns", with spaces in the name as '_'.
+results() {
+    awk '
+        function field(name,    pattern) {
+            pattern = "\"" name "\": \"?[^,\"}]*"
+            if (!match($0, pattern))
+                return ""
+            value = substr($0, RSTART + length(name) + 4, RLENGTH - length(name) - 4)
+            sub(/^"/, "", value)
+            return value
+        }
+        /"mean_ns"/ {
+            name = field("name")
+            gsub(/ /, "_", name)
+            print name, field("mean_ns"), field("ci_low_ns"), field("ci_high_ns")
+        }' "$1"
+}
+
+join <(results "$1" | sort) <(results "$2" | sort) |
+awk -v threshold="$threshold" '
+    BEGIN {
+        printf "%-36s %12s %12s %8s\n", "benchmark", "before ns", "after ns", "change"
+    }
+    {
+        name = $1; before = $2; before_low = $3; before_high = $4
+        after = $5; after_low = $6; after_high = $7
+        change = (after - before) / before * 100
+        verdict = ""
+        if (change > threshold && after_low > before_high) {
+            verdict = "  REGRESSION"
+            ++regressions
+        } else if (change < -threshold && after_high < before_low) {
+            verdict = "  improved"
+        } else if (change > threshold || change < -threshold) {
+            verdict = "  (within noise)"
+        }
+        printf "%-36s %12.3f %12.3f %+7.1f%%%s\n", name, before, after, change, verdict
+    }
+    END {
+        if (regressions > 0) {
+            printf "\n%d regression(s) over %s%%\n", regressions, threshold
+            exit 1
+        }
+    }'
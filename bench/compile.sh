@@ -0,0 +1,18 @@
+#! /bin/bash
+
+set -x
+
+gcc -O2 -Wall -Werror -c -o bench.o bench.c
+gcc -O2 -Wall -Werror -c -o instrument.o ../instrument/instrument.c
+
+gcc -O2 -Wall -Werror -o microbench_structs microbench_structs.c bench.o instrument.o ../03_structs/record.c ../03_structs/record_table.c ../03_structs/record_writer.c -lm
+gcc -O2 -Wall -Werror -o microbench_const microbench_const.c bench.o instrument.o ../04_const/fast_string_length.c -lm
+gcc -O2 -Wall -Werror -pthread -o microbench_memory microbench_memory.c bench.o instrument.o ../05_memory_management/arena.c ../05_memory_management/object_pool.c ../05_memory_management/record.c -lm
+gcc -O2 -Wall -Werror -o microbench_pointer_arithmetic microbench_pointer_arithmetic.c bench.o instrument.o ../06_pointer_arithmetic/fast_find.c ../06_pointer_arithmetic/fast_case.c ../06_pointer_arithmetic/mapped_file.c ../06_pointer_arithmetic/slices.c -lm
+gcc -O2 -Wall -Werror -pthread -o microbench_function_ptr microbench_function_ptr.c bench.o instrument.o ../07_function_ptr/char_class.c ../07_function_ptr/higher_order.c ../07_function_ptr/parallel.c ../07_function_ptr/expr_batch.c ../07_function_ptr/expr_compiler.c ../07_function_ptr/expr_reader.c ../07_function_ptr/expression.c ../07_function_ptr/stream.c ../07_function_ptr/transforms.c ../06_pointer_arithmetic/slices.c ../06_pointer_arithmetic/fast_find.c -lm
+
+g++ -std=c++11 -O2 -DNDEBUG -Wall -Werror -o microbench_templates microbench_templates.cpp bench.o -lm
+g++ -std=c++11 -O2 -DSPAN_CHECKS=1 -Wall -Werror -o microbench_templates_checked microbench_templates.cpp bench.o -lm
+g++ -std=c++11 -O2 -Wall -Werror -o microbench_raii microbench_raii.cpp bench.o -lm
+
+rm bench.o instrument.o
@@ -0,0 +1,103 @@
+/* Benchmarks of the string length functions in 04_const, on strings from
+   1 byte to 64 MB long. Short strings measure the fixed cost of a call,
+   long ones how many bytes a second the loop gets through, first from the
+   caches and finally from memory. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../04_const/fast_string_length.h"
+
+#include "bench.h"
+
+#define MAX_LENGTH (64 * 1024 * 1024)
+
+/* Every string starts at the beginning of one 64 byte aligned buffer of
+   'a's. A benchmark puts the '\0' after length chars, and takes it away
+   again when it is done. */
+static char* buffer;
+
+typedef struct {
+    string_length_func func;
+    size_t length;
+} length_case_t;
+
+/* Every function is called through a pointer, like a function in a library
+   would be, so none of them gets inlined into the loop and the comparison
+   is fair. */
+static void bench_length(void* context, uint64_t iterations) {
+    length_case_t const * c = (length_case_t const *)context;
+    buffer[c->length] = '\0';
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(buffer);
+        bench_keep(c->func(buffer));
+    }
+    buffer[c->length] = 'a';
+}
+
+static size_t lesson_string_length(char const * string) {
+    return string_length(string);
+}
+
+static size_t libc_strlen(char const * string) {
+    return strlen(string);
+}
+
+typedef struct {
+    char const * name;
+    string_length_func func;
+} length_func_t;
+
+static length_func_t funcs[] = {
+    {"string_length", lesson_string_length},
+    {"strlen", libc_strlen},
+    {"string_length_swar", string_length_swar},
+    {"string_length_sse2", string_length_sse2},
+    {"string_length_avx2", string_length_avx2},
+    {"string_length_fast", string_length_fast},
+};
+
+#define FUNC_COUNT (sizeof(funcs) / sizeof(funcs[0]))
+
+static struct {
+    size_t length;
+    char const * label;
+} const lengths[] = {
+    {1, "1"}, {16, "16"}, {64, "64"}, {256, "256"}, {4096, "4K"},
+    {64 * 1024, "64K"}, {1024 * 1024, "1M"}, {16 * 1024 * 1024, "16M"},
+    {MAX_LENGTH, "64M"},
+};
+
+#define LENGTH_COUNT (sizeof(lengths) / sizeof(lengths[0]))
+
+/* bench_add keeps the name and context pointers, so they live here. */
+static length_case_t cases[LENGTH_COUNT][FUNC_COUNT];
+static char names[LENGTH_COUNT][FUNC_COUNT][48];
+
+int main(int argc, char* argv[]) {
+    buffer = (char*)aligned_alloc(64, MAX_LENGTH + 64);
+    if (buffer == NULL) {
+        puts("Out of memory!");
+        return 1;
+    }
+    memset(buffer, 'a', MAX_LENGTH + 64);
+
+    for (size_t l = 0; l < LENGTH_COUNT; ++l) {
+        for (size_t f = 0; f < FUNC_COUNT; ++f) {
+            if (funcs[f].func == string_length_avx2 &&
+                !__builtin_cpu_supports("avx2"))
+                continue;
+            length_case_t c = {funcs[f].func, lengths[l].length};
+            cases[l][f] = c;
+            snprintf(names[l][f], sizeof(names[l][f]), "%s/%s",
+                     funcs[f].name, lengths[l].label);
+            bench_add(names[l][f], bench_length, &cases[l][f]);
+            bench_set_bytes(lengths[l].length);
+        }
+    }
+
+    int status = bench_main(argc, argv);
+    free(buffer);
+    return status;
+}
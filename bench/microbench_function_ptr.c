@@ -0,0 +1,275 @@
+/* Benchmarks of the higher order functions in 07_function_ptr. */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../07_function_ptr/char_class.h"
+#include "../07_function_ptr/expr_batch.h"
+#include "../07_function_ptr/expr_reader.h"
+#include "../07_function_ptr/expression.h"
+#include "../07_function_ptr/higher_order.h"
+#include "../07_function_ptr/stream.h"
+#include "../07_function_ptr/transforms.h"
+
+#include "bench.h"
+
+#define EXPRESSION_COUNT 1024
+#define TEXT_SIZE 4096
+
+static expression_t expressions[EXPRESSION_COUNT];
+static int left_operands[EXPRESSION_COUNT];
+static int right_operands[EXPRESSION_COUNT];
+static char op_codes[EXPRESSION_COUNT];
+static int results[EXPRESSION_COUNT];
+
+/* Letters, with a single digit at the very end. */
+static char text[TEXT_SIZE];
+
+/* One iteration evaluates one expression. They use all four operators in a
+   pattern the branch predictor can't learn, as real input would. */
+static void bench_eval_expression(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(expressions);
+        bench_keep(eval_expression(expressions[i % EXPRESSION_COUNT]));
+    }
+}
+
+/* One iteration evaluates all EXPRESSION_COUNT expressions. */
+static void bench_eval_expression_batch(void* context, uint64_t iterations) {
+    expr_batch_t batch = {left_operands, right_operands, op_codes,
+                          EXPRESSION_COUNT};
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(op_codes);
+        eval_expression_batch(&batch, results);
+        bench_escape(results);
+    }
+}
+
+/* ---- reading expressions ----
+
+   One iteration reads and evaluates all read_lines lines of a file of
+   expressions, from the start: with read_expression, which calls scanf once
+   per line, and with an expr_reader_t and eval_expression_batch. The file
+   is in the page cache, so this measures the parsing, not the disk.
+
+   read_expression reads stdin, so the file is put in place of stdin.
+   Rewinding stdin rewinds the file, and the reader seeks back to the start
+   itself.
+
+   read_lines is 100000 by default, about 1.5 MB, so the whole suite stays
+   quick. --lines=N changes it. --lines=70000000 makes a file of about 1 GB,
+   far bigger than the processor's caches:
+
+       microbench_function_ptr --lines=70000000 --filter=70000000_lines --samples=3
+*/
+
+static long read_lines = 100000;
+
+static int expression_fd = -1;
+static long expression_bytes;
+
+static void bench_read_expression(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        rewind(stdin);
+        int total = 0;
+        for (long line = 0; line < read_lines; ++line)
+            total += eval_expression(read_expression());
+        bench_keep(total);
+    }
+}
+
+static void bench_expr_reader(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        lseek(expression_fd, 0, SEEK_SET);
+        expr_reader_t* reader = expr_reader_create(expression_fd, NULL, NULL);
+        if (reader == NULL)
+            return;
+        size_t count;
+        while ((count = expr_reader_next_batch(reader, left_operands,
+                                               right_operands, op_codes,
+                                               EXPRESSION_COUNT)) > 0) {
+            expr_batch_t batch = {left_operands, right_operands, op_codes,
+                                  count};
+            eval_expression_batch(&batch, results);
+            bench_escape(results);
+        }
+        expr_reader_free(reader);
+    }
+}
+
+/* Writes read_lines expressions to a temporary file, and makes it stdin.
+   Returns 0 if it can't. */
+static int make_expression_file() {
+    FILE* file = tmpfile();
+    if (file == NULL)
+        return 0;
+    unsigned random = 54321;
+    for (long line = 0; line < read_lines; ++line) {
+        random = random * 1103515245 + 12345;
+        fprintf(file, "%d %c %d\n", (int)(random >> 8) % 100000 - 50000,
+                "*/+-"[(random >> 20) % 4], 1 + (int)(random >> 4) % 1000);
+    }
+    fflush(file);
+    expression_bytes = ftell(file);
+    expression_fd = fileno(file);
+    return dup2(expression_fd, 0) == 0;
+}
+
+static void bench_find_char_if(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(find_char_if(text, text + TEXT_SIZE, isdigit));
+    }
+}
+
+static void bench_find_char_in_class(void* context, uint64_t iterations) {
+    char_class_t const * digits = (char_class_t const *)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(find_char_in_class(text, text + TEXT_SIZE, digits));
+    }
+}
+
+/* cap_char leaves the digit alone, so the searches find the same thing
+   whichever order the benchmarks run in. */
+static void bench_for_each_char(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        for_each_char(text, text + TEXT_SIZE, cap_char);
+    }
+}
+
+static void bench_capitalize_chars(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        capitalize_chars(text, text + TEXT_SIZE);
+    }
+}
+
+/* One iteration streams STREAM_BLOCKS MB through a pipe from a producer
+   thread, through the transform, to /dev/null. */
+#define STREAM_BLOCKS 64
+
+typedef struct {
+    stream_transform_t transform;
+    void* context;
+} stream_case_t;
+
+/* A failed stream would make a benchmark look fast, so it fails the run. */
+static int stream_failed = 0;
+
+static void bench_stream(void* context, uint64_t iterations) {
+    stream_case_t const * c = (stream_case_t const *)context;
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) {
+        perror("/dev/null");
+        stream_failed = 1;
+        return;
+    }
+    for (uint64_t i = 0; i < iterations && !stream_failed; ++i) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            stream_failed = 1;
+            break;
+        }
+        producer_t producer = {fds[1], STREAM_BLOCKS};
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, producer_main, &producer) != 0) {
+            puts("Could not start a thread");
+            close(fds[0]);
+            close(fds[1]);
+            stream_failed = 1;
+            break;
+        }
+        if (!stream_run(fds[0], null_fd, c->transform, c->context, NULL)) {
+            perror("stream_run");
+            stream_failed = 1;
+        }
+        /* if stream_run stopped early, the producer's next write fails
+           once nobody reads the pipe, and it stops */
+        close(fds[0]);
+        pthread_join(thread, NULL);
+    }
+    close(null_fd);
+}
+
+static long stream_lines;
+static word_t bar = {"bar", 3};
+static stream_case_t stream_cases[] = {
+    {capitalize_transform, NULL},
+    {count_lines_transform, &stream_lines},
+    {capitalize_word_transform, &bar}
+};
+
+int main(int argc, char* argv[]) {
+    /* --lines=N is ours, the other options are passed on to bench_main */
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--lines=", 8) != 0) {
+            argv[kept++] = argv[i];
+        } else if (sscanf(argv[i] + 8, "%ld", &read_lines) != 1 ||
+                   read_lines < 1) {
+            fprintf(stderr, "--lines must be a positive number\n");
+            return 1;
+        }
+    }
+    argc = kept;
+    argv[argc] = NULL;
+
+    /* so a failed write to a pipe returns an error instead of ending the
+       program, see stream.h */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* a small linear congruential generator, the same every run */
+    unsigned random = 12345;
+    for (int i = 0; i < EXPRESSION_COUNT; ++i) {
+        random = random * 1103515245 + 12345;
+        left_operands[i] = (int)(random >> 8) % 1000;
+        right_operands[i] = 1 + (int)(random >> 4) % 100;
+        op_codes[i] = "*/+-"[(random >> 20) % 4];
+        expressions[i].left_operand = left_operands[i];
+        expressions[i].right_operand = right_operands[i];
+        expressions[i].operator = math_symbol_to_func(op_codes[i]);
+    }
+
+    for (int i = 0; i < TEXT_SIZE; ++i)
+        text[i] = 'a' + i % 26;
+    text[TEXT_SIZE - 1] = '7';
+    static char_class_t digits;
+    char_class_from_pred(&digits, isdigit);
+
+    bench_add("eval_expression", bench_eval_expression, NULL);
+    bench_add("eval_expression_batch/1024", bench_eval_expression_batch, NULL);
+    if (!make_expression_file()) {
+        perror("making a file of expressions");
+        return 1;
+    }
+    static char read_expression_name[64];
+    static char expr_reader_name[64];
+    snprintf(read_expression_name, sizeof(read_expression_name),
+             "read_expression/%ld_lines", read_lines);
+    snprintf(expr_reader_name, sizeof(expr_reader_name),
+             "expr_reader_next_batch/%ld_lines", read_lines);
+    bench_add(read_expression_name, bench_read_expression, NULL);
+    bench_set_bytes(expression_bytes);
+    bench_add(expr_reader_name, bench_expr_reader, NULL);
+    bench_set_bytes(expression_bytes);
+    bench_add("find_char_if/isdigit/4096", bench_find_char_if, NULL);
+    bench_add("find_char_in_class/digits/4096", bench_find_char_in_class,
+              &digits);
+    bench_add("for_each_char/cap_char/4096", bench_for_each_char, NULL);
+    bench_add("capitalize_chars/4096", bench_capitalize_chars, NULL);
+    bench_add("stream_run/capitalize/64M", bench_stream, &stream_cases[0]);
+    bench_add("stream_run/count_lines/64M", bench_stream, &stream_cases[1]);
+    bench_add("stream_run/capitalize_word/64M", bench_stream,
+              &stream_cases[2]);
+    int status = bench_main(argc, argv);
+    return stream_failed ? 1 : status;
+}
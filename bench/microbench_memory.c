@@ -0,0 +1,336 @@
+/* Benchmarks of the ways 05_memory_management makes records. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../05_memory_management/arena.h"
+#include "../05_memory_management/object_pool.h"
+#include "../05_memory_management/record.h"
+
+#include "bench.h"
+
+/* One iteration makes one record and frees it again. */
+static void bench_make_record_free(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        record_t* rec = make_record(48, 72);
+        bench_escape(rec);
+        free(rec);
+    }
+}
+
+/* An arena can't free single records, so it is reset after every 1024,
+   which is part of the cost. */
+static void bench_make_record_in(void* context, uint64_t iterations) {
+    arena_t* arena = (arena_t*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(make_record_in(arena, 48, 72));
+        if (i % 1024 == 1023)
+            arena_reset(arena);
+    }
+    arena_reset(arena);
+}
+
+static void bench_make_record_from_pool(void* context, uint64_t iterations) {
+    object_pool_t* pool = (object_pool_t*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        record_t* rec = make_record_from_pool(pool, 48, 72);
+        bench_escape(rec);
+        object_pool_free(pool, rec);
+    }
+}
+
+/* The same through a cache that keeps a few records for this thread alone,
+   and only goes to the shared pool when it is empty or full. */
+static void bench_pool_cache(void* context, uint64_t iterations) {
+    pool_cache_t cache;
+    pool_cache_init(&cache, (object_pool_t*)context);
+    for (uint64_t i = 0; i < iterations; ++i) {
+        record_t* rec = (record_t*)pool_cache_alloc(&cache);
+        bench_escape(rec);
+        pool_cache_free(&cache, rec);
+    }
+    pool_cache_flush(&cache);
+}
+
+/* ---- many threads ----
+
+   The benchmarks above run on one thread, where malloc's per-thread cache
+   makes it hard to beat. With many threads, everything shared is fought
+   over. Here 1 to MAX_CHURN_THREADS threads each keep LIVE_RECORDS records,
+   and replace a random one at a time, with malloc, with the pool, and with
+   the pool through a cache per thread.
+
+   Throughput is all threads' replacements divided by the time from when
+   the first thread starts until the last one is done. For the tail
+   latency every LATENCY_EVERY-th replacement is timed on its own, and the
+   50th, 99th and 99.9th percentiles of those times are printed. The slow
+   ones are what a thread waiting on a contended free list, or preempted
+   while holding malloc's lock, sees.
+
+   This runs before the benchmarks above, which pin the process, and every
+   thread it starts, to one processor.
+*/
+
+#define MAX_CHURN_THREADS 64
+#define CHURN_OPERATIONS 2000000 /* in total, shared by the threads */
+#define LIVE_RECORDS 100
+#define LATENCY_EVERY 16
+
+enum { CHURN_MALLOC, CHURN_POOL, CHURN_POOL_CACHE };
+
+typedef struct {
+    int allocator;
+    object_pool_t* pool;
+    int operations;       /* per thread */
+    pthread_barrier_t start;
+} churn_t;
+
+typedef struct {
+    churn_t* churn;
+    unsigned seed;
+    double* latencies;    /* operations / LATENCY_EVERY of them */
+    double started, finished;
+} churn_thread_t;
+
+static double now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static record_t* churn_alloc(churn_t* churn, pool_cache_t* cache) {
+    switch (churn->allocator) {
+    case CHURN_MALLOC:
+        return make_record(48, 72);
+    case CHURN_POOL:
+        return make_record_from_pool(churn->pool, 48, 72);
+    default:
+        return (record_t*)pool_cache_alloc(cache);
+    }
+}
+
+static void churn_free(churn_t* churn, pool_cache_t* cache, record_t* rec) {
+    switch (churn->allocator) {
+    case CHURN_MALLOC:
+        free(rec);
+        break;
+    case CHURN_POOL:
+        object_pool_free(churn->pool, rec);
+        break;
+    default:
+        pool_cache_free(cache, rec);
+    }
+}
+
+static void* churn_worker(void* arg) {
+    churn_thread_t* thread = (churn_thread_t*)arg;
+    churn_t* churn = thread->churn;
+    record_t* live[LIVE_RECORDS] = {NULL};
+    pool_cache_t cache;
+    pool_cache_init(&cache, churn->pool);
+    unsigned random = thread->seed;
+
+    pthread_barrier_wait(&churn->start);
+    thread->started = now_ns();
+    for (int op = 0; op < churn->operations; ++op) {
+        random = random * 1103515245 + 12345;
+        int slot = (random >> 16) % LIVE_RECORDS;
+        int timed = op % LATENCY_EVERY == 0;
+        double start = timed ? now_ns() : 0;
+
+        if (live[slot] != NULL)
+            churn_free(churn, &cache, live[slot]);
+        live[slot] = churn_alloc(churn, &cache);
+        if (live[slot] == NULL) {
+            puts("Out of memory!");
+            exit(1);
+        }
+        bench_escape(live[slot]);
+
+        if (timed)
+            thread->latencies[op / LATENCY_EVERY] = now_ns() - start;
+    }
+    thread->finished = now_ns();
+
+    for (int slot = 0; slot < LIVE_RECORDS; ++slot) {
+        if (live[slot] != NULL)
+            churn_free(churn, &cache, live[slot]);
+    }
+    pool_cache_flush(&cache);
+    return NULL;
+}
+
+static int compare_doubles(void const * a, void const * b) {
+    double x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double const * sorted, size_t count, double p) {
+    return sorted[(size_t)(p * (count - 1))];
+}
+
+static void churn(char const * name, int allocator, int thread_count) {
+    churn_t churn;
+    churn.allocator = allocator;
+    churn.pool = object_pool_create(sizeof(record_t), 0);
+    churn.operations = CHURN_OPERATIONS / thread_count;
+    if (churn.pool == NULL) {
+        puts("Out of memory!");
+        exit(1);
+    }
+    pthread_barrier_init(&churn.start, NULL, thread_count + 1);
+
+    size_t per_thread = churn.operations / LATENCY_EVERY;
+    size_t latency_count = per_thread * thread_count;
+    static double latencies[CHURN_OPERATIONS / LATENCY_EVERY];
+    static churn_thread_t threads[MAX_CHURN_THREADS];
+    static pthread_t ids[MAX_CHURN_THREADS];
+    for (int i = 0; i < thread_count; ++i) {
+        churn_thread_t thread = {&churn, 12345u + i, latencies + i * per_thread,
+                                 0, 0};
+        threads[i] = thread;
+        if (pthread_create(&ids[i], NULL, churn_worker, &threads[i]) != 0) {
+            puts("Could not start a thread");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&churn.start);
+    for (int i = 0; i < thread_count; ++i)
+        pthread_join(ids[i], NULL);
+    double started = threads[0].started, finished = threads[0].finished;
+    for (int i = 1; i < thread_count; ++i) {
+        if (threads[i].started < started)
+            started = threads[i].started;
+        if (threads[i].finished > finished)
+            finished = threads[i].finished;
+    }
+    double elapsed = finished - started;
+
+    qsort(latencies, latency_count, sizeof(double), compare_doubles);
+    printf("%7d  %-22s %8.1f %8.0f %8.0f %9.0f\n", thread_count, name,
+           (double)churn.operations * thread_count / elapsed * 1e3,
+           percentile(latencies, latency_count, 0.5),
+           percentile(latencies, latency_count, 0.99),
+           percentile(latencies, latency_count, 0.999));
+
+    pthread_barrier_destroy(&churn.start);
+    object_pool_destroy(churn.pool);
+}
+
+static void print_churn() {
+    printf("%7s  %-22s %8s %8s %8s %9s\n", "threads", "replacing records with",
+           "Mops/s", "p50 ns", "p99 ns", "p99.9 ns");
+    for (int threads = 1; threads <= MAX_CHURN_THREADS; threads *= 2) {
+        churn("malloc/free", CHURN_MALLOC, threads);
+        churn("object_pool", CHURN_POOL, threads);
+        churn("pool_cache", CHURN_POOL_CACHE, threads);
+    }
+    puts("");
+}
+
+/* ---- memory use ----
+
+   How much memory do RSS_RECORDS records really take? Each allocator makes
+   them, and the growth of the process's RESIDENT SET SIZE (the memory it
+   really has, not just reserved addresses) is printed. malloc has a header
+   for each block and rounds blocks up to 16 bytes, the arena and the pool
+   have neither.
+
+   ru_maxrss from getrusage would only give the highest RSS so far, which
+   can't be used to compare two allocators in one process, so the current
+   RSS is read from /proc/self/statm. malloc goes last: memory it has freed
+   stays in the process, and would be reused by whichever came next. This
+   is also why it all runs after the timings. Millions of freed blocks
+   left in malloc's free lists make its next large allocation slow, which
+   upsets the timing of whatever benchmark runs first. */
+
+#define RSS_RECORDS 4000000
+
+/* Returns 0 if it can't tell. */
+static long resident_bytes() {
+    long pages = 0, resident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file == NULL)
+        return 0;
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(file);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void print_rss(char const * name, long before, long after) {
+    printf("%-24s %8.1f MB, %5.1f bytes per record\n", name,
+           (after - before) / 1e6, (double)(after - before) / RSS_RECORDS);
+}
+
+static void print_memory_use() {
+    printf("memory for %d records of %zu bytes:\n", RSS_RECORDS,
+           sizeof(record_t));
+
+    long before = resident_bytes();
+    arena_t arena;
+    arena_init(&arena, 0);
+    for (int i = 0; i < RSS_RECORDS; ++i)
+        make_record_in(&arena, 48, 72);
+    print_rss("make_record_in/arena", before, resident_bytes());
+    arena_destroy(&arena);
+
+    before = resident_bytes();
+    object_pool_t* pool = object_pool_create(sizeof(record_t), 0);
+    if (pool == NULL) {
+        puts("Out of memory!");
+        exit(1);
+    }
+    for (int i = 0; i < RSS_RECORDS; ++i)
+        make_record_from_pool(pool, 48, 72);
+    print_rss("make_record_from_pool", before, resident_bytes());
+    object_pool_destroy(pool);
+
+    /* the pointers, needed to free the records again, are made resident
+       before measuring */
+    record_t** records = (record_t**)malloc(RSS_RECORDS * sizeof(record_t*));
+    if (records == NULL) {
+        puts("Out of memory!");
+        exit(1);
+    }
+    memset(records, 0, RSS_RECORDS * sizeof(record_t*));
+    before = resident_bytes();
+    for (int i = 0; i < RSS_RECORDS; ++i)
+        records[i] = make_record(48, 72);
+    print_rss("make_record/malloc", before, resident_bytes());
+    for (int i = 0; i < RSS_RECORDS; ++i)
+        free(records[i]);
+    free(records);
+}
+
+int main(int argc, char* argv[]) {
+    print_churn();
+
+    arena_t arena;
+    arena_init(&arena, 0);
+    object_pool_t* pool = object_pool_create(sizeof(record_t), 1024);
+    if (pool == NULL) {
+        puts("Out of memory!");
+        return 1;
+    }
+
+    bench_add("make_record/free", bench_make_record_free, NULL);
+    bench_add("make_record_in/arena", bench_make_record_in, &arena);
+    bench_add("make_record_from_pool/free", bench_make_record_from_pool, pool);
+    bench_add("pool_cache_alloc/free", bench_pool_cache, pool);
+    int status = bench_main(argc, argv);
+
+    object_pool_destroy(pool);
+    arena_destroy(&arena);
+    if (status == 0) {
+        puts("");
+        print_memory_use();
+    }
+    return status;
+}
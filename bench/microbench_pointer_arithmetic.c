@@ -0,0 +1,231 @@
+/* Benchmarks of the slice functions in 06_pointer_arithmetic, on memory and
+   on files. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../06_pointer_arithmetic/fast_case.h"
+#include "../06_pointer_arithmetic/fast_find.h"
+#include "../06_pointer_arithmetic/mapped_file.h"
+#include "../06_pointer_arithmetic/slices.h"
+
+#include "bench.h"
+
+#define TEXT_SIZE 4096
+#define MAX_FIND_SIZE (1024 * 1024)
+
+/* Lower case text. The searches put the char they look for at the very end
+   of their slice, so every search reads all of it. */
+static char text[MAX_FIND_SIZE];
+
+typedef char* (*find_func)(char* begin, char* end, char ch);
+typedef void (*change_func)(char* begin, char* end);
+
+static char* libc_memchr(char* begin, char* end, char ch) {
+    char* found = (char*)memchr(begin, ch, end - begin);
+    return found != NULL ? found : end;
+}
+
+/* find_first_of with one needle is just find_char_fast, so it is measured
+   with 2, 4 and 8, all of which run its vector loops. The text is lower
+   case, so only the '!', last among the needles, is ever found. */
+static char const needles[] = "ABCDEFG!";
+
+static char* find_first_of_2(char* begin, char* end, char ch) {
+    return find_first_of(begin, end, needles + 6, 2);
+}
+
+static char* find_first_of_4(char* begin, char* end, char ch) {
+    return find_first_of(begin, end, needles + 4, 4);
+}
+
+static char* find_first_of_8(char* begin, char* end, char ch) {
+    return find_first_of(begin, end, needles, 8);
+}
+
+typedef struct {
+    find_func find;
+    size_t size;
+} find_case_t;
+
+/* The functions are called through pointers so none of them is inlined
+   into the loop. */
+static void bench_find(void* context, uint64_t iterations) {
+    find_case_t const * c = (find_case_t const *)context;
+    char* end = text + c->size;
+    end[-1] = '!';
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(c->find(text, end, '!'));
+    }
+    end[-1] = 'a' + (c->size - 1) % 26;
+}
+
+static void bench_change(void* context, uint64_t iterations) {
+    change_func change = *(change_func*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        change(text, text + TEXT_SIZE);
+    }
+}
+
+/* ---- files ----
+
+   Counting the lines of a FILE_SIZE file, and capitalizing it, through a
+   mapping and with fread into a buffer. One iteration does the whole file,
+   from opening it to closing it. The file is written just before, so it is
+   in the page cache: this measures the cost of getting the chars to the
+   slice functions, not of the disk. */
+
+#define FILE_SIZE (64 << 20)
+#define READ_BUFFER_SIZE (64 << 10)
+
+static char file_path[] = "/tmp/microbench_XXXXXX";
+
+static void bench_count_lines_mapped(void* context, uint64_t iterations) {
+    int hints = *(int*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        mapped_file_t file;
+        if (!mapped_file_open(&file, file_path, MAPPED_READ_ONLY, hints))
+            abort();
+        bench_keep(count_lines(mapped_file_all(&file)));
+        mapped_file_close(&file);
+    }
+}
+
+static void bench_count_lines_fread(void* context, uint64_t iterations) {
+    static char buffer[READ_BUFFER_SIZE];
+    for (uint64_t i = 0; i < iterations; ++i) {
+        FILE* file = fopen(file_path, "rb");
+        if (file == NULL)
+            abort();
+        long lines = 0;
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            file_slice_t slice = {buffer, buffer + size};
+            lines += count_lines(slice);
+        }
+        bench_keep(lines);
+        fclose(file);
+    }
+}
+
+/* Copy on write, so the file stays the same for the next iteration. Every
+   page written to is copied, which fread does too. */
+static void bench_capitalize_mapped(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        mapped_file_t file;
+        if (!mapped_file_open(&file, file_path, MAPPED_COPY_ON_WRITE,
+                              MAPPED_SEQUENTIAL))
+            abort();
+        file_slice_t all = mapped_file_all(&file);
+        uppercase_chars(all.begin, all.end);
+        bench_escape(all.begin);
+        mapped_file_close(&file);
+    }
+}
+
+static void bench_capitalize_fread(void* context, uint64_t iterations) {
+    static char buffer[READ_BUFFER_SIZE];
+    for (uint64_t i = 0; i < iterations; ++i) {
+        FILE* file = fopen(file_path, "rb");
+        if (file == NULL)
+            abort();
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            uppercase_chars(buffer, buffer + size);
+            bench_escape(buffer);
+        }
+        fclose(file);
+    }
+}
+
+/* Fills the file with lines of text. Returns 0 if it can't. */
+static int make_file() {
+    int fd = mkstemp(file_path);
+    if (fd < 0)
+        return 0;
+    static char block[READ_BUFFER_SIZE];
+    for (int i = 0; i < READ_BUFFER_SIZE; ++i)
+        block[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+    for (int written = 0; written < FILE_SIZE; written += READ_BUFFER_SIZE) {
+        if (write(fd, block, READ_BUFFER_SIZE) != READ_BUFFER_SIZE) {
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+    return 1;
+}
+
+static int no_hints = 0;
+static int sequential = MAPPED_SEQUENTIAL;
+
+static struct {
+    char const * name;
+    find_func find;
+} const find_funcs[] = {
+    {"find_char", find_char},
+    {"find_char_fast", find_char_fast},
+    {"find_first_of/2_needles", find_first_of_2},
+    {"find_first_of/4_needles", find_first_of_4},
+    {"find_first_of/8_needles", find_first_of_8},
+    {"memchr", libc_memchr},
+};
+
+#define FIND_FUNC_COUNT (sizeof(find_funcs) / sizeof(find_funcs[0]))
+
+static size_t const find_sizes[] = {16, 256, 4096, 65536, MAX_FIND_SIZE};
+
+#define FIND_SIZE_COUNT (sizeof(find_sizes) / sizeof(find_sizes[0]))
+
+/* bench_add keeps the name and context pointers, so they live here. */
+static find_case_t find_cases[FIND_SIZE_COUNT][FIND_FUNC_COUNT];
+static char find_names[FIND_SIZE_COUNT][FIND_FUNC_COUNT][48];
+
+static change_func change_funcs[] = {capitalize_chars, uppercase_chars};
+
+int main(int argc, char* argv[]) {
+    for (int i = 0; i < MAX_FIND_SIZE; ++i)
+        text[i] = 'a' + i % 26;
+
+    for (size_t s = 0; s < FIND_SIZE_COUNT; ++s) {
+        for (size_t f = 0; f < FIND_FUNC_COUNT; ++f) {
+            find_case_t c = {find_funcs[f].find, find_sizes[s]};
+            find_cases[s][f] = c;
+            snprintf(find_names[s][f], sizeof(find_names[s][f]), "%s/%zu",
+                     find_funcs[f].name, find_sizes[s]);
+            bench_add(find_names[s][f], bench_find, &find_cases[s][f]);
+            bench_set_bytes(find_sizes[s]);
+        }
+    }
+
+    /* These don't write any '!', so the searches above find the same thing
+       whatever order the benchmarks run in. */
+    bench_add("capitalize_chars/4096", bench_change, &change_funcs[0]);
+    bench_set_bytes(TEXT_SIZE);
+    bench_add("uppercase_chars/4096", bench_change, &change_funcs[1]);
+    bench_set_bytes(TEXT_SIZE);
+
+    if (!make_file()) {
+        perror(file_path);
+        return 1;
+    }
+    bench_add("count_lines/64M/mapped", bench_count_lines_mapped, &no_hints);
+    bench_set_bytes(FILE_SIZE);
+    bench_add("count_lines/64M/mapped_sequential", bench_count_lines_mapped,
+              &sequential);
+    bench_set_bytes(FILE_SIZE);
+    bench_add("count_lines/64M/fread", bench_count_lines_fread, NULL);
+    bench_set_bytes(FILE_SIZE);
+    bench_add("uppercase_chars/64M/mapped", bench_capitalize_mapped, NULL);
+    bench_set_bytes(FILE_SIZE);
+    bench_add("uppercase_chars/64M/fread", bench_capitalize_fread, NULL);
+    bench_set_bytes(FILE_SIZE);
+    int status = bench_main(argc, argv);
+
+    unlink(file_path);
+    return status;
+}
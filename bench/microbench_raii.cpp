@@ -0,0 +1,127 @@
+/* Benchmarks of small_vector from 09_raii: how fast elements can be pushed
+   into it, against std::vector, and against a VLA for the small sizes a VLA
+   is safe for.
+
+   Every iteration starts with an empty container and pushes size elements,
+   so the growing is measured too. The small_vector has room for 64 ints
+   inline, so up to 64 it never touches the heap.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../09_raii/small_vector.hpp"
+
+#include "bench.h"
+
+#define INLINE_CAPACITY 64
+
+/* ---- ints ---- */
+
+static void bench_vla(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        int array[size];
+        for (int j = 0; j < size; ++j)
+            array[j] = j;
+        bench_escape(array);
+    }
+}
+
+static void bench_small_vector(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        small_vector<int, INLINE_CAPACITY> vector;
+        for (int j = 0; j < size; ++j)
+            vector.push_back(j);
+        bench_escape(vector.data());
+    }
+}
+
+static void bench_small_vector_reserve(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        small_vector<int, INLINE_CAPACITY> vector;
+        vector.reserve(size);
+        for (int j = 0; j < size; ++j)
+            vector.push_back(j);
+        bench_escape(vector.data());
+    }
+}
+
+static void bench_std_vector(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::vector<int> vector;
+        for (int j = 0; j < size; ++j)
+            vector.push_back(j);
+        bench_escape(vector.data());
+    }
+}
+
+static void bench_std_vector_reserve(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::vector<int> vector;
+        vector.reserve(size);
+        for (int j = 0; j < size; ++j)
+            vector.push_back(j);
+        bench_escape(vector.data());
+    }
+}
+
+/* ---- strings, which are moved one by one instead of realloc'ed ---- */
+
+static void bench_small_vector_string(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    std::string const word = "word";
+    for (uint64_t i = 0; i < iterations; ++i) {
+        small_vector<std::string, INLINE_CAPACITY> vector;
+        for (int j = 0; j < size; ++j)
+            vector.push_back(word);
+        bench_escape(vector.data());
+    }
+}
+
+static void bench_std_vector_string(void* context, uint64_t iterations) {
+    int size = *(int*)context;
+    std::string const word = "word";
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::vector<std::string> vector;
+        for (int j = 0; j < size; ++j)
+            vector.push_back(word);
+        bench_escape(vector.data());
+    }
+}
+
+static int small_sizes[] = {8, 16, 64};
+static int large_sizes[] = {1024, 65536};
+
+/* bench_add keeps the name pointer, so the names live here. */
+static char names[64][48];
+static int name_count = 0;
+
+static void add(char const * what, int* size, bench_func_t func) {
+    char* name = names[name_count++];
+    std::snprintf(name, sizeof(names[0]), "push_back/%s/%d", what, *size);
+    bench_add(name, func, size);
+}
+
+int main(int argc, char* argv[]) {
+    for (int& size : small_sizes) {
+        add("vla", &size, bench_vla);
+        add("small_vector", &size, bench_small_vector);
+        add("std_vector", &size, bench_std_vector);
+        add("std_vector_reserve", &size, bench_std_vector_reserve);
+    }
+    for (int& size : large_sizes) {
+        add("small_vector", &size, bench_small_vector);
+        add("small_vector_reserve", &size, bench_small_vector_reserve);
+        add("std_vector", &size, bench_std_vector);
+        add("std_vector_reserve", &size, bench_std_vector_reserve);
+        add("small_vector_string", &size, bench_small_vector_string);
+        add("std_vector_string", &size, bench_std_vector_string);
+    }
+    return bench_main(argc, argv);
+}
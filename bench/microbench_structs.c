@@ -0,0 +1,91 @@
+/* Benchmarks of the struct copy paths in 03_structs. */
+
+#include <stdio.h>
+
+#include "../03_structs/record.h"
+#include "../03_structs/record_table.h"
+
+#include "bench.h"
+
+#define RECORD_COUNT 1024
+
+static record_t records[RECORD_COUNT];
+static record_t copies[RECORD_COUNT];
+static char* names[RECORD_COUNT];
+
+typedef record_t (*make_record_func)(char* name, int age);
+
+/* make_record returns a record_t by value. It is called through a pointer,
+   so it isn't inlined and the record really is returned. */
+static void bench_make_record(void* context, uint64_t iterations) {
+    make_record_func make = *(make_record_func*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        record_t rec = make(names[i % RECORD_COUNT], (int)i);
+        bench_escape(&rec);
+    }
+}
+
+/* One iteration copies one record with struct assignment. */
+static void bench_struct_assignment(void* context, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(records);
+        copies[i % RECORD_COUNT] = records[i % RECORD_COUNT];
+        bench_escape(copies);
+    }
+}
+
+/* From an array of structs into a table's columns, and back. One iteration
+   copies all RECORD_COUNT records. */
+static void bench_append_structs(void* context, uint64_t iterations) {
+    record_table_t* table = (record_table_t*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        table->size = 0;
+        bench_escape(records);
+        record_table_append_structs(table, records, RECORD_COUNT,
+                                    &record_t_layout);
+        bench_escape(table->ages);
+    }
+}
+
+static void bench_to_structs(void* context, uint64_t iterations) {
+    record_table_t* table = (record_table_t*)context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(table->ages);
+        record_table_to_structs(table, 0, RECORD_COUNT, copies,
+                                &record_t_layout);
+        bench_escape(copies);
+    }
+}
+
+static make_record_func make_record_ptr = make_record;
+
+int main(int argc, char* argv[]) {
+    static char name_text[RECORD_COUNT][16];
+    for (int i = 0; i < RECORD_COUNT; ++i) {
+        snprintf(name_text[i], sizeof(name_text[i]), "name %d", i);
+        names[i] = name_text[i];
+        records[i] = make_record(names[i], 20 + i % 50);
+    }
+
+    /* The table keeps its capacity when its size is reset, so the benchmarks
+       measure copying, not allocating. */
+    record_table_t table;
+    record_table_init(&table);
+    if (!record_table_reserve(&table, RECORD_COUNT) ||
+        !record_table_append_structs(&table, records, RECORD_COUNT,
+                                     &record_t_layout)) {
+        puts("Out of memory!");
+        return 1;
+    }
+
+    bench_add("make_record/return_by_value", bench_make_record,
+              &make_record_ptr);
+    bench_add("struct_assignment", bench_struct_assignment, NULL);
+    bench_add("record_table_append_structs/1024", bench_append_structs,
+              &table);
+    bench_add("record_table_to_structs/1024", bench_to_structs, &table);
+    int status = bench_main(argc, argv);
+
+    record_table_destroy(&table);
+    return status;
+}
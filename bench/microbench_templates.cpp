@@ -0,0 +1,219 @@
+/* Benchmarks of algo::span from 08_templates against the same loops on two
+   raw pointers.
+
+   This file is built twice. microbench_templates gets the build's flags,
+   which in the default Release build include NDEBUG, so the span has no
+   checks and should be about as fast as the raw pointers.
+   microbench_templates_checked is built with SPAN_CHECKS=1, so the span
+   checks every step. The raw versions are the same in both, so
+
+       ./compare.sh microbench_templates.json microbench_templates_checked.json
+
+   shows what the checks cost.
+
+   Without the checks, a raw and a span version compile to nearly the same
+   instructions: their inner loops differ at most in the order of a cmp's
+   operands (see 08_templates/span_codegen.sh for the rest). Yet their times
+   can still differ, by as much as 2x. The loops simply sit at different
+   addresses, and on many Intel processors a loop whose jump crosses a
+   32-byte boundary runs slower. -Wa,-mbranches-within-32B-boundaries
+   makes the assembler avoid that, and the difference goes away.
+*/
+
+#include <cctype>
+#include <cstring>
+
+#include "../08_templates/span.hpp"
+
+#include "bench.h"
+
+#define TEXT_SIZE 4096
+#define NUMBER_COUNT 1024
+
+/* Words, with the char being searched for at the very end, so every
+   search reads all of it. */
+static char text[TEXT_SIZE];
+static int numbers[NUMBER_COUNT];
+
+/* The functions being measured. noinline keeps each one a separate loop,
+   like it would be in a library, instead of being merged into the
+   benchmark's own loop. */
+
+__attribute__((noinline))
+static char* raw_find_char(char* begin, char* end, char ch) {
+    for (; begin != end && *begin != ch; ++begin);
+    return begin;
+}
+
+__attribute__((noinline))
+static algo::span<char>::iterator span_find_char(algo::span<char> s, char ch) {
+    return algo::find_char(s, ch);
+}
+
+__attribute__((noinline))
+static void raw_capitalize_chars(char* begin, char* end) {
+    for (; begin != end; ++begin)
+        *begin = std::toupper(*begin);
+}
+
+__attribute__((noinline))
+static void span_capitalize_chars(algo::span<char> s) {
+    algo::capitalize_chars(s);
+}
+
+__attribute__((noinline))
+static long raw_sum(int const * begin, int const * end) {
+    long sum = 0;
+    for (; begin != end; ++begin)
+        sum += *begin;
+    return sum;
+}
+
+__attribute__((noinline))
+static long span_sum(algo::span<int const> s) {
+    long sum = 0;
+    for (int n : s)
+        sum += n;
+    return sum;
+}
+
+__attribute__((noinline))
+static long raw_sum_indexed(int const * begin, int const * end) {
+    long sum = 0;
+    for (std::size_t i = 0; i < (std::size_t)(end - begin); ++i)
+        sum += begin[i];
+    return sum;
+}
+
+__attribute__((noinline))
+static long span_sum_indexed(algo::span<int const> s) {
+    long sum = 0;
+    for (std::size_t i = 0; i < s.size(); ++i)
+        sum += s[i];
+    return sum;
+}
+
+__attribute__((noinline))
+static std::size_t raw_count_words(char* begin, char* end) {
+    std::size_t count = 0;
+    while (begin != end) {
+        char* space = raw_find_char(begin, end, ' ');
+        if (space != begin)
+            ++count;
+        begin = space == end ? end : space + 1;
+    }
+    return count;
+}
+
+__attribute__((noinline))
+static std::size_t span_count_words(algo::span<char> s) {
+    std::size_t count = 0;
+    while (!s.empty()) {
+        std::pair<algo::span<char>, algo::span<char> > parts = s.split(' ');
+        if (!parts.first.empty())
+            ++count;
+        s = parts.second;
+    }
+    return count;
+}
+
+static void bench_raw_find_char(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(raw_find_char(text, text + TEXT_SIZE, '!'));
+    }
+}
+
+static void bench_span_find_char(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(span_find_char(algo::span<char>(text), '!'));
+    }
+}
+
+static void bench_raw_capitalize_chars(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        raw_capitalize_chars(text, text + TEXT_SIZE);
+    }
+}
+
+static void bench_span_capitalize_chars(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        span_capitalize_chars(algo::span<char>(text));
+    }
+}
+
+static void bench_raw_sum(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(numbers);
+        bench_keep(raw_sum(numbers, numbers + NUMBER_COUNT));
+    }
+}
+
+static void bench_span_sum(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(numbers);
+        bench_keep(span_sum(algo::span<int const>(numbers)));
+    }
+}
+
+static void bench_raw_sum_indexed(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(numbers);
+        bench_keep(raw_sum_indexed(numbers, numbers + NUMBER_COUNT));
+    }
+}
+
+static void bench_span_sum_indexed(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(numbers);
+        bench_keep(span_sum_indexed(algo::span<int const>(numbers)));
+    }
+}
+
+static void bench_raw_count_words(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(raw_count_words(text, text + TEXT_SIZE));
+    }
+}
+
+static void bench_span_count_words(void*, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench_escape(text);
+        bench_keep(span_count_words(algo::span<char>(text)));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    /* words of 1 to 8 letters, separated by spaces */
+    int length = 1;
+    int letters = 0;
+    for (int i = 0; i < TEXT_SIZE; ++i) {
+        if (letters == length) {
+            text[i] = ' ';
+            letters = 0;
+            length = length % 8 + 1;
+        } else {
+            text[i] = 'a' + i % 26;
+            ++letters;
+        }
+    }
+    text[TEXT_SIZE - 1] = '!';
+    for (int i = 0; i < NUMBER_COUNT; ++i)
+        numbers[i] = i * 7 % 100;
+
+    bench_add("find_char/raw/4096", bench_raw_find_char, NULL);
+    bench_add("find_char/span/4096", bench_span_find_char, NULL);
+    bench_add("capitalize_chars/raw/4096", bench_raw_capitalize_chars, NULL);
+    bench_add("capitalize_chars/span/4096", bench_span_capitalize_chars, NULL);
+    bench_add("sum/raw/1024", bench_raw_sum, NULL);
+    bench_add("sum/span/1024", bench_span_sum, NULL);
+    bench_add("sum_indexed/raw/1024", bench_raw_sum_indexed, NULL);
+    bench_add("sum_indexed/span/1024", bench_span_sum_indexed, NULL);
+    bench_add("count_words/raw/4096", bench_raw_count_words, NULL);
+    bench_add("count_words/span/4096", bench_span_count_words, NULL);
+    return bench_main(argc, argv);
+}
@@ -0,0 +1,78 @@
+# Measures the wall clock time of a clean build and of a few incremental
+# builds, with and without precompiled headers.
+#
+# Usage, from the top of the repository:
+#
+#   cmake [-DBINARY_DIR=build-times] [-DJOBS=N] -P cmake/build_times.cmake
+#
+# cmake/compile_times.txt holds the numbers from the last time this was run
+# and committed, as a baseline to compare against.
+
+cmake_minimum_required(VERSION 3.16)
+
+get_filename_component(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if(NOT BINARY_DIR)
+    set(BINARY_DIR "${SOURCE_DIR}/build-times")
+endif()
+get_filename_component(BINARY_DIR "${BINARY_DIR}" ABSOLUTE)
+if(NOT JOBS)
+    cmake_host_system_information(RESULT JOBS QUERY NUMBER_OF_LOGICAL_CORES)
+endif()
+
+# Files touched for the incremental builds: one C++ program, one C helper
+# library file, and a header.
+set(touched
+    10_strings/strings.cpp
+    06_pointer_arithmetic/fast_find.c
+    07_function_ptr/char_class.h)
+
+function(now_ms var)
+    execute_process(COMMAND date +%s%3N OUTPUT_VARIABLE ms
+                    OUTPUT_STRIP_TRAILING_WHITESPACE)
+    set(${var} ${ms} PARENT_SCOPE)
+endfunction()
+
+# build_ms(VAR) builds BINARY_DIR and sets VAR to how long it took.
+function(build_ms var)
+    now_ms(start)
+    execute_process(COMMAND ${CMAKE_COMMAND} --build "${BINARY_DIR}"
+                            --parallel ${JOBS}
+                    RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+    now_ms(end)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "build failed")
+    endif()
+    math(EXPR ms "${end} - ${start}")
+    set(${var} ${ms} PARENT_SCOPE)
+endfunction()
+
+set(text "")
+foreach(pch OFF ON)
+    file(REMOVE_RECURSE "${BINARY_DIR}")
+    execute_process(COMMAND ${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${BINARY_DIR}"
+                            -DTUTORIAL_PCH=${pch}
+                    OUTPUT_QUIET)
+
+    build_ms(clean)
+    string(APPEND text "TUTORIAL_PCH=${pch}\n")
+    string(APPEND text "    clean build                                        ${clean} ms\n")
+
+    foreach(file IN LISTS touched)
+        file(TOUCH "${SOURCE_DIR}/${file}")
+        build_ms(incremental)
+        string(APPEND text "    after touching ${file}")
+        string(LENGTH "${file}" length)
+        math(EXPR spaces "36 - ${length}")
+        if(spaces GREATER 0)
+            string(REPEAT " " ${spaces} padding)
+            string(APPEND text "${padding}")
+        endif()
+        string(APPEND text " ${incremental} ms\n")
+    endforeach()
+endforeach()
+file(REMOVE_RECURSE "${BINARY_DIR}")
+
+cmake_host_system_information(RESULT cpu QUERY PROCESSOR_DESCRIPTION)
+execute_process(COMMAND gcc -dumpfullversion OUTPUT_VARIABLE gcc_version
+                OUTPUT_STRIP_TRAILING_WHITESPACE)
+message("${text}\ngcc ${gcc_version}, ${JOBS} jobs, ${cpu}")
@@ -0,0 +1,174 @@
+# Reports where compile time goes: for every translation unit the time
+# spent in the FRONTEND (preprocessing and parsing, mostly of headers) and
+# the BACKEND (optimizing and generating code), and which headers are the
+# most expensive to parse.
+#
+# Usage, after configuring a build in BINARY_DIR:
+#
+#   cmake -DBINARY_DIR=build -P cmake/compile_time_report.cmake
+#
+# Every file is compiled again with gcc's -ftime-report, which prints the
+# time of each compiler phase, and -H, which prints each included header.
+# (clang's -ftime-trace gives the time of every single header. gcc has no
+# such option, so a header's cost is measured by compiling a file that does
+# nothing but include it.) The report is printed and saved as
+# BINARY_DIR/compile_time_report.txt.
+
+cmake_minimum_required(VERSION 3.19)
+
+if(NOT BINARY_DIR)
+    message(FATAL_ERROR "usage: cmake -DBINARY_DIR=build -P ${CMAKE_CURRENT_LIST_FILE}")
+endif()
+get_filename_component(BINARY_DIR "${BINARY_DIR}" ABSOLUTE)
+get_filename_component(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+file(READ "${BINARY_DIR}/compile_commands.json" commands)
+set(scratch "${BINARY_DIR}/compile_time_report")
+file(MAKE_DIRECTORY "${scratch}")
+
+# CMake's math() only does integers, so times are kept in milliseconds.
+# to_ms(VAR "0.24") sets VAR to 240.
+function(to_ms var seconds)
+    string(REGEX MATCH "^([0-9]+)\\.([0-9]+)$" ignored "${seconds}")
+    set(fraction "${CMAKE_MATCH_2}000")
+    string(SUBSTRING "${fraction}" 0 3 fraction)
+    math(EXPR ms "${CMAKE_MATCH_1} * 1000 + 1${fraction} - 1000")
+    set(${var} ${ms} PARENT_SCOPE)
+endfunction()
+
+# phase_ms(VAR OUTPUT PHASE) sets VAR to the wall time, in ms, of PHASE in
+# the -ftime-report OUTPUT, or 0 if it isn't there.
+function(phase_ms var output phase)
+    # " phase parsing   :   0.24 ( 86%)   0.13 ( 93%)   0.38 ( 88%) ..."
+    #                        user           system        wall
+    set(time "[0-9]+\\.[0-9]+ *\\( *[0-9]+%\\)")
+    if(output MATCHES "phase ${phase} *: *${time} *${time} *([0-9]+\\.[0-9]+)")
+        to_ms(ms "${CMAKE_MATCH_1}")
+    else()
+        set(ms 0)
+    endif()
+    set(${var} ${ms} PARENT_SCOPE)
+endfunction()
+
+# pad(VAR WIDTH VALUE) right aligns VALUE in WIDTH characters.
+function(pad var width value)
+    string(LENGTH "${value}" length)
+    while(length LESS width)
+        string(PREPEND value " ")
+        math(EXPR length "${length} + 1")
+    endwhile()
+    set(${var} "${value}" PARENT_SCOPE)
+endfunction()
+
+string(JSON count LENGTH "${commands}")
+math(EXPR last "${count} - 1")
+
+set(report "")
+set(headers "")
+set(total_frontend 0)
+set(total_backend 0)
+
+foreach(i RANGE ${last})
+    string(JSON source GET "${commands}" ${i} file)
+    string(JSON directory GET "${commands}" ${i} directory)
+    string(JSON command GET "${commands}" ${i} command)
+    if(source MATCHES "tutorial_pch\\.")
+        continue()
+    endif()
+
+    # Compile to a scratch object, so the build itself isn't touched.
+    separate_arguments(args UNIX_COMMAND "${command}")
+    list(FIND args "-o" output_index)
+    math(EXPR output_index "${output_index} + 1")
+    list(REMOVE_AT args ${output_index})
+    list(INSERT args ${output_index} "${scratch}/object.o")
+
+    execute_process(COMMAND ${args} -ftime-report -H
+                    WORKING_DIRECTORY "${directory}"
+                    ERROR_VARIABLE output OUTPUT_QUIET)
+
+    phase_ms(setup "${output}" "setup")
+    phase_ms(parsing "${output}" "parsing")
+    phase_ms(deferred "${output}" "lang\\. deferred")
+    phase_ms(backend "${output}" "opt and generate")
+    math(EXPR frontend "${setup} + ${parsing} + ${deferred}")
+    math(EXPR total_frontend "${total_frontend} + ${frontend}")
+    math(EXPR total_backend "${total_backend} + ${backend}")
+
+    file(RELATIVE_PATH name "${SOURCE_DIR}" "${source}")
+    pad(frontend_text 10 "${frontend}")
+    pad(backend_text 9 "${backend}")
+    string(APPEND report "${frontend_text} ${backend_text}  ${name}\n")
+
+    # -H prints one line per header, with one dot per level of nesting.
+    # Only headers the file includes itself are measured, with the command
+    # line of the first file that includes them. A precompiled header
+    # shows up as "! name.gch", and its -include option is dropped so it
+    # doesn't skew the measurement.
+    string(REGEX MATCHALL "\n\\. [^\n]+" includes "\n${output}")
+    list(FIND args "-include" include_index)
+    if(include_index GREATER -1)
+        math(EXPR included_index "${include_index} + 1")
+        list(REMOVE_AT args ${include_index} ${included_index})
+    endif()
+    foreach(include IN LISTS includes)
+        string(REGEX REPLACE "^\n\\. " "" header "${include}")
+        get_filename_component(header "${header}" ABSOLUTE
+                               BASE_DIR "${directory}")
+        if(header MATCHES "^${BINARY_DIR}" OR header IN_LIST headers)
+            continue()
+        endif()
+        list(APPEND headers "${header}")
+        string(MAKE_C_IDENTIFIER "${header}" id)
+        set(header_args_${id} "${args}")
+        set(header_source_${id} "${source}")
+        set(header_directory_${id} "${directory}")
+    endforeach()
+endforeach()
+
+# Each header on its own: compile a file that only includes it.
+set(header_costs "")
+foreach(header IN LISTS headers)
+    string(MAKE_C_IDENTIFIER "${header}" id)
+    get_filename_component(extension "${header_source_${id}}" LAST_EXT)
+    set(stub "${scratch}/only_header${extension}")
+    file(WRITE "${stub}" "#include \"${header}\"\n")
+
+    set(args "${header_args_${id}}")
+    list(TRANSFORM args REPLACE "^${header_source_${id}}$" "${stub}")
+    execute_process(COMMAND ${args} -ftime-report
+                    WORKING_DIRECTORY "${header_directory_${id}}"
+                    ERROR_VARIABLE output OUTPUT_QUIET)
+    phase_ms(parsing "${output}" "parsing")
+    phase_ms(deferred "${output}" "lang\\. deferred")
+    math(EXPR cost "${parsing} + ${deferred}")
+
+    # zero padded, so sorting the strings sorts by cost
+    pad(cost_text 6 "${cost}")
+    string(REPLACE " " "0" cost_text "${cost_text}")
+    list(APPEND header_costs "${cost_text} ${header}")
+endforeach()
+list(SORT header_costs ORDER DESCENDING)
+list(SUBLIST header_costs 0 15 header_costs)
+
+set(text "time per translation unit, in ms of wall time\n\n")
+string(APPEND text "  frontend   backend  file\n${report}")
+pad(frontend_text 10 "${total_frontend}")
+pad(backend_text 9 "${total_backend}")
+string(APPEND text "${frontend_text} ${backend_text}  total\n\n")
+string(APPEND text "most expensive headers, in ms to parse on their own\n\n")
+foreach(entry IN LISTS header_costs)
+    string(REGEX MATCH "^0*([0-9]+) (.*)$" ignored "${entry}")
+    pad(cost_text 8 "${CMAKE_MATCH_1}")
+    # The project's own headers are shown relative to the source directory,
+    # so the report reads the same wherever the repository is checked out.
+    set(header "${CMAKE_MATCH_2}")
+    string(FIND "${header}" "${SOURCE_DIR}/" source_index)
+    if(source_index EQUAL 0)
+        file(RELATIVE_PATH header "${SOURCE_DIR}" "${header}")
+    endif()
+    string(APPEND text "${cost_text}  ${header}\n")
+endforeach()
+
+file(WRITE "${BINARY_DIR}/compile_time_report.txt" "${text}")
+file(REMOVE_RECURSE "${scratch}")
+message("${text}")
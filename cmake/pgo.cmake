@@ -0,0 +1,44 @@
+# Builds every lesson with profile guided optimization:
+#
+#   1. build with TUTORIAL_PGO_PHASE=generate, which records a profile,
+#   2. build and run the train target to record it,
+#   3. rebuild the same tree with TUTORIAL_PGO_PHASE=use.
+#
+# Usage, from the top of the repository:
+#
+#   cmake -DBINARY_DIR=build-pgo [-DGENERATOR=Ninja] -P cmake/pgo.cmake
+#
+# The optimized programs end up in BINARY_DIR, and ninja bench (or make
+# bench) there runs the benchmarks with them.
+
+cmake_minimum_required(VERSION 3.13)
+
+get_filename_component(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if(NOT BINARY_DIR)
+    set(BINARY_DIR "${SOURCE_DIR}/build-pgo")
+endif()
+get_filename_component(BINARY_DIR "${BINARY_DIR}" ABSOLUTE)
+
+set(generator_args)
+if(GENERATOR)
+    set(generator_args -G "${GENERATOR}")
+endif()
+
+function(run)
+    message(STATUS "pgo: ${ARGN}")
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "pgo: failed: ${ARGN}")
+    endif()
+endfunction()
+
+# Old profiles would be mixed into the new one, so start from scratch.
+file(REMOVE_RECURSE "${BINARY_DIR}/pgo-profile")
+
+run(${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${BINARY_DIR}" ${generator_args}
+    -DCMAKE_BUILD_TYPE=Pgo -DTUTORIAL_PGO_PHASE=generate)
+run(${CMAKE_COMMAND} --build "${BINARY_DIR}" --target train)
+
+run(${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${BINARY_DIR}"
+    -DTUTORIAL_PGO_PHASE=use)
+run(${CMAKE_COMMAND} --build "${BINARY_DIR}")
@@ -0,0 +1,447 @@
+#include "instrument.h"
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+/* Scopes nested deeper than this, usually from deep recursion, are not
+   recorded. Their time still counts towards the scope around them. */
+#define MAX_DEPTH 128
+
+/* cycles, instructions, cache misses, branch misses */
+#define EVENT_COUNT 4
+
+static char const * const event_names[EVENT_COUNT] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"
+};
+
+/* One node of a call tree: a scope name, reached through a particular chain
+   of enclosing scopes. Nodes refer to each other by index, because the array
+   holding them moves when it grows. Node 0 is the root, which stands for
+   "no scope". */
+typedef struct {
+    char const * name;
+    int parent;
+    int first_child;
+    int last_child;
+    int next_sibling;
+    uint64_t calls;
+    uint64_t ticks;        /* including the time of child scopes */
+    uint64_t child_ticks;
+    uint64_t events[EVENT_COUNT];
+} node_t;
+
+typedef struct {
+    char const * name;
+    int64_t total;
+} counter_t;
+
+/* Everything one thread records. Only that thread writes to it, so it needs
+   no locks. */
+typedef struct thread_data {
+    struct thread_data* next;  /* the list of all threads, see all_threads */
+    int id;
+
+    node_t* nodes;
+    int node_count;
+    int node_capacity;
+    int current;  /* the innermost running scope */
+    int depth;
+
+    int perf_fd;  /* the performance counters, -1 if there are none */
+    uint64_t start_events[MAX_DEPTH][EVENT_COUNT];
+
+    counter_t* counters;
+    int counter_count;
+    int counter_capacity;
+} thread_data_t;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int enabled;
+static int use_perf;
+static char const * json_path;
+static char const * folded_path;
+
+/* to convert ticks to nanoseconds at the end */
+static uint64_t start_ticks;
+static struct timespec start_time;
+
+/* Threads add themselves to the front of this list with a compare and swap,
+   so the list never needs a lock. Entries are never removed: a thread's
+   results are still wanted after it has finished. */
+static _Atomic(thread_data_t*) all_threads;
+static atomic_int thread_count;
+
+static _Thread_local thread_data_t* this_thread;
+
+static void init() {
+    json_path = getenv("INSTRUMENT_JSON");
+    folded_path = getenv("INSTRUMENT_FOLDED");
+    char const * perf = getenv("INSTRUMENT_PERF");
+    use_perf = perf != NULL && strcmp(perf, "0") != 0;
+    enabled = json_path != NULL || folded_path != NULL;
+
+    if (enabled) {
+        start_ticks = __rdtsc();
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        atexit(instrument_dump);
+    }
+}
+
+/* ---------- performance counters ---------- */
+
+static int open_event(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    /* pid 0, cpu -1: this thread, on whichever processor it runs */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/* Opens the four counters as one GROUP, so a single read gets all of them.
+   Returns the group's file descriptor, or -1. */
+static int open_perf_group() {
+    static uint64_t const configs[EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    int fds[EVENT_COUNT];
+    fds[0] = open_event(configs[0], -1);
+    for (int i = 1; i < EVENT_COUNT; ++i) {
+        fds[i] = fds[0] < 0 ? -1 : open_event(configs[i], fds[0]);
+        if (fds[i] < 0) {
+            for (int j = 0; j < i; ++j)
+                close(fds[j]);
+            return -1;
+        }
+    }
+    return fds[0];
+}
+
+static void read_events(int perf_fd, uint64_t* events) {
+    /* PERF_FORMAT_GROUP gives the number of counters, then their values */
+    uint64_t values[1 + EVENT_COUNT];
+    if (read(perf_fd, values, sizeof(values)) == sizeof(values))
+        memcpy(events, values + 1, sizeof(uint64_t) * EVENT_COUNT);
+    else
+        memset(events, 0, sizeof(uint64_t) * EVENT_COUNT);
+}
+
+/* ---------- recording ---------- */
+
+/* Returns the index of a new node, or -1 if out of memory. */
+static int add_node(thread_data_t* thread, char const * name, int parent) {
+    if (thread->node_count == thread->node_capacity) {
+        int capacity = thread->node_capacity ? thread->node_capacity * 2 : 64;
+        node_t* nodes = (node_t*)realloc(thread->nodes,
+                                         capacity * sizeof(node_t));
+        if (nodes == NULL)
+            return -1;
+        thread->nodes = nodes;
+        thread->node_capacity = capacity;
+    }
+
+    int index = thread->node_count++;
+    node_t* node = &thread->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->name = name;
+    node->parent = parent;
+    node->first_child = -1;
+    node->last_child = -1;
+    node->next_sibling = -1;
+
+    /* children are kept in the order they first ran */
+    if (parent >= 0) {
+        node_t* parent_node = &thread->nodes[parent];
+        if (parent_node->last_child >= 0)
+            thread->nodes[parent_node->last_child].next_sibling = index;
+        else
+            parent_node->first_child = index;
+        parent_node->last_child = index;
+    }
+    return index;
+}
+
+static thread_data_t* get_thread_data() {
+    if (this_thread != NULL)
+        return this_thread;
+
+    thread_data_t* thread = (thread_data_t*)calloc(1, sizeof(thread_data_t));
+    if (thread == NULL)
+        return NULL;
+    thread->id = atomic_fetch_add(&thread_count, 1);
+    thread->perf_fd = use_perf ? open_perf_group() : -1;
+    if (add_node(thread, NULL, -1) != 0) {
+        free(thread);
+        return NULL;
+    }
+
+    thread->next = atomic_load(&all_threads);
+    while (!atomic_compare_exchange_weak(&all_threads, &thread->next, thread));
+
+    this_thread = thread;
+    return thread;
+}
+
+/* The same name can be a different pointer in different files, so compare
+   the text too, but only if the pointers differ. */
+static int same_name(char const * a, char const * b) {
+    return a == b || strcmp(a, b) == 0;
+}
+
+instrument_scope_t instrument_scope_begin(char const * name) {
+    instrument_scope_t scope = {-1, 0};
+    pthread_once(&init_once, init);
+    if (!enabled)
+        return scope;
+
+    thread_data_t* thread = get_thread_data();
+    if (thread == NULL || thread->depth == MAX_DEPTH)
+        return scope;
+
+    int child = thread->nodes[thread->current].first_child;
+    while (child >= 0 && !same_name(thread->nodes[child].name, name))
+        child = thread->nodes[child].next_sibling;
+    if (child < 0)
+        child = add_node(thread, name, thread->current);
+    if (child < 0)
+        return scope;
+
+    thread->current = child;
+    if (thread->perf_fd >= 0)
+        read_events(thread->perf_fd, thread->start_events[thread->depth]);
+    ++thread->depth;
+
+    scope.node = child;
+    /* last, so the work above isn't counted */
+    scope.start = __rdtsc();
+    return scope;
+}
+
+void instrument_scope_end(instrument_scope_t* scope) {
+    if (scope->node < 0)
+        return;
+    uint64_t end = __rdtsc();
+
+    thread_data_t* thread = this_thread;
+    node_t* node = &thread->nodes[scope->node];
+    uint64_t elapsed = end - scope->start;
+    node->ticks += elapsed;
+    ++node->calls;
+    thread->nodes[node->parent].child_ticks += elapsed;
+
+    --thread->depth;
+    if (thread->perf_fd >= 0) {
+        uint64_t events[EVENT_COUNT];
+        read_events(thread->perf_fd, events);
+        for (int i = 0; i < EVENT_COUNT; ++i)
+            node->events[i] += events[i] - thread->start_events[thread->depth][i];
+    }
+    thread->current = node->parent;
+}
+
+void instrument_count(char const * name, int64_t amount) {
+    pthread_once(&init_once, init);
+    if (!enabled)
+        return;
+    thread_data_t* thread = get_thread_data();
+    if (thread == NULL)
+        return;
+
+    for (int i = 0; i < thread->counter_count; ++i) {
+        if (same_name(thread->counters[i].name, name)) {
+            thread->counters[i].total += amount;
+            return;
+        }
+    }
+
+    if (thread->counter_count == thread->counter_capacity) {
+        int capacity = thread->counter_capacity ? thread->counter_capacity * 2 : 16;
+        counter_t* counters = (counter_t*)realloc(thread->counters,
+                                                  capacity * sizeof(counter_t));
+        if (counters == NULL)
+            return;
+        thread->counters = counters;
+        thread->counter_capacity = capacity;
+    }
+    counter_t counter = {name, amount};
+    thread->counters[thread->counter_count++] = counter;
+}
+
+/* ---------- output ---------- */
+
+static double ticks_per_ns;
+
+static void compute_ticks_per_ns() {
+    struct timespec now;
+    uint64_t now_ticks = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ns = (now.tv_sec - start_time.tv_sec) * 1e9 +
+                (now.tv_nsec - start_time.tv_nsec);
+    ticks_per_ns = ns > 0 ? (now_ticks - start_ticks) / ns : 1;
+}
+
+/* A scope that is still running when the results are written, like main
+   when instrument_dump is called from it, has no time of its own yet, but
+   its finished children do. */
+static uint64_t self_ticks(node_t const * node) {
+    return node->ticks > node->child_ticks ? node->ticks - node->child_ticks : 0;
+}
+
+static void write_json_string(FILE* out, char const * text) {
+    fputc('"', out);
+    for (; *text != '\0'; ++text) {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*text >= ' ')
+            fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json_node(FILE* out, thread_data_t const * thread, int index,
+                            int indent, int use_events) {
+    node_t const * node = &thread->nodes[index];
+    fprintf(out, "%*s{\"name\": ", indent, "");
+    write_json_string(out, node->name);
+    fprintf(out, ", \"calls\": %llu, \"ticks\": %llu, \"self_ticks\": %llu, "
+            "\"ns\": %.0f, \"self_ns\": %.0f",
+            (unsigned long long)node->calls, (unsigned long long)node->ticks,
+            (unsigned long long)self_ticks(node),
+            node->ticks / ticks_per_ns,
+            self_ticks(node) / ticks_per_ns);
+    if (use_events) {
+        for (int i = 0; i < EVENT_COUNT; ++i)
+            fprintf(out, ", \"%s\": %llu", event_names[i],
+                    (unsigned long long)node->events[i]);
+    }
+
+    fprintf(out, ", \"children\": [");
+    for (int child = node->first_child; child >= 0;
+         child = thread->nodes[child].next_sibling) {
+        fprintf(out, "\n");
+        write_json_node(out, thread, child, indent + 2, use_events);
+        if (thread->nodes[child].next_sibling >= 0)
+            fprintf(out, ",");
+    }
+    fprintf(out, "]}");
+}
+
+static void write_json(FILE* out, thread_data_t* threads) {
+    int have_events = 0;
+    for (thread_data_t* thread = threads; thread != NULL; thread = thread->next)
+        have_events |= thread->perf_fd >= 0;
+
+    fprintf(out, "{\"ticks_per_ns\": %.4f, \"hardware_counters\": %s,\n",
+            ticks_per_ns, have_events ? "true" : "false");
+
+    fprintf(out, "\"threads\": [");
+    for (thread_data_t* thread = threads; thread != NULL; thread = thread->next) {
+        fprintf(out, "\n {\"thread\": %d, \"scopes\": [", thread->id);
+        for (int child = thread->nodes[0].first_child; child >= 0;
+             child = thread->nodes[child].next_sibling) {
+            fprintf(out, "\n");
+            write_json_node(out, thread, child, 2, thread->perf_fd >= 0);
+            if (thread->nodes[child].next_sibling >= 0)
+                fprintf(out, ",");
+        }
+        fprintf(out, "]}%s", thread->next != NULL ? "," : "");
+    }
+
+    /* Counters with the same name are added up over all threads. The first
+       thread that has a name prints the total. */
+    fprintf(out, "],\n\"counters\": {");
+    int first = 1;
+    for (thread_data_t* thread = threads; thread != NULL; thread = thread->next) {
+        for (int i = 0; i < thread->counter_count; ++i) {
+            char const * name = thread->counters[i].name;
+            int printed = 0;
+            for (thread_data_t* before = threads; before != thread && !printed;
+                 before = before->next) {
+                for (int j = 0; j < before->counter_count && !printed; ++j)
+                    printed = same_name(before->counters[j].name, name);
+            }
+            if (printed)
+                continue;
+
+            int64_t total = 0;
+            for (thread_data_t* other = thread; other != NULL; other = other->next) {
+                for (int j = 0; j < other->counter_count; ++j) {
+                    if (same_name(other->counters[j].name, name))
+                        total += other->counters[j].total;
+                }
+            }
+            fprintf(out, "%s\n  ", first ? "" : ",");
+            write_json_string(out, name);
+            fprintf(out, ": %lld", (long long)total);
+            first = 0;
+        }
+    }
+    fprintf(out, "}}\n");
+}
+
+/* Folded stacks have one line per call tree node: the names from the root
+   down, separated by ';', then the node's own time, here in nanoseconds.
+   ';' and spaces in names would confuse the tools, so they become '_'. */
+static void write_folded_node(FILE* out, thread_data_t const * thread,
+                              int index, char* path, size_t path_length) {
+    node_t const * node = &thread->nodes[index];
+    size_t length = path_length;
+    path[length++] = ';';
+    for (char const * ch = node->name; *ch != '\0' && length < 4000; ++ch)
+        path[length++] = (*ch == ';' || *ch == ' ') ? '_' : *ch;
+    path[length] = '\0';
+
+    fprintf(out, "%s %.0f\n", path,
+            self_ticks(node) / ticks_per_ns);
+    for (int child = node->first_child; child >= 0;
+         child = thread->nodes[child].next_sibling)
+        write_folded_node(out, thread, child, path, length);
+}
+
+static void write_folded(FILE* out, thread_data_t* threads) {
+    char path[4096 + 64];
+    for (thread_data_t* thread = threads; thread != NULL; thread = thread->next) {
+        int length = snprintf(path, sizeof(path), "thread_%d", thread->id);
+        for (int child = thread->nodes[0].first_child; child >= 0;
+             child = thread->nodes[child].next_sibling)
+            write_folded_node(out, thread, child, path, length);
+    }
+}
+
+static void write_file(char const * path,
+                       void (*write)(FILE*, thread_data_t*),
+                       thread_data_t* threads) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return;
+    }
+    write(out, threads);
+    fclose(out);
+}
+
+void instrument_dump(void) {
+    pthread_once(&init_once, init);
+    if (!enabled)
+        return;
+
+    compute_ticks_per_ns();
+    thread_data_t* threads = atomic_load(&all_threads);
+    if (json_path != NULL)
+        write_file(json_path, write_json, threads);
+    if (folded_path != NULL)
+        write_file(folded_path, write_folded, threads);
+}
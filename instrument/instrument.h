@@ -0,0 +1,111 @@
+/* Measuring where a program spends its time, from the inside. */
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+
+/* A SCOPED TIMER measures a block of code, from where it is declared to the
+   end of the enclosing { }:
+
+       void load_records() {
+           INSTRUMENT_FUNCTION();
+           ...
+           {
+               INSTRUMENT_SCOPE("parse");
+               ...
+           }
+       }
+
+   C has no destructors, but gcc's cleanup attribute comes close: it calls a
+   function when a variable goes out of scope, however the scope is left.
+   The same macros work in C++, where they also stop the timer when an
+   exception passes through.
+
+   Timers that run inside other timers are nested, so the results form a
+   CALL TREE per thread, like a profiler shows: how long each scope took, how
+   much of that was its own code, and how often it ran. Time is measured
+   with the processor's time stamp counter (rdtsc), which takes a few
+   nanoseconds to read (more in virtual machines that trap it), so a timer
+   costs less than the clock functions. A timer that isn't recording costs
+   a function call and a branch or two.
+
+   INSTRUMENTED(call) times a single statement, under the name of its text:
+
+       INSTRUMENTED(demonstrate_slicing());
+
+   Nothing is recorded unless one of these environment variables is set:
+
+   INSTRUMENT_JSON=FILE      write the call trees and counters as JSON to
+                             FILE when the program exits
+   INSTRUMENT_FOLDED=FILE    write them as "folded stacks", the input format
+                             of flamegraph.pl and speedscope:
+                             main;use_expressions;eval 1234
+   INSTRUMENT_PERF=1         also count cycles, instructions, cache misses
+                             and branch misses for every scope, with the
+                             processor's performance counters (Linux
+                             perf_event_open). Reading them is a system call,
+                             so this is much slower, and they aren't
+                             available in most virtual machines.
+
+   Building with -DNO_INSTRUMENT turns all of the macros into nothing.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Treat as private. */
+typedef struct {
+    int node;        /* index in this thread's call tree, -1 if not recording */
+    uint64_t start;  /* rdtsc when the scope was entered */
+} instrument_scope_t;
+
+/* name must stay valid until the program exits, a string literal is best. */
+instrument_scope_t instrument_scope_begin(char const * name);
+void instrument_scope_end(instrument_scope_t* scope);
+
+/* Adds amount to the counter called name, for things that aren't time, like
+   "bytes read" or "cache hits". Each thread adds to its own copy, so there is
+   no locking or atomic instruction. The copies are added up at exit. */
+void instrument_count(char const * name, int64_t amount);
+
+/* Writes the output files now, instead of at exit. */
+void instrument_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef NO_INSTRUMENT
+
+/* __LINE__ has to go through two macros to be replaced by its value before
+   being pasted into a variable name. */
+#define INSTRUMENT_CONCAT2(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT2(a, b)
+
+#define INSTRUMENT_SCOPE(name) \
+    instrument_scope_t INSTRUMENT_CONCAT(instrument_scope_, __LINE__) \
+        __attribute__((cleanup(instrument_scope_end))) = \
+        instrument_scope_begin(name)
+
+#define INSTRUMENT_FUNCTION() INSTRUMENT_SCOPE(__func__)
+
+#define INSTRUMENTED(call) \
+    do { \
+        INSTRUMENT_SCOPE(#call); \
+        call; \
+    } while (0)
+
+#define INSTRUMENT_COUNT(name, amount) instrument_count(name, amount)
+
+#else
+
+#define INSTRUMENT_SCOPE(name) do { } while (0)
+#define INSTRUMENT_FUNCTION() do { } while (0)
+#define INSTRUMENTED(call) call
+#define INSTRUMENT_COUNT(name, amount) do { } while (0)
+
+#endif /* NO_INSTRUMENT */
+
+#endif /* INSTRUMENT_H */